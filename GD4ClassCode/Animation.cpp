@@ -3,6 +3,8 @@
 #include <SFML/Graphics/RenderTarget.hpp>
 #include <SFML/Graphics/Texture.hpp>
 
+#include <algorithm>
+
 
 Animation::Animation()
 	: mSprite()
@@ -86,6 +88,32 @@ bool Animation::isFinished() const
 	return mCurrentFrame >= mNumFrames;
 }
 
+void Animation::setProgress(std::size_t frame, sf::Time elapsed)
+{
+	mCurrentFrame = frame;
+	mElapsedTime = elapsed;
+
+	const sf::Texture* texture = mSprite.getTexture();
+	if (!texture || mFrameSize.x <= 0)
+		return;
+
+	// Same layout update() walks through: left to right, then down a line
+	std::size_t framesPerLine = std::max(texture->getSize().x / static_cast<unsigned int>(mFrameSize.x), 1u);
+	int left = static_cast<int>(frame % framesPerLine) * mFrameSize.x;
+	int top = static_cast<int>(frame / framesPerLine) * mFrameSize.y;
+	mSprite.setTextureRect(sf::IntRect(left, top, mFrameSize.x, mFrameSize.y));
+}
+
+std::size_t Animation::getCurrentFrame() const
+{
+	return mCurrentFrame;
+}
+
+sf::Time Animation::getElapsedTime() const
+{
+	return mElapsedTime;
+}
+
 sf::FloatRect Animation::getLocalBounds() const
 {
 	return sf::FloatRect(getOrigin(), static_cast<sf::Vector2f>(getFrameSize()));
@@ -27,6 +27,11 @@ public:
 	void 					restart();
 	bool 					isFinished() const;
 
+	// Progress through the frames, e.g. to save and restore it with the owner's state
+	void 					setProgress(std::size_t frame, sf::Time elapsed);
+	std::size_t 			getCurrentFrame() const;
+	sf::Time 				getElapsedTime() const;
+
 	sf::FloatRect 			getLocalBounds() const;
 	sf::FloatRect 			getGlobalBounds() const;
 
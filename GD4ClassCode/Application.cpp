@@ -5,6 +5,8 @@
 #include "TitleState.hpp"
 #include "GameState.hpp"
 #include "MultiplayerGameState.hpp"
+#include "LockstepGameState.hpp"
+#include "ReplayState.hpp"
 #include "MenuState.hpp"
 #include "PauseState.hpp"
 #include "SettingsState.hpp"
@@ -123,14 +125,20 @@ void Application::registerStates()
 	mStateStack.registerState<GameState>(States::Game);
 	mStateStack.registerState<MultiplayerGameState>(States::HostGame, true);
 	mStateStack.registerState<MultiplayerGameState>(States::JoinGame, false);
+	mStateStack.registerState<MultiplayerGameState>(States::Spectate, false, true);
+	mStateStack.registerState<LockstepGameState>(States::LockstepHost, true);
+	mStateStack.registerState<LockstepGameState>(States::LockstepJoin, false);
+	mStateStack.registerState<ReplayState>(States::Replay);
 	mStateStack.registerState<PauseState>(States::Pause);
 	mStateStack.registerState<PauseState>(States::NetworkPause, true);
 	mStateStack.registerState<SettingsState>(States::Settings);
 	mStateStack.registerState<OptionsState>(States::Options);
 	mStateStack.registerState<HighScoreState>(States::HighScore);
-	mStateStack.registerState<GameOverState>(States::MissionSuccess1, "Player 1 Wins!");
-	mStateStack.registerState<GameOverState>(States::MissionSuccess2, "Player 2 Wins!");
+	mStateStack.registerState<GameOverState>(States::MissionSuccess1, "Player 1 Wins!", true);
+	mStateStack.registerState<GameOverState>(States::MissionSuccess2, "Player 2 Wins!", true);
 	mStateStack.registerState<GameOverState>(States::MissionDraw, "You Suck, Draw!");
+	mStateStack.registerState<GameOverState>(States::RematchDraw, "You Suck, Draw!", true);
 	mStateStack.registerState<GameOverState>(States::GameOver, "Mission Failed!");
+	mStateStack.registerState<GameOverState>(States::RematchGameOver, "Mission Failed!", true);
 	mStateStack.registerState<GameOverState>(States::MissionSuccess, "Mission Successful!");
 }
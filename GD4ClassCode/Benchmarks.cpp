@@ -0,0 +1,607 @@
+#include "Benchmarks.hpp"
+#include "BotSystem.hpp"
+#include "Broadphase.hpp"
+#include "CommandQueue.hpp"
+#include "Entity.hpp"
+#include "EntityStore.hpp"
+#include "PacketOutbox.hpp"
+#include "Pickup.hpp"
+#include "Projectile.hpp"
+#include "ResourceHolder.hpp"
+#include "SceneNode.hpp"
+#include "SoundPlayer.hpp"
+#include "SpatialIndex.hpp"
+#include "World.hpp"
+#include "Foreach.hpp"
+#include "Utility.hpp"
+
+#include <SFML/System/Clock.hpp>
+#include <SFML/System/Sleep.hpp>
+#include <SFML/Graphics/RenderTexture.hpp>
+#include <SFML/Network/IpAddress.hpp>
+#include <SFML/Network/TcpListener.hpp>
+#include <SFML/Network/TcpSocket.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+	// Projectile's steering rate
+	const float ApproachRate = 200.f;
+
+	// Stand-in for a Projectile in the collision benchmark, no textures needed
+	class BenchmarkNode : public SceneNode
+	{
+	public:
+		explicit BenchmarkNode(Category::Type category)
+			: SceneNode(category)
+		{
+		}
+
+		virtual sf::FloatRect getBoundingRect() const
+		{
+			return sf::FloatRect(getPosition(), sf::Vector2f(6.f, 6.f));
+		}
+	};
+
+	// What Entity and Projectile::updateCurrent() used to do, for the entity benchmark
+	class LegacyEntity : public SceneNode
+	{
+	public:
+		LegacyEntity(sf::Vector2f velocity, bool guided)
+			: mVelocity(velocity)
+			, mTargetDirection(0.f, 1.f)
+			, mGuided(guided)
+		{
+		}
+
+	private:
+		virtual void updateCurrent(sf::Time dt, CommandQueue&)
+		{
+			if (mGuided)
+			{
+				sf::Vector2f newVelocity = unitVector(ApproachRate * dt.asSeconds() * mTargetDirection + mVelocity);
+				newVelocity *= 150.f;
+				setRotation(toDegree(std::atan2(newVelocity.y, newVelocity.x)) + 90.f);
+				mVelocity = newVelocity;
+			}
+
+			move(mVelocity * dt.asSeconds());
+		}
+
+		sf::Vector2f mVelocity;
+		sf::Vector2f mTargetDirection;
+		bool mGuided;
+	};
+
+	// Stand-in for characters, bullets and missiles in the store benchmarks, no textures needed
+	class BenchmarkEntity : public Entity
+	{
+	public:
+		BenchmarkEntity(EntityStore& store, Category::Type category, int identifier)
+			: Entity(store, 1)
+			, mCategory(category)
+			, mIdentifier(identifier)
+		{
+		}
+
+		virtual unsigned int getCategory() const
+		{
+			return mCategory;
+		}
+
+		int getIdentifier() const
+		{
+			return mIdentifier;
+		}
+
+		// Flies like a missile towards a fixed direction
+		void guide(float maxSpeed, sf::Vector2f direction)
+		{
+			setGuided(maxSpeed);
+			setTargetDirection(direction);
+		}
+
+	private:
+		Category::Type mCategory;
+		int mIdentifier;
+	};
+
+	SceneNode* addNode(SceneNode& parent, Category::Type category, std::size_t children)
+	{
+		SceneNode::Ptr node(new SceneNode(category));
+		for (std::size_t i = 0; i < children; ++i)
+			node->attachChild(SceneNode::Ptr(new SceneNode()));
+
+		SceneNode* result = node.get();
+		parent.attachChild(std::move(node));
+		return result;
+	}
+
+	// Roughly World's graph in a busy match: projectiles carry two emitters, characters five texts
+	void buildCommandScene(SceneNode& root)
+	{
+		addNode(root, Category::None, 1);
+		SceneNode* lowerAir = addNode(root, Category::SceneAirLayer, 0);
+		SceneNode* upperAir = addNode(root, Category::None, 0);
+
+		for (int i = 0; i < 2000; ++i)
+			addNode(*lowerAir, Category::AlliedProjectile, 2);
+		addNode(*lowerAir, Category::ParticleSystem, 0);
+		addNode(*lowerAir, Category::ParticleSystem, 0);
+
+		for (int i = 0; i < 30; ++i)
+			addNode(*upperAir, Category::Platform, 0);
+		for (int i = 0; i < 4; ++i)
+			addNode(*upperAir, Category::PlayerCharacter, 5);
+		for (int i = 0; i < 20; ++i)
+			addNode(*upperAir, Category::Pickup, 0);
+
+		addNode(root, Category::SoundEffect, 0);
+		addNode(root, Category::Network, 0);
+	}
+
+	// Bullets fly sideways, every 25th entity is a falling pickup, every 50th a platform, every 100th a missile
+	sf::Vector2f entityVelocity(std::size_t i)
+	{
+		if (i % 100 == 0)
+			return sf::Vector2f(0.f, -150.f);
+		if (i % 50 == 0)
+			return sf::Vector2f();
+		if (i % 25 == 0)
+			return sf::Vector2f(0.f, 250.f);
+		return sf::Vector2f(i % 2 ? 400.f : -400.f, 0.f);
+	}
+
+	// Spread without clustering, the same on every run
+	float spatialCoordinate(std::size_t i, std::size_t salt, float extent)
+	{
+		return static_cast<float>((i * 7919 + salt * 104729) % 10007) / 10007.f * extent;
+	}
+
+	// An odd size, so the socket buffer rarely fills up exactly at a packet boundary; the content identifies the packet
+	std::string outboxPayload(sf::Int32 sequence)
+	{
+		return std::string(16411, static_cast<char>('a' + sequence % 26));
+	}
+}
+
+void runBotBenchmark()
+{
+	const std::size_t botCounts[] = { 1, 8, 64, 512 };
+	const std::size_t humans = 8;
+	const int iterations = 200;
+	const sf::Time dt = sf::seconds(1.f / BotSystem::UpdatesPerSecond);
+
+	for (std::size_t bots : botCounts)
+	{
+		BotSystem system;
+		for (std::size_t i = 0; i < bots; ++i)
+			system.addBot(static_cast<sf::Int32>(i + 1), static_cast<sf::Uint32>(i * 7919 + 1));
+
+		sf::Clock clock;
+		for (int iteration = 0; iteration < iterations; ++iteration)
+		{
+			// Same gather the server does: every bot and human moves a little each update
+			system.clearTargets();
+			for (std::size_t i = 0; i < bots; ++i)
+			{
+				sf::Vector2f position(static_cast<float>((i * 97 + iteration * 13) % 1024), static_cast<float>((i * 31) % 768));
+				system.setBotState(i, position, 2);
+				system.addTarget(static_cast<sf::Int32>(i + 1), position);
+			}
+			for (std::size_t h = 0; h < humans; ++h)
+				system.addTarget(static_cast<sf::Int32>(bots + h + 1), sf::Vector2f(static_cast<float>(h * 128), 400.f));
+
+			system.update(dt);
+		}
+
+		float perUpdate = clock.getElapsedTime().asMicroseconds() / static_cast<float>(iterations);
+		std::cout << "Bots: " << bots << " bots, " << humans << " humans: " << perUpdate << " us per AI update, "
+			<< perUpdate / bots << " us per bot (" << perUpdate * BotSystem::UpdatesPerSecond / 10000.f << "% of a core at "
+			<< BotSystem::UpdatesPerSecond << " updates/s)" << std::endl;
+	}
+}
+
+void runCollisionBenchmark()
+{
+	// Same density for every count, like a bigger arena: at 1000 projectiles, a 1024 x 768 screen.
+	// Projectiles fly in streams of 50, a few px apart, so neighbours overlap; every hundredth node is a character.
+	// Filtered, projectiles only test against characters
+	const std::vector<std::size_t> counts = { 1000, 2500, 5000, 10000 };
+	const unsigned int everything = ~0u;
+	const int frames = 30;
+
+	FOREACH(std::size_t count, counts)
+	{
+		float scale = std::sqrt(count / 1000.f);
+		sf::Vector2f area(1024.f * scale, 768.f * scale);
+
+		std::vector<std::unique_ptr<BenchmarkNode>> nodes;
+		std::vector<sf::Vector2f> velocities;
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			nodes.emplace_back(new BenchmarkNode(i % 100 == 0 ? Category::PlayerCharacter : Category::AlliedProjectile));
+			std::size_t stream = i / 50;
+			sf::Vector2f start(std::fmod(stream * 97.31f, area.x), std::fmod(stream * 61.17f, area.y));
+			sf::Vector2f velocity(std::fmod(stream * 13.f, 400.f) - 200.f, std::fmod(stream * 7.f, 400.f) - 200.f);
+			nodes.back()->setPosition(start + velocity * ((i % 50) * 4.f / 200.f));
+			velocities.push_back(velocity);
+		}
+
+		Broadphase broadphase(64.f);
+		std::vector<SceneNode::Pair> pairs;
+		sf::Time gridTime, filteredTime, bruteTime;
+		std::size_t gridPairs = 0, filteredPairs = 0, brutePairs = 0;
+
+		for (int frame = 0; frame < frames; ++frame)
+		{
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				sf::Vector2f position = nodes[i]->getPosition() + velocities[i] / 60.f;
+				nodes[i]->setPosition(std::fmod(position.x + area.x, area.x), std::fmod(position.y + area.y, area.y));
+			}
+
+			sf::Clock clock;
+			broadphase.clear();
+			pairs.clear();
+			FOREACH(auto& node, nodes)
+				broadphase.insert(*node, everything);
+			broadphase.findPairs(pairs);
+			gridTime += clock.getElapsedTime();
+			gridPairs += pairs.size();
+
+			clock.restart();
+			broadphase.clear();
+			pairs.clear();
+			FOREACH(auto& node, nodes)
+			{
+				bool character = (node->getCategory() & Category::PlayerCharacter) != 0;
+				broadphase.insert(*node, character ? Category::PlayerCharacter | Category::Projectile : Category::PlayerCharacter);
+			}
+			broadphase.findPairs(pairs);
+			filteredTime += clock.getElapsedTime();
+			filteredPairs += pairs.size();
+
+			// What checkSceneCollision used to do, minus the scene graph recursion and std::set
+			clock.restart();
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				sf::FloatRect bounds = nodes[i]->getBoundingRect();
+				for (std::size_t j = i + 1; j < count; ++j)
+					brutePairs += bounds.intersects(nodes[j]->getBoundingRect()) ? 1 : 0;
+			}
+			bruteTime += clock.getElapsedTime();
+		}
+
+		std::cout << "Broadphase: " << count << " nodes: grid " << gridTime.asMicroseconds() / frames << " us ("
+			<< gridTime.asMicroseconds() / frames * 1000.f / count << " ns each), filtered " << filteredTime.asMicroseconds() / frames
+			<< " us, all pairs " << bruteTime.asMicroseconds() / frames << " us; " << gridPairs / frames << " pairs per frame, "
+			<< filteredPairs / frames << " with a response" << (gridPairs == brutePairs ? "" : " MISMATCH") << std::endl;
+	}
+}
+
+void runCommandBenchmark()
+{
+	const int frames = 300;
+	sf::Time times[2];
+	std::size_t visits[2] = { 0, 0 };
+
+	for (int indexed = 0; indexed < 2; ++indexed)
+	{
+		SceneNode root;
+		if (indexed)
+			root.enableCategoryIndex();
+		buildCommandScene(root);
+
+		std::size_t& visited = visits[indexed];
+		auto push = [&visited] (CommandQueue& queue, unsigned int category, int count)
+		{
+			Command command;
+			command.category = category;
+			command.action = [&visited] (SceneNode&, sf::Time) { ++visited; };
+			for (int i = 0; i < count; ++i)
+				queue.push(command);
+		};
+
+		// One frame's commands: movement, the out-of-view check, fire, sounds and new emitters' particle finders
+		CommandQueue queue;
+		for (int frame = 0; frame < frames; ++frame)
+		{
+			push(queue, Category::PlayerCharacter, 4);
+			push(queue, Category::Projectile | Category::EnemyCharacter, 1);
+			push(queue, Category::SceneAirLayer, 1);
+			push(queue, Category::SoundEffect, 4);
+			push(queue, Category::ParticleSystem, 8);
+
+			sf::Clock clock;
+			while (!queue.isEmpty())
+				root.onCommand(queue.pop(), sf::Time::Zero);
+			times[indexed] += clock.getElapsedTime();
+		}
+	}
+
+	std::cout << "Command queue: drain per frame, tree walk " << times[0].asMicroseconds() / frames << " us, category index "
+		<< times[1].asMicroseconds() / frames << " us; " << visits[1] / frames << " nodes commanded per frame"
+		<< (visits[0] == visits[1] ? "" : " MISMATCH") << std::endl;
+}
+
+void runEntityBenchmark()
+{
+	const std::size_t count = 5000;
+	const int frames = 300;
+	const sf::Time dt = sf::seconds(1.f / 60.f);
+	CommandQueue commands;
+
+	// Before: every entity is a node whose updateCurrent() moves it
+	SceneNode legacyRoot;
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		SceneNode::Ptr node(new LegacyEntity(entityVelocity(i), i % 100 == 0));
+		node->setPosition(static_cast<float>(i % 1024), static_cast<float>(i / 1024 * 100));
+		legacyRoot.attachChild(std::move(node));
+	}
+
+	sf::Clock clock;
+	for (int frame = 0; frame < frames; ++frame)
+		legacyRoot.update(dt, commands);
+	sf::Time legacyTime = clock.getElapsedTime();
+
+	// After: the same entities in a store; the scene graph walk is left with nothing to do for them
+	EntityStore store;
+	SceneNode root;
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		std::unique_ptr<BenchmarkEntity> entity(new BenchmarkEntity(store, Category::None, static_cast<int>(i + 1)));
+		entity->setPosition(static_cast<float>(i % 1024), static_cast<float>(i / 1024 * 100));
+		entity->setVelocity(entityVelocity(i));
+		if (i % 100 == 0)
+			entity->guide(150.f, sf::Vector2f(0.f, 1.f));
+		root.attachChild(std::move(entity));
+	}
+
+	sf::Time walkTime, systemTime;
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		clock.restart();
+		root.update(dt, commands);
+		walkTime += clock.restart();
+		store.update(dt);
+		systemTime += clock.getElapsedTime();
+	}
+
+	std::cout << "Entity store: " << count << " entities, updateCurrent() overrides " << legacyTime.asMicroseconds() / frames
+		<< " us per frame; systems " << systemTime.asMicroseconds() / frames << " us plus "
+		<< walkTime.asMicroseconds() / frames << " us for the remaining scene graph walk" << std::endl;
+}
+
+void runSpatialBenchmark()
+{
+	const std::size_t missiles = 2000;
+	const std::size_t targetCounts[] = { 8, 64, 512 };
+	const int frames = 100;
+	const sf::FloatRect bounds(0.f, 0.f, 1024.f, 768.f);
+
+	for (std::size_t t = 0; t < sizeof(targetCounts) / sizeof(targetCounts[0]); ++t)
+	{
+		std::size_t targets = targetCounts[t];
+
+		EntityStore store;
+		store.setSpatialBounds(bounds);
+
+		std::vector<std::unique_ptr<BenchmarkEntity>> entities;
+		std::vector<BenchmarkEntity*> targetList;
+		for (std::size_t i = 0; i < targets; ++i)
+		{
+			entities.emplace_back(new BenchmarkEntity(store, Category::PlayerCharacter, static_cast<int>(i + 1)));
+			entities.back()->setPosition(spatialCoordinate(i, 1, bounds.width), spatialCoordinate(i, 2, bounds.height));
+			targetList.push_back(entities.back().get());
+		}
+		for (std::size_t i = 0; i < missiles; ++i)
+		{
+			entities.emplace_back(new BenchmarkEntity(store, Category::AlliedProjectile, static_cast<int>(i % targets + 1)));
+			entities.back()->setPosition(spatialCoordinate(i, 3, bounds.width), spatialCoordinate(i, 4, bounds.height));
+		}
+
+		// Before: every missile measures the distance to every other player
+		sf::Clock clock;
+		std::size_t scanChecksum = 0;
+		for (int frame = 0; frame < frames; ++frame)
+		{
+			for (std::size_t i = targets; i < entities.size(); ++i)
+			{
+				BenchmarkEntity& missile = *entities[i];
+				float minDistance = std::numeric_limits<float>::max();
+				BenchmarkEntity* closest = nullptr;
+				for (std::size_t j = 0; j < targetList.size(); ++j)
+				{
+					float targetDistance = distance(missile, *targetList[j]);
+					if (targetDistance < minDistance && targetList[j]->getIdentifier() != missile.getIdentifier())
+					{
+						closest = targetList[j];
+						minDistance = targetDistance;
+					}
+				}
+				scanChecksum += closest ? closest->getIdentifier() : 0;
+			}
+		}
+		sf::Time scanTime = clock.getElapsedTime();
+
+		// After: refresh the index once per frame, then ask it
+		clock.restart();
+		std::size_t indexChecksum = 0;
+		for (int frame = 0; frame < frames; ++frame)
+		{
+			store.refreshSpatialIndex();
+			for (std::size_t i = targets; i < entities.size(); ++i)
+			{
+				BenchmarkEntity& missile = *entities[i];
+				int shooter = missile.getIdentifier();
+				Entity* closest = store.queryNearest(missile.getWorldPosition(), Category::PlayerCharacter, [shooter](Entity& target)
+				{
+					return static_cast<BenchmarkEntity&>(target).getIdentifier() != shooter;
+				});
+				indexChecksum += closest ? static_cast<BenchmarkEntity*>(closest)->getIdentifier() : 0;
+			}
+		}
+		sf::Time indexTime = clock.getElapsedTime();
+
+		std::cout << "Spatial index: " << missiles << " missiles, " << targets << " targets: scan " << scanTime.asMicroseconds() / frames
+			<< " us, index " << indexTime.asMicroseconds() / frames << " us per frame"
+			<< (scanChecksum == indexChecksum ? "" : " (targets differ!)") << std::endl;
+	}
+}
+
+void runRollbackBenchmark()
+{
+	const sf::Time dt = sf::seconds(1.f / 60.f);
+	const sf::Uint32 maxDepth = 8;
+	const int iterations = 200;
+
+	// What World needs, without a window; muted like a re-simulating LockstepGameState
+	sf::RenderTexture target;
+	target.create(1024, 768);
+	FontHolder fonts;
+	fonts.load(Fonts::Main, "Media/Sansation.ttf");
+	SoundPlayer sounds;
+
+	setRandomSeed(1);
+	World world(target, fonts, sounds, false);
+	world.setMuted(true);
+
+	// Four players in a busy exchange: bullet streams, every tenth shot a missile, pickups lying around
+	for (int i = 0; i < 4; ++i)
+		world.addCharacter(i + 1, 100.f + 200.f * i, 100.f);
+	for (std::size_t i = 0; i < 300; ++i)
+	{
+		Projectile::Type type = (i % 10 == 0) ? Projectile::Missile : Projectile::AlliedBullet;
+		sf::Vector2f position(static_cast<float>(i * 37 % 1000 + 12), static_cast<float>(i * 53 % 700 + 34));
+		sf::Vector2f velocity(i % 2 ? 400.f : -400.f, 0.f);
+		world.createProjectile(type, static_cast<int>(i % 4 + 1), position, velocity, i % 2 ? 90.f : 270.f);
+	}
+	for (std::size_t i = 0; i < 12; ++i)
+		world.createPickup(sf::Vector2f(80.f * i + 40.f, 300.f), static_cast<Pickup::Type>(i % Pickup::TypeCount));
+
+	// A few ticks in, so the state is one the simulation produced
+	for (int tick = 0; tick < 10; ++tick)
+		world.update(dt);
+
+	World::Snapshot snapshot;
+	sf::Clock clock;
+	for (int i = 0; i < iterations; ++i)
+		world.saveState(snapshot);
+	sf::Time saveTime = clock.getElapsedTime();
+
+	clock.restart();
+	for (int i = 0; i < iterations; ++i)
+		world.restoreState(snapshot);
+	sf::Time restoreTime = clock.getElapsedTime();
+
+	std::cout << "Rollback: " << snapshot.characters.size() << " characters, " << snapshot.projectiles.size() << " projectiles, "
+		<< snapshot.pickups.size() << " pickups: save " << saveTime.asMicroseconds() / iterations << " us, restore "
+		<< restoreTime.asMicroseconds() / iterations << " us" << std::endl;
+
+	// What LockstepGameState::rollback() does for a late input depth ticks back
+	for (sf::Uint32 depth = 1; depth <= maxDepth; ++depth)
+	{
+		sf::Time total, worst;
+		for (int i = 0; i < iterations; ++i)
+		{
+			clock.restart();
+			world.restoreState(snapshot);
+			for (sf::Uint32 tick = 0; tick < depth; ++tick)
+				world.update(dt);
+
+			sf::Time elapsed = clock.getElapsedTime();
+			total += elapsed;
+			worst = std::max(worst, elapsed);
+		}
+
+		float average = total.asMicroseconds() / static_cast<float>(iterations);
+		std::cout << "  re-simulate " << depth << " ticks: avg " << average << " us, max " << worst.asMicroseconds() << " us ("
+			<< average / dt.asMicroseconds() * 100.f << "% of a frame)" << std::endl;
+	}
+}
+
+bool runOutboxCheck()
+{
+	const sf::Int32 heartbeat = -1;
+
+	// A loopback connection whose receiving side doesn't read until the sending side's buffer is full
+	sf::TcpListener listener;
+	sf::TcpSocket sender, receiver;
+	if (listener.listen(sf::Socket::AnyPort) != sf::Socket::Done
+		|| receiver.connect(sf::IpAddress::LocalHost, listener.getLocalPort(), sf::seconds(1.f)) != sf::Socket::Done
+		|| listener.accept(sender) != sf::Socket::Done)
+	{
+		std::cout << "Packet outbox: no loopback connection, nothing checked" << std::endl;
+		return false;
+	}
+
+	sender.setBlocking(false);
+	receiver.setBlocking(false);
+
+	// Packets that must arrive, each followed by a droppable one like the server's heartbeats, until
+	// a few wait behind a partially sent one
+	PacketOutbox outbox(sender);
+	sf::Int32 sent = 0;
+	std::size_t partialSends = 0, droppedHeartbeats = 0;
+	while (sent < 100000 && outbox.getQueuedCount() < 16)
+	{
+		sf::Packet packet;
+		packet << sent << outboxPayload(sent);
+		partialSends += (outbox.send(packet) == sf::Socket::Partial) ? 1 : 0;
+		sent++;
+
+		sf::Packet droppable;
+		droppable << heartbeat;
+		droppedHeartbeats += (outbox.send(droppable, true) == sf::Socket::NotReady) ? 1 : 0;
+	}
+
+	std::size_t queued = outbox.getQueuedCount();
+	if (partialSends == 0)
+	{
+		std::cout << "Packet outbox: no send came back partial, nothing checked" << std::endl;
+		return false;
+	}
+
+	// Read back while the outbox drains: every packet in order and complete, heartbeats only between packets
+	sf::Int32 expected = 0;
+	bool intact = true;
+	sf::Clock clock;
+	while (expected < sent && intact && clock.getElapsedTime() < sf::seconds(10.f))
+	{
+		outbox.flush();
+
+		sf::Packet packet;
+		while (intact && receiver.receive(packet) == sf::Socket::Done)
+		{
+			sf::Int32 sequence;
+			std::string payload;
+			packet >> sequence;
+			if (sequence != heartbeat)
+			{
+				packet >> payload;
+				intact = (sequence == expected++ && payload == outboxPayload(sequence));
+			}
+
+			intact = intact && packet && packet.endOfPacket();
+		}
+
+		sf::sleep(sf::milliseconds(1));
+	}
+
+	bool passed = intact && expected == sent && outbox.isEmpty();
+	std::cout << "Packet outbox: " << sent << " packets of " << outboxPayload(0).size() << " bytes, " << partialSends << " partial sends, "
+		<< queued << " queued at most, " << droppedHeartbeats << " heartbeats dropped; "
+		<< (passed ? "all decoded in order" : "STREAM BROKEN at packet " + toString(expected)) << std::endl;
+
+	return passed;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+
+// Headless measurements and checks behind main's flags; each prints its results and returns
+
+// Cost per bot of BotSystem::update() for a range of bot counts
+void		runBotBenchmark();
+
+// Unfiltered grid, filtered grid and all-pairs timings of Broadphase for growing numbers of moving projectile-sized rects
+void		runCollisionBenchmark();
+
+// Time to drain a frame's worth of commands into a busy scene graph, walking the whole tree against the root's category index
+void		runCommandBenchmark();
+
+// Update times for 5000 entities: scene graph updateCurrent() overrides against the EntityStore systems
+void		runEntityBenchmark();
+
+// Homing stress scene: every missile picks its closest target, by scanning all targets and through the SpatialIndex
+void		runSpatialBenchmark();
+
+// Lockstep rollback costs in a busy World: saveState(), restoreState(), and restoring plus re-simulating 1 to 8 ticks
+void		runRollbackBenchmark();
+
+// Forces partial sends through a PacketOutbox on a loopback connection and checks that the receiving side still
+// decodes every packet, in order; false if the stream broke
+bool		runOutboxCheck();
@@ -0,0 +1,184 @@
+#include "BotSystem.hpp"
+#include "NetworkProtocol.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+namespace
+{
+	const sf::Uint8 MoveLeftBit = 1 << PlayerActions::MoveLeft;
+	const sf::Uint8 MoveRightBit = 1 << PlayerActions::MoveRight;
+	const sf::Uint8 JumpBit = 1 << PlayerActions::Jump;
+	const sf::Uint8 FireBit = 1 << PlayerActions::Fire;
+	const sf::Uint8 MissileBit = 1 << PlayerActions::LaunchMissile;
+
+	// Tuned against the Eagle: bullets fly straight, so line up vertically before firing
+	const float FollowDeadZone = 30.f;
+	const float JumpHeight = 60.f;
+	const float FireRangeX = 500.f;
+	const float FireRangeY = 50.f;
+	const float MissileRangeX = 250.f;
+	const float MissileCooldown = 4.f;
+	const float StuckDistance = 2.f;
+}
+
+BotSystem::BotSystem()
+{
+}
+
+void BotSystem::addBot(sf::Int32 identifier, sf::Uint32 seed)
+{
+	mIdentifiers.push_back(identifier);
+	mPositionX.push_back(0.f);
+	mPositionY.push_back(0.f);
+	mLastPositionX.push_back(0.f);
+	mMissileAmmo.push_back(0);
+	mMissileCooldown.push_back(MissileCooldown);
+	mRandomState.push_back(seed ? seed : 1);
+	mActionMask.push_back(0);
+	mPreviousActionMask.push_back(0);
+	mChosenTarget.push_back(0);
+}
+
+void BotSystem::removeBot(sf::Int32 identifier)
+{
+	auto found = std::find(mIdentifiers.begin(), mIdentifiers.end(), identifier);
+	if (found == mIdentifiers.end())
+		return;
+
+	// Swap with the last slot, order doesn't matter and the arrays stay dense
+	std::size_t slot = found - mIdentifiers.begin();
+	std::size_t last = mIdentifiers.size() - 1;
+
+	mIdentifiers[slot] = mIdentifiers[last];				mIdentifiers.pop_back();
+	mPositionX[slot] = mPositionX[last];					mPositionX.pop_back();
+	mPositionY[slot] = mPositionY[last];					mPositionY.pop_back();
+	mLastPositionX[slot] = mLastPositionX[last];			mLastPositionX.pop_back();
+	mMissileAmmo[slot] = mMissileAmmo[last];				mMissileAmmo.pop_back();
+	mMissileCooldown[slot] = mMissileCooldown[last];		mMissileCooldown.pop_back();
+	mRandomState[slot] = mRandomState[last];				mRandomState.pop_back();
+	mActionMask[slot] = mActionMask[last];					mActionMask.pop_back();
+	mPreviousActionMask[slot] = mPreviousActionMask[last];	mPreviousActionMask.pop_back();
+	mChosenTarget.pop_back();
+}
+
+std::size_t BotSystem::getBotCount() const
+{
+	return mIdentifiers.size();
+}
+
+const std::vector<sf::Int32>& BotSystem::getIdentifiers() const
+{
+	return mIdentifiers;
+}
+
+void BotSystem::setBotState(std::size_t slot, sf::Vector2f position, sf::Int32 missileAmmo)
+{
+	mPositionX[slot] = position.x;
+	mPositionY[slot] = position.y;
+	mMissileAmmo[slot] = missileAmmo;
+}
+
+void BotSystem::clearTargets()
+{
+	mTargetIdentifiers.clear();
+	mTargetX.clear();
+	mTargetY.clear();
+}
+
+void BotSystem::addTarget(sf::Int32 identifier, sf::Vector2f position)
+{
+	mTargetIdentifiers.push_back(identifier);
+	mTargetX.push_back(position.x);
+	mTargetY.push_back(position.y);
+}
+
+void BotSystem::update(sf::Time dt)
+{
+	const std::size_t bots = mIdentifiers.size();
+	const std::size_t targets = mTargetIdentifiers.size();
+	const float seconds = dt.asSeconds();
+
+	// Pass 1: nearest target per bot
+	for (std::size_t i = 0; i < bots; ++i)
+	{
+		float closest = std::numeric_limits<float>::max();
+		std::size_t chosen = targets;
+
+		for (std::size_t t = 0; t < targets; ++t)
+		{
+			float dx = mTargetX[t] - mPositionX[i];
+			float dy = mTargetY[t] - mPositionY[i];
+			float distanceSquared = dx * dx + dy * dy;
+
+			if (distanceSquared < closest && mTargetIdentifiers[t] != mIdentifiers[i])
+			{
+				closest = distanceSquared;
+				chosen = t;
+			}
+		}
+
+		mChosenTarget[i] = chosen;
+	}
+
+	// Pass 2: new action mask per bot
+	for (std::size_t i = 0; i < bots; ++i)
+	{
+		mPreviousActionMask[i] = mActionMask[i];
+		mMissileCooldown[i] = std::max(mMissileCooldown[i] - seconds, 0.f);
+
+		sf::Uint8 mask = 0;
+		std::size_t t = mChosenTarget[i];
+		if (t < targets)
+		{
+			float dx = mTargetX[t] - mPositionX[i];
+			float dy = mTargetY[t] - mPositionY[i];
+			float distanceX = std::abs(dx);
+
+			if (dx < -FollowDeadZone)
+				mask |= MoveLeftBit;
+			else if (dx > FollowDeadZone)
+				mask |= MoveRightBit;
+
+			// Jump for targets above, when pushing against something, and now and then to be harder to hit
+			bool stuck = (mask & (MoveLeftBit | MoveRightBit)) && std::abs(mPositionX[i] - mLastPositionX[i]) < StuckDistance;
+			if (dy < -JumpHeight || stuck || nextRandom(i) % 16 == 0)
+				mask |= JumpBit;
+
+			if (distanceX < FireRangeX && std::abs(dy) < FireRangeY)
+				mask |= FireBit;
+
+			if (distanceX < MissileRangeX && std::abs(dy) < FireRangeY && mMissileAmmo[i] > 0 && mMissileCooldown[i] <= 0.f)
+			{
+				mask |= MissileBit;
+				mMissileCooldown[i] = MissileCooldown;
+			}
+		}
+
+		mActionMask[i] = mask;
+		mLastPositionX[i] = mPositionX[i];
+	}
+}
+
+sf::Uint8 BotSystem::getActionMask(std::size_t slot) const
+{
+	return mActionMask[slot];
+}
+
+sf::Uint8 BotSystem::getPreviousActionMask(std::size_t slot) const
+{
+	return mPreviousActionMask[slot];
+}
+
+sf::Uint32 BotSystem::nextRandom(std::size_t slot)
+{
+	// xorshift32, one state per bot keeps the loop free of shared state
+	sf::Uint32 x = mRandomState[slot];
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	mRandomState[slot] = x;
+	return x;
+}
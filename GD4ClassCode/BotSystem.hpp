@@ -0,0 +1,60 @@
+#pragma once
+
+#include <SFML/Config.hpp>
+#include <SFML/System/Time.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include <vector>
+
+
+// Decisions for the server's bot players. Bot state lives in parallel arrays indexed by slot, so an update
+// is a couple of tight loops over contiguous memory: the server gathers positions in, calls update() at the
+// AI rate, and scatters the action masks that changed out as ordinary player input
+class BotSystem
+{
+public:
+	static const sf::Int32		UpdatesPerSecond = 5;
+
+
+public:
+								BotSystem();
+
+	void						addBot(sf::Int32 identifier, sf::Uint32 seed);
+	void						removeBot(sf::Int32 identifier);
+	std::size_t					getBotCount() const;
+	const std::vector<sf::Int32>& getIdentifiers() const;
+
+	// Gather: slot follows getIdentifiers()
+	void						setBotState(std::size_t slot, sf::Vector2f position, sf::Int32 missileAmmo);
+
+	// Characters the bots may chase, bots included; a bot never chases itself
+	void						clearTargets();
+	void						addTarget(sf::Int32 identifier, sf::Vector2f position);
+
+	void						update(sf::Time dt);
+
+	// Scatter: PlayerActions bitmask after the last update, and before it
+	sf::Uint8					getActionMask(std::size_t slot) const;
+	sf::Uint8					getPreviousActionMask(std::size_t slot) const;
+
+
+private:
+	sf::Uint32					nextRandom(std::size_t slot);
+
+
+private:
+	std::vector<sf::Int32>		mIdentifiers;
+	std::vector<float>			mPositionX;
+	std::vector<float>			mPositionY;
+	std::vector<float>			mLastPositionX;			// to notice a bot stuck against a wall
+	std::vector<sf::Int32>		mMissileAmmo;
+	std::vector<float>			mMissileCooldown;		// seconds
+	std::vector<sf::Uint32>		mRandomState;
+	std::vector<sf::Uint8>		mActionMask;
+	std::vector<sf::Uint8>		mPreviousActionMask;
+	std::vector<std::size_t>	mChosenTarget;			// scratch, index into the target arrays
+
+	std::vector<sf::Int32>		mTargetIdentifiers;
+	std::vector<float>			mTargetX;
+	std::vector<float>			mTargetY;
+};
@@ -0,0 +1,151 @@
+#include "Broadphase.hpp"
+#include "Foreach.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+namespace
+{
+	// Bounds the grid's memory when a stray entity ends up far away; cells just grow then
+	const std::size_t MaxCellsPerAxis = 256;
+}
+
+Broadphase::Broadphase(float cellSize)
+	: mCellSize(cellSize)
+	, mEntries()
+	, mOrigin()
+	, mCellExtent()
+	, mColumns(0)
+	, mRows(0)
+	, mCellStart()
+	, mCellEntries()
+	, mPairs()
+{
+}
+
+void Broadphase::clear()
+{
+	mEntries.clear();
+}
+
+void Broadphase::insert(SceneNode& node, unsigned int collidesWith)
+{
+	if (collidesWith == Category::None)
+		return;
+
+	// An empty rect never intersects anything (layers, sounds, text, emitters)
+	sf::FloatRect bounds = node.getBoundingRect();
+	if (bounds.width <= 0.f || bounds.height <= 0.f)
+		return;
+
+	Entry entry = { &node, bounds, node.getCategory(), collidesWith };
+	mEntries.push_back(entry);
+}
+
+void Broadphase::findPairs(std::vector<SceneNode::Pair>& pairs)
+{
+	if (mEntries.size() < 2)
+		return;
+
+	buildGrid();
+	mPairs.clear();
+
+	for (std::size_t cell = 0; cell + 1 < mCellStart.size(); ++cell)
+	{
+		sf::Uint32 begin = mCellStart[cell];
+		sf::Uint32 end = mCellStart[cell + 1];
+
+		for (sf::Uint32 a = begin; a < end; ++a)
+		{
+			sf::Uint32 first = mCellEntries[a];
+			const Entry& firstEntry = mEntries[first];
+			const sf::FloatRect& firstBounds = firstEntry.bounds;
+
+			for (sf::Uint32 b = a + 1; b < end; ++b)
+			{
+				sf::Uint32 second = mCellEntries[b];
+				const Entry& secondEntry = mEntries[second];
+				const sf::FloatRect& secondBounds = secondEntry.bounds;
+
+				// No response registered for this category pair, skip the rect test
+				if (!(firstEntry.collidesWith & secondEntry.category) && !(secondEntry.collidesWith & firstEntry.category))
+					continue;
+
+				if (!firstBounds.intersects(secondBounds))
+					continue;
+
+				// Report from the cell that holds the overlap's top-left corner only
+				float left = std::max(firstBounds.left, secondBounds.left);
+				float top = std::max(firstBounds.top, secondBounds.top);
+				CellRange owner = getCellRange(sf::FloatRect(left, top, 0.f, 0.f));
+				if (owner.top * mColumns + owner.left == cell)
+					mPairs.push_back(std::make_pair(first, second));
+			}
+		}
+	}
+
+	std::sort(mPairs.begin(), mPairs.end());
+
+	FOREACH(auto& pair, mPairs)
+		pairs.push_back(SceneNode::Pair(mEntries[pair.first].node, mEntries[pair.second].node));
+}
+
+std::size_t Broadphase::getNodeCount() const
+{
+	return mEntries.size();
+}
+
+void Broadphase::buildGrid()
+{
+	// Fit the grid to this pass' entries
+	sf::Vector2f minimum(std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+	sf::Vector2f maximum(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
+	FOREACH(const Entry& entry, mEntries)
+	{
+		minimum.x = std::min(minimum.x, entry.bounds.left);
+		minimum.y = std::min(minimum.y, entry.bounds.top);
+		maximum.x = std::max(maximum.x, entry.bounds.left + entry.bounds.width);
+		maximum.y = std::max(maximum.y, entry.bounds.top + entry.bounds.height);
+	}
+
+	sf::Vector2f size = maximum - minimum;
+	mOrigin = minimum;
+	mColumns = std::min(MaxCellsPerAxis, std::max<std::size_t>(1, static_cast<std::size_t>(std::ceil(size.x / mCellSize))));
+	mRows = std::min(MaxCellsPerAxis, std::max<std::size_t>(1, static_cast<std::size_t>(std::ceil(size.y / mCellSize))));
+	mCellExtent = sf::Vector2f(std::max(mCellSize, size.x / mColumns), std::max(mCellSize, size.y / mRows));
+
+	// Counting sort: count per cell, prefix sums, then fill; entries are visited in order, so every cell's
+	// list is ascending
+	mCellStart.assign(mColumns * mRows + 1, 0);
+	FOREACH(const Entry& entry, mEntries)
+	{
+		CellRange range = getCellRange(entry.bounds);
+		for (std::size_t y = range.top; y <= range.bottom; ++y)
+			for (std::size_t x = range.left; x <= range.right; ++x)
+				mCellStart[y * mColumns + x + 1]++;
+	}
+
+	for (std::size_t cell = 1; cell < mCellStart.size(); ++cell)
+		mCellStart[cell] += mCellStart[cell - 1];
+
+	mCellEntries.resize(mCellStart.back());
+	std::vector<sf::Uint32> fill(mCellStart.begin(), mCellStart.end() - 1);
+	for (sf::Uint32 index = 0; index < mEntries.size(); ++index)
+	{
+		CellRange range = getCellRange(mEntries[index].bounds);
+		for (std::size_t y = range.top; y <= range.bottom; ++y)
+			for (std::size_t x = range.left; x <= range.right; ++x)
+				mCellEntries[fill[y * mColumns + x]++] = index;
+	}
+}
+
+Broadphase::CellRange Broadphase::getCellRange(const sf::FloatRect& bounds) const
+{
+	auto column = [this] (float x) { return std::min(mColumns - 1, static_cast<std::size_t>(std::max(0.f, (x - mOrigin.x) / mCellExtent.x))); };
+	auto row = [this] (float y) { return std::min(mRows - 1, static_cast<std::size_t>(std::max(0.f, (y - mOrigin.y) / mCellExtent.y))); };
+
+	CellRange range = { column(bounds.left), row(bounds.top), column(bounds.left + bounds.width), row(bounds.top + bounds.height) };
+	return range;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "SceneNode.hpp"
+
+#include <SFML/Config.hpp>
+#include <SFML/Graphics/Rect.hpp>
+
+#include <utility>
+#include <vector>
+
+
+// Uniform grid over the bounding rects of the collidable nodes, rebuilt every pass with a counting sort.
+// Only nodes sharing a cell are tested, and a pair is reported by the one cell holding the top-left corner of
+// its overlap, so nodes spanning several cells need no duplicate check. Pairs come out in insertion order
+// (first inserted first), the order the old all-pairs scene graph test produced, so peers stay in lockstep.
+// Every node carries the categories it has a response for; pairs neither side cares about are dropped before
+// the rect test, so projectile/projectile and platform/platform overlaps never reach the caller
+class Broadphase
+{
+public:
+	explicit					Broadphase(float cellSize);
+
+	void						clear();
+	void						insert(SceneNode& node, unsigned int collidesWith);
+	void						findPairs(std::vector<SceneNode::Pair>& pairs);
+
+	std::size_t					getNodeCount() const;
+
+
+private:
+	struct Entry
+	{
+		SceneNode*				node;
+		sf::FloatRect			bounds;
+		unsigned int			category;
+		unsigned int			collidesWith;
+	};
+
+	struct CellRange
+	{
+		std::size_t				left;
+		std::size_t				top;
+		std::size_t				right;
+		std::size_t				bottom;
+	};
+
+
+private:
+	void						buildGrid();
+	CellRange					getCellRange(const sf::FloatRect& bounds) const;
+
+
+private:
+	float						mCellSize;
+	std::vector<Entry>			mEntries;
+
+	// Grid of the current pass, sized to the entries' extent
+	sf::Vector2f				mOrigin;
+	sf::Vector2f				mCellExtent;
+	std::size_t					mColumns;
+	std::size_t					mRows;
+	std::vector<sf::Uint32>		mCellStart;			// mColumns * mRows + 1 offsets into mCellEntries
+	std::vector<sf::Uint32>		mCellEntries;		// entry indices, ascending within a cell
+
+	std::vector<std::pair<sf::Uint32, sf::Uint32>> mPairs;
+};
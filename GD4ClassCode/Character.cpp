@@ -20,8 +20,8 @@ namespace
 	const std::vector<CharacterData> Table = initializeCharacterData();
 }
 
-Character::Character(Type type, const TextureHolder& textures, const FontHolder& fonts)
-	: Entity(Table[type].hitpoints)
+Character::Character(Type type, EntityStore& entities, const TextureHolder& textures, const FontHolder& fonts)
+	: Entity(entities, Table[type].hitpoints)
 	, mType(type)
 	, mSprite(textures.get(Table[type].texture), Table[type].textureRect)
 	, mExplosion(textures.get(Textures::Explosion))
@@ -41,19 +41,23 @@ Character::Character(Type type, const TextureHolder& textures, const FontHolder&
 	, mDirectionIndex(0)
 	, mMissileDisplay(nullptr)
 	, mIdentifier(0)
-	, mKnockbackModifier(Table[type].knockback)
 	, mIsGrounded(false)
 	, mPreviousPositionOnFire(this->getPosition())
 	, mShootDirection(1)
 	, mAinmationFrameTimer()
 	, mSurvivability(0)
 {
+	// Texts, animations and firing still run in updateCurrent()
+	setUpdateCurrentEnabled(true);
+
 	mExplosion.setFrameSize(sf::Vector2i(256, 256));
 	mExplosion.setNumFrames(16);
 	mExplosion.setDuration(sf::seconds(1));
 
 	centerOrigin(mSprite);
 	centerOrigin(mExplosion);
+	setCollider(mSprite.getGlobalBounds());
+	setKnockback(Table[type].knockback);
 
 	mFireCommand.category = Category::SceneAirLayer;
 	mFireCommand.action = [this, &textures](SceneNode& node, sf::Time)
@@ -169,9 +173,8 @@ void Character::updateCurrent(sf::Time dt, CommandQueue& commands)
 	// Check if bullets or missiles are fired
 	checkProjectileLaunch(dt, commands);
 
-	// Update enemy movement pattern; apply velocity
+	// Update enemy movement pattern; EntityStore applies the velocity
 	updateMovementPattern(dt);
-	Entity::updateCurrent(dt, commands);
 }
 
 unsigned int Character::getCategory() const
@@ -182,11 +185,6 @@ unsigned int Character::getCategory() const
 		return Category::EnemyCharacter;
 }
 
-sf::FloatRect Character::getBoundingRect() const
-{
-	return getWorldTransform().transformRect(mSprite.getGlobalBounds());
-}
-
 bool Character::isMarkedForRemoval() const
 {
 	return isDestroyed() && (mExplosion.isFinished() || !mShowExplosion);
@@ -258,7 +256,7 @@ void Character::playLocalSound(CommandQueue& commands, SoundEffect::ID effect)
 	commands.push(command);
 }
 
-int	Character::getIdentifier()
+int	Character::getIdentifier() const
 {
 	return mIdentifier;
 }
@@ -268,20 +266,6 @@ void Character::setIdentifier(int identifier)
 	mIdentifier = identifier;
 }
 
-float Character::getKnockback()
-{
-	return mKnockbackModifier;
-}
-
-void Character::setKnockback(float increment)
-{
-	mKnockbackModifier = increment;
-}
-
-void Character::incrementKnockback(float increment)
-{
-	mKnockbackModifier += increment;
-}
 int Character::getSurvivability() {
 	return mSurvivability;
 }
@@ -294,6 +278,55 @@ void Character::increaseSurvivability(int s) {
 	mSurvivability = getSurvivability() + s;
 }
 
+void Character::saveState(State& out)
+{
+	out.identifier = mIdentifier;
+	out.position = getPosition();
+	out.velocity = getVelocity();
+	out.hitpoints = getHitpoints();
+	out.knockback = getKnockback();
+	out.missileAmmo = mMissileAmmo;
+	out.survivability = mSurvivability;
+	out.fireRateLevel = mFireRateLevel;
+	out.fireCountdown = mFireCountdown;
+	out.isFiring = mIsFiring;
+	out.isLaunchingMissile = mIsLaunchingMissile;
+	out.isGrounded = mIsGrounded;
+	out.explosionBegan = mExplosionBegan;
+	out.playedExplosionSound = mPlayedExplosionSound;
+	out.explosionFrame = mExplosion.getCurrentFrame();
+	out.explosionElapsed = mExplosion.getElapsedTime();
+	out.spawnedPickup = mSpawnedPickup;
+	out.previousPositionOnFire = mPreviousPositionOnFire;
+	out.shootDirection = mShootDirection;
+	out.currentAnimation = mCurrentAnimation;
+	out.animationFrameTimer = mAinmationFrameTimer;
+}
+
+void Character::restoreState(const State& state)
+{
+	mIdentifier = state.identifier;
+	setPosition(state.position);
+	setVelocity(state.velocity);
+	setHitpoints(state.hitpoints);
+	setKnockback(state.knockback);
+	mMissileAmmo = state.missileAmmo;
+	mSurvivability = state.survivability;
+	mFireRateLevel = state.fireRateLevel;
+	mFireCountdown = state.fireCountdown;
+	mIsFiring = state.isFiring;
+	mIsLaunchingMissile = state.isLaunchingMissile;
+	mIsGrounded = state.isGrounded;
+	mExplosionBegan = state.explosionBegan;
+	mPlayedExplosionSound = state.playedExplosionSound;
+	mExplosion.setProgress(state.explosionFrame, state.explosionElapsed);
+	mSpawnedPickup = state.spawnedPickup;
+	mPreviousPositionOnFire = state.previousPositionOnFire;
+	mShootDirection = state.shootDirection;
+	mCurrentAnimation = state.currentAnimation;
+	mAinmationFrameTimer = state.animationFrameTimer;
+}
+
 void Character::updateMovementPattern(sf::Time dt)
 {
 	// Enemy airplane: Movement pattern
@@ -367,7 +400,7 @@ void Character::createBullets(SceneNode& node, const TextureHolder& textures)
 
 void Character::createProjectile(SceneNode& node, Projectile::Type type, const TextureHolder& textures)
 {
-	std::unique_ptr<Projectile> projectile(new Projectile(type, textures,mIdentifier));
+	std::unique_ptr<Projectile> projectile(new Projectile(type, getEntityStore(), textures, mIdentifier));
 
 	sf::Vector2f velocity;
 	
@@ -20,12 +20,37 @@ public:
 		TypeCount
 	};
 
+	// Everything update() reads or writes, for rollback save/restore
+	struct State
+	{
+		int					identifier;
+		sf::Vector2f		position;
+		sf::Vector2f		velocity;
+		int					hitpoints;
+		float				knockback;
+		int					missileAmmo;
+		int					survivability;
+		int					fireRateLevel;
+		sf::Time			fireCountdown;
+		bool				isFiring;
+		bool				isLaunchingMissile;
+		bool				isGrounded;
+		bool				explosionBegan;
+		bool				playedExplosionSound;
+		std::size_t			explosionFrame;
+		sf::Time			explosionElapsed;
+		bool				spawnedPickup;
+		sf::Vector2f		previousPositionOnFire;
+		int					shootDirection;
+		int					currentAnimation;
+		int					animationFrameTimer;
+	};
+
 
 public:
-	Character(Type type, const TextureHolder& textures, const FontHolder& fonts);
+	Character(Type type, EntityStore& entities, const TextureHolder& textures, const FontHolder& fonts);
 
 	virtual unsigned int	getCategory() const;
-	virtual sf::FloatRect	getBoundingRect() const;
 	virtual void			remove();
 	virtual bool 			isMarkedForRemoval() const;
 	bool					isAllied() const;
@@ -39,17 +64,17 @@ public:
 	void 					jump(float vx, float vy);
 	void					launchMissile();
 	void					playLocalSound(CommandQueue& commands, SoundEffect::ID effect);
-	int						getIdentifier();
+	int						getIdentifier() const;
 	void					setIdentifier(int identifier);
-	float					getKnockback();
-	void					setKnockback(float increment);
-	void					incrementKnockback(float increment);
 	int						getMissileAmmo() const;
 	void					setMissileAmmo(int ammo);
 	void 					increaseSurvivability(int s);
 	void 					setSurvivability(int s);
 	int						getSurvivability();
 
+	void					saveState(State& out);
+	void					restoreState(const State& state);
+
 	bool					mIsGrounded;
 	sf::Vector2f			mPreviousPositionOnFire;
 
@@ -97,7 +122,6 @@ private:
 	TextNode*				mSurvivabilityDisplay;
 
 	int						mIdentifier;
-	float					mKnockbackModifier;
 	int						mShootDirection;
 	int						mCurrentAnimation;
 	int						mAinmationFrameTimer;
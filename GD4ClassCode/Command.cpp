@@ -1,8 +1,80 @@
 #include "Command.hpp"
 
 
+CommandAction::CommandAction()
+: mStorage()
+, mOperations(nullptr)
+{
+}
+
+CommandAction::CommandAction(const CommandAction& other)
+: mStorage()
+, mOperations(other.mOperations)
+{
+	if (mOperations)
+		mOperations->copy(&other.mStorage, &mStorage);
+}
+
+CommandAction::CommandAction(CommandAction&& other)
+: mStorage()
+, mOperations(other.mOperations)
+{
+	if (mOperations)
+		mOperations->move(&other.mStorage, &mStorage);
+}
+
+CommandAction& CommandAction::operator=(const CommandAction& other)
+{
+	if (this != &other)
+	{
+		reset();
+		if (other.mOperations)
+			other.mOperations->copy(&other.mStorage, &mStorage);
+		mOperations = other.mOperations;
+	}
+
+	return *this;
+}
+
+CommandAction& CommandAction::operator=(CommandAction&& other)
+{
+	if (this != &other)
+	{
+		reset();
+		if (other.mOperations)
+			other.mOperations->move(&other.mStorage, &mStorage);
+		mOperations = other.mOperations;
+	}
+
+	return *this;
+}
+
+CommandAction::~CommandAction()
+{
+	reset();
+}
+
+void CommandAction::operator() (SceneNode& node, sf::Time dt) const
+{
+	assert(mOperations);
+	mOperations->invoke(&mStorage, node, dt);
+}
+
+CommandAction::operator bool() const
+{
+	return mOperations != nullptr;
+}
+
+void CommandAction::reset()
+{
+	if (mOperations)
+		mOperations->destroy(&mStorage);
+	mOperations = nullptr;
+}
+
 Command::Command()
 : action()
 , category(Category::None)
+, target(0)
 {
 }
@@ -5,31 +5,91 @@
 
 #include <SFML/System/Time.hpp>
 
-#include <functional>
 #include <cassert>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 
 class SceneNode;
 
+// Type-erased void(SceneNode&, sf::Time) with the callable stored inline. Anything that doesn't fit is a
+// compile error rather than a heap allocation, so building, copying and queueing commands never allocates
+class CommandAction
+{
+public:
+	static const std::size_t				StorageSize = 4 * sizeof(void*);
+
+
+public:
+											CommandAction();
+
+	template <typename Function, typename = typename std::enable_if<
+		!std::is_same<typename std::decay<Function>::type, CommandAction>::value>::type>
+											CommandAction(Function&& fn);
+
+											CommandAction(const CommandAction& other);
+											CommandAction(CommandAction&& other);
+	CommandAction&							operator=(const CommandAction& other);
+	CommandAction&							operator=(CommandAction&& other);
+											~CommandAction();
+
+	void									operator() (SceneNode& node, sf::Time dt) const;
+	explicit								operator bool() const;
+
+
+private:
+	struct Operations
+	{
+		void								(*invoke)(void* storage, SceneNode& node, sf::Time dt);
+		void								(*copy)(const void* source, void* destination);
+		void								(*move)(void* source, void* destination);
+		void								(*destroy)(void* storage);
+	};
+
+	template <typename Function>
+	static const Operations*				getOperations();
+
+	void									reset();
+
+
+private:
+	mutable std::aligned_storage<StorageSize, alignof(std::max_align_t)>::type mStorage;
+	const Operations*						mOperations;
+};
+
 struct Command
 {
 												Command();
 
-	std::function<void(SceneNode&, sf::Time)>	action;
+	CommandAction								action;
 	unsigned int								category;
+	int											target;		// character identifier; 0 offers the command to the whole category
 };
 
+// Calls fn with the node downcast to GameObject; the cast is only checked in debug builds
 template <typename GameObject, typename Function>
-std::function<void(SceneNode&, sf::Time)> derivedAction(Function fn)
+struct DerivedAction
 {
-	return [=] (SceneNode& node, sf::Time dt)
+	void operator() (SceneNode& node, sf::Time dt) const
 	{
 		// Check if cast is safe
 		assert(dynamic_cast<GameObject*>(&node) != nullptr);
 
 		// Downcast node and invoke function on it
 		fn(static_cast<GameObject&>(node), dt);
-	};
+	}
+
+	Function fn;
+};
+
+template <typename GameObject, typename Function>
+DerivedAction<GameObject, Function> derivedAction(Function fn)
+{
+	DerivedAction<GameObject, Function> action = { fn };
+	return action;
 }
 
+#include "Command.inl"
 #endif // BOOK_COMMAND_HPP
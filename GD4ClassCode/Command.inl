@@ -0,0 +1,25 @@
+
+template <typename Function, typename>
+CommandAction::CommandAction(Function&& fn)
+: mOperations(getOperations<typename std::decay<Function>::type>())
+{
+	typedef typename std::decay<Function>::type Stored;
+	static_assert(sizeof(Stored) <= StorageSize, "Command action captures too much, capture pointers or references instead");
+	static_assert(alignof(Stored) <= alignof(std::max_align_t), "Command action is over-aligned");
+
+	new (&mStorage) Stored(std::forward<Function>(fn));
+}
+
+template <typename Function>
+const CommandAction::Operations* CommandAction::getOperations()
+{
+	static const Operations operations =
+	{
+		[] (void* storage, SceneNode& node, sf::Time dt) { (*static_cast<Function*>(storage))(node, dt); },
+		[] (const void* source, void* destination) { new (destination) Function(*static_cast<const Function*>(source)); },
+		[] (void* source, void* destination) { new (destination) Function(std::move(*static_cast<Function*>(source))); },
+		[] (void* storage) { static_cast<Function*>(storage)->~Function(); }
+	};
+
+	return &operations;
+}
@@ -1,20 +1,46 @@
 #include "CommandQueue.hpp"
 #include "SceneNode.hpp"
 
+#include <cassert>
+
+
+CommandQueue::CommandQueue()
+: mBuffer(InitialCapacity)
+, mFront(0)
+, mSize(0)
+{
+}
 
 void CommandQueue::push(const Command& command)
 {
-	mQueue.push(command);
+	if (mSize == mBuffer.size())
+		grow();
+
+	mBuffer[(mFront + mSize) % mBuffer.size()] = command;
+	mSize++;
 }
 
 Command CommandQueue::pop()
 {
-	Command command = mQueue.front();
-	mQueue.pop();
+	assert(mSize > 0);
+
+	Command command = std::move(mBuffer[mFront]);
+	mFront = (mFront + 1) % mBuffer.size();
+	mSize--;
 	return command;
 }
 
 bool CommandQueue::isEmpty() const
 {
-	return mQueue.empty();
+	return mSize == 0;
+}
+
+void CommandQueue::grow()
+{
+	std::vector<Command> buffer(mBuffer.size() * 2);
+	for (std::size_t i = 0; i < mSize; ++i)
+		buffer[i] = std::move(mBuffer[(mFront + i) % mBuffer.size()]);
+
+	mBuffer.swap(buffer);
+	mFront = 0;
 }
@@ -3,19 +3,33 @@
 
 #include "Command.hpp"
 
-#include <queue>
+#include <vector>
 
 
+// Ring buffer of commands; slots are reused frame after frame, so pushing and popping don't allocate.
+// The capacity only doubles if a frame ever issues more commands than it holds
 class CommandQueue
 {
 	public:
+		static const std::size_t	InitialCapacity = 256;
+
+
+	public:
+									CommandQueue();
+
 		void						push(const Command& command);
 		Command						pop();
 		bool						isEmpty() const;
 
 		
 	private:
-		std::queue<Command>			mQueue;
+		void						grow();
+
+
+	private:
+		std::vector<Command>		mBuffer;
+		std::size_t					mFront;
+		std::size_t					mSize;
 };
 
 #endif // BOOK_COMMANDQUEUE_HPP
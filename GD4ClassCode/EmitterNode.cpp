@@ -2,6 +2,7 @@
 #include "ParticleNode.hpp"
 #include "CommandQueue.hpp"
 #include "Command.hpp"
+#include "ObjectPool.hpp"
 
 
 EmitterNode::EmitterNode(Particle::Type type)
@@ -12,6 +13,16 @@ EmitterNode::EmitterNode(Particle::Type type)
 {
 }
 
+void* EmitterNode::operator new(std::size_t size)
+{
+	return ObjectPool<EmitterNode>::instance().allocate(size);
+}
+
+void EmitterNode::operator delete(void* pointer, std::size_t size)
+{
+	ObjectPool<EmitterNode>::instance().deallocate(pointer, size);
+}
+
 void EmitterNode::updateCurrent(sf::Time dt, CommandQueue& commands)
 {
 	if (mParticleSystem)
@@ -10,6 +10,10 @@ class EmitterNode : public SceneNode
 public:
 	explicit				EmitterNode(Particle::Type type);
 
+	// Recycled through ObjectPool<EmitterNode>; every missile brings two
+	static void*			operator new(std::size_t size);
+	static void				operator delete(void* pointer, std::size_t size);
+
 
 private:
 	virtual void			updateCurrent(sf::Time dt, CommandQueue& commands);
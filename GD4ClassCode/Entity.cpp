@@ -2,73 +2,110 @@
 
 #include <cassert>
 
-Entity::Entity(int hitpoints)
-	:mVelocity(), mHitpoints(hitpoints)
-{}
+Entity::Entity(EntityStore& store, int hitpoints)
+	: mStore(store)
+	, mStoreIndex(store.add(*this, hitpoints))
+	, mHandle(store.acquireHandle(*this))
+	, mGraveyardSlot(NotBuried)
+{
+	// Movement and guidance run in the store's systems
+	setUpdateCurrentEnabled(false);
+	checkDeath();
+}
+
+Entity::~Entity()
+{
+	if (mGraveyardSlot != NotBuried)
+		mStore.unbury(*this);
+	mStore.releaseHandle(mHandle);
+	mStore.remove(mStoreIndex);
+}
+
+EntityHandle Entity::getHandle() const
+{
+	return mHandle;
+}
 
 void Entity::setVelocity(sf::Vector2f velocity)
 {
-	mVelocity = velocity;
+	mStore.mVelocityX[mStoreIndex] = velocity.x;
+	mStore.mVelocityY[mStoreIndex] = velocity.y;
 }
 
 void Entity::setVelocity(float vx, float vy)
 {
-	mVelocity.x = vx;
-	mVelocity.y = vy;
+	mStore.mVelocityX[mStoreIndex] = vx;
+	mStore.mVelocityY[mStoreIndex] = vy;
 }
 
 sf::Vector2f Entity::getVelocity() const
 {
-	return mVelocity;
+	return sf::Vector2f(mStore.mVelocityX[mStoreIndex], mStore.mVelocityY[mStoreIndex]);
 }
 
 void Entity::accelerate(sf::Vector2f velocity)
 {
-	mVelocity += velocity;
+	mStore.mVelocityX[mStoreIndex] += velocity.x;
+	mStore.mVelocityY[mStoreIndex] += velocity.y;
 }
 
 void Entity::accelerate(float vx, float vy)
 {
-	mVelocity.x += vx;
-	mVelocity.y += vy;
+	mStore.mVelocityX[mStoreIndex] += vx;
+	mStore.mVelocityY[mStoreIndex] += vy;
 }
 
-void Entity::updateCurrent(sf::Time dt, CommandQueue&)
+float Entity::getKnockback() const
 {
-	move(mVelocity * dt.asSeconds());
+	return mStore.mKnockback[mStoreIndex];
+}
+
+void Entity::setKnockback(float knockback)
+{
+	mStore.mKnockback[mStoreIndex] = knockback;
+}
+
+void Entity::incrementKnockback(float increment)
+{
+	mStore.mKnockback[mStoreIndex] += increment;
 }
 
 int Entity::getHitpoints() const
 {
-	return mHitpoints;
+	return mStore.mHitpoints[mStoreIndex];
 }
 
 void Entity::setHitpoints(int points)
 {
 	//assert(points >= 0);
-	if (mHitpoints < 0) {
-		mHitpoints = 0;
+	int& hitpoints = mStore.mHitpoints[mStoreIndex];
+	if (hitpoints < 0) {
+		hitpoints = 0;
 	}
-	mHitpoints = points;
+	hitpoints = points;
+	checkDeath();
 }
 
 void Entity::repair(int points)
 {
 	assert(points > 0);
-	mHitpoints += points;
+	mStore.mHitpoints[mStoreIndex] += points;
 }
 
 void Entity::damage(int points)
 {
-	mHitpoints -= points;
-	if (mHitpoints < 0) {
-		mHitpoints = 0;
+	int& hitpoints = mStore.mHitpoints[mStoreIndex];
+	hitpoints -= points;
+	if (hitpoints < 0) {
+		hitpoints = 0;
 	}
+	checkDeath();
 }
 
 void Entity::destroy()
 {
-	mHitpoints = 0;
+	mStore.mHitpoints[mStoreIndex] = 0;
+	checkDeath();
 }
 
 void Entity::remove()
@@ -78,6 +115,43 @@ void Entity::remove()
 
 bool Entity::isDestroyed() const
 {
-	return mHitpoints <= 0;
+	return mStore.mHitpoints[mStoreIndex] <= 0;
+}
+
+sf::FloatRect Entity::getBoundingRect() const
+{
+	return getWorldTransform().transformRect(mStore.mColliders[mStoreIndex]);
 }
 
+EntityStore& Entity::getEntityStore() const
+{
+	return mStore;
+}
+
+void Entity::setCollider(const sf::FloatRect& localBounds)
+{
+	mStore.mColliders[mStoreIndex] = localBounds;
+}
+
+void Entity::setGuided(float maxSpeed)
+{
+	mStore.mGuided[mStoreIndex] = 1;
+	mStore.mMaxSpeed[mStoreIndex] = maxSpeed;
+}
+
+sf::Vector2f Entity::getTargetDirection() const
+{
+	return sf::Vector2f(mStore.mTargetDirectionX[mStoreIndex], mStore.mTargetDirectionY[mStoreIndex]);
+}
+
+void Entity::setTargetDirection(sf::Vector2f direction)
+{
+	mStore.mTargetDirectionX[mStoreIndex] = direction.x;
+	mStore.mTargetDirectionY[mStoreIndex] = direction.y;
+}
+
+void Entity::checkDeath()
+{
+	if (mGraveyardSlot == NotBuried && isDestroyed())
+		mStore.bury(*this);
+}
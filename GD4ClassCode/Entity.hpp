@@ -1,14 +1,26 @@
 #pragma once
 #include "SceneNode.hpp"
+#include "EntityStore.hpp"
 
+// Velocity, hitpoints, knockback and collider live in the EntityStore the entity was created with
 class Entity : public SceneNode
 {
+	friend class EntityStore;
+
 private:
-	sf::Vector2f mVelocity;
-	int mHitpoints;
+	static const std::size_t NotBuried = static_cast<std::size_t>(-1);
+
+	EntityStore& mStore;
+	std::size_t mStoreIndex;
+	EntityHandle mHandle;
+	std::size_t mGraveyardSlot;		// position in the store's graveyard once hitpoints reached zero
 
 public:
-	explicit Entity(int hitpoints);
+	Entity(EntityStore& store, int hitpoints);
+	virtual ~Entity();
+
+	// Stays valid only as long as the entity, see EntityStore::resolve()
+	EntityHandle getHandle() const;
 
 	int getHitpoints() const;
 	void setHitpoints(int points);
@@ -24,6 +36,23 @@ public:
 	void accelerate(float vx, float vy);
 	sf::Vector2f getVelocity() const;
 
+	float getKnockback() const;
+	void setKnockback(float knockback);
+	void incrementKnockback(float increment);
+
+	// World transform applied to the collider
+	virtual sf::FloatRect getBoundingRect() const;
+
 protected:
-	virtual void updateCurrent(sf::Time dt, CommandQueue& commands);
-};
\ No newline at end of file
+	EntityStore& getEntityStore() const;
+	void setCollider(const sf::FloatRect& localBounds);
+
+	// Guided entities turn towards the target direction every update, flying at maxSpeed
+	void setGuided(float maxSpeed);
+	sf::Vector2f getTargetDirection() const;
+	void setTargetDirection(sf::Vector2f direction);
+
+private:
+	// Hands the entity to the store's graveyard when its hitpoints just ran out
+	void checkDeath();
+};
@@ -0,0 +1,245 @@
+#include "EntityStore.hpp"
+#include "Entity.hpp"
+#include "Utility.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+
+namespace
+{
+	// Projectile's steering rate
+	const float ApproachRate = 200.f;
+
+	// About two characters wide
+	const float SpatialCellSize = 128.f;
+}
+
+EntityHandle::EntityHandle()
+	: index(std::numeric_limits<sf::Uint32>::max())
+	, generation(0)
+{
+}
+
+EntityStore::EntityStore()
+	: mOwners()
+	, mVelocityX()
+	, mVelocityY()
+	, mHitpoints()
+	, mKnockback()
+	, mColliders()
+	, mGuided()
+	, mTargetDirectionX()
+	, mTargetDirectionY()
+	, mMaxSpeed()
+	, mHandleTargets()
+	, mHandleGenerations()
+	, mFreeHandles()
+	, mSpatialIndex(SpatialCellSize)
+	, mGraveyard()
+{
+}
+
+void EntityStore::update(sf::Time dt)
+{
+	guideMissiles(dt);
+	integrate(dt);
+}
+
+std::size_t EntityStore::getEntityCount() const
+{
+	return mOwners.size();
+}
+
+void EntityStore::setSpatialBounds(const sf::FloatRect& bounds)
+{
+	mSpatialIndex.setBounds(bounds);
+}
+
+void EntityStore::refreshSpatialIndex()
+{
+	// Entities only change cells when they cross a border
+	for (std::size_t i = 0; i < mOwners.size(); ++i)
+		mSpatialIndex.update(i, mOwners[i]->getWorldPosition(), mOwners[i]->getCategory());
+}
+
+void EntityStore::queryRadius(sf::Vector2f position, float radius, unsigned int categoryMask, std::vector<Entity*>& out) const
+{
+	mSpatialIndex.forEachInRadius(position, radius, categoryMask, [this, &out](sf::Uint32 i)
+	{
+		if (mHitpoints[i] > 0)
+			out.push_back(mOwners[i]);
+	});
+}
+
+Entity* EntityStore::resolve(EntityHandle handle) const
+{
+	if (handle.index >= mHandleTargets.size() || mHandleGenerations[handle.index] != handle.generation)
+		return nullptr;
+
+	return mHandleTargets[handle.index];
+}
+
+void EntityStore::collectWrecks(std::vector<SceneNode*>& wrecks)
+{
+	std::size_t kept = 0;
+	for (std::size_t i = 0; i < mGraveyard.size(); ++i)
+	{
+		Entity* entity = mGraveyard[i];
+		if (entity->isMarkedForRemoval())
+		{
+			entity->mGraveyardSlot = Entity::NotBuried;
+			wrecks.push_back(entity);
+		}
+		else if (entity->isDestroyed())
+		{
+			entity->mGraveyardSlot = kept;
+			mGraveyard[kept++] = entity;
+		}
+		else
+		{
+			// Brought back, e.g. by restoring a snapshot
+			entity->mGraveyardSlot = Entity::NotBuried;
+		}
+	}
+
+	mGraveyard.resize(kept);
+}
+
+std::size_t EntityStore::add(Entity& owner, int hitpoints)
+{
+	mOwners.push_back(&owner);
+	mVelocityX.push_back(0.f);
+	mVelocityY.push_back(0.f);
+	mHitpoints.push_back(hitpoints);
+	mKnockback.push_back(0.f);
+	mColliders.push_back(sf::FloatRect());
+	mGuided.push_back(0);
+	mTargetDirectionX.push_back(0.f);
+	mTargetDirectionY.push_back(0.f);
+	mMaxSpeed.push_back(0.f);
+	mSpatialIndex.add();
+
+	return mOwners.size() - 1;
+}
+
+void EntityStore::remove(std::size_t index)
+{
+	assert(index < mOwners.size());
+
+	// Move the last entity into the gap
+	std::size_t last = mOwners.size() - 1;
+	if (index != last)
+	{
+		mOwners[index] = mOwners[last];
+		mVelocityX[index] = mVelocityX[last];
+		mVelocityY[index] = mVelocityY[last];
+		mHitpoints[index] = mHitpoints[last];
+		mKnockback[index] = mKnockback[last];
+		mColliders[index] = mColliders[last];
+		mGuided[index] = mGuided[last];
+		mTargetDirectionX[index] = mTargetDirectionX[last];
+		mTargetDirectionY[index] = mTargetDirectionY[last];
+		mMaxSpeed[index] = mMaxSpeed[last];
+
+		mOwners[index]->mStoreIndex = index;
+	}
+
+	mOwners.pop_back();
+	mVelocityX.pop_back();
+	mVelocityY.pop_back();
+	mHitpoints.pop_back();
+	mKnockback.pop_back();
+	mColliders.pop_back();
+	mGuided.pop_back();
+	mTargetDirectionX.pop_back();
+	mTargetDirectionY.pop_back();
+	mMaxSpeed.pop_back();
+
+	mSpatialIndex.remove(index);
+}
+
+EntityHandle EntityStore::acquireHandle(Entity& owner)
+{
+	EntityHandle handle;
+	if (mFreeHandles.empty())
+	{
+		handle.index = static_cast<sf::Uint32>(mHandleTargets.size());
+		mHandleTargets.push_back(&owner);
+		mHandleGenerations.push_back(0);
+	}
+	else
+	{
+		handle.index = mFreeHandles.back();
+		mFreeHandles.pop_back();
+		mHandleTargets[handle.index] = &owner;
+	}
+
+	handle.generation = mHandleGenerations[handle.index];
+	return handle;
+}
+
+void EntityStore::releaseHandle(EntityHandle handle)
+{
+	assert(resolve(handle) != nullptr);
+
+	// Outstanding copies of the handle no longer match
+	mHandleTargets[handle.index] = nullptr;
+	++mHandleGenerations[handle.index];
+	mFreeHandles.push_back(handle.index);
+}
+
+void EntityStore::bury(Entity& entity)
+{
+	assert(entity.mGraveyardSlot == Entity::NotBuried);
+
+	entity.mGraveyardSlot = mGraveyard.size();
+	mGraveyard.push_back(&entity);
+}
+
+void EntityStore::unbury(Entity& entity)
+{
+	assert(mGraveyard[entity.mGraveyardSlot] == &entity);
+
+	Entity* last = mGraveyard.back();
+	mGraveyard[entity.mGraveyardSlot] = last;
+	last->mGraveyardSlot = entity.mGraveyardSlot;
+	mGraveyard.pop_back();
+
+	entity.mGraveyardSlot = Entity::NotBuried;
+}
+
+void EntityStore::guideMissiles(sf::Time dt)
+{
+	float seconds = dt.asSeconds();
+
+	for (std::size_t i = 0; i < mOwners.size(); ++i)
+	{
+		if (!mGuided[i] || mHitpoints[i] <= 0)
+			continue;
+
+		sf::Vector2f target(mTargetDirectionX[i], mTargetDirectionY[i]);
+		sf::Vector2f velocity(mVelocityX[i], mVelocityY[i]);
+
+		sf::Vector2f newVelocity = unitVector(ApproachRate * seconds * target + velocity) * mMaxSpeed[i];
+		mVelocityX[i] = newVelocity.x;
+		mVelocityY[i] = newVelocity.y;
+
+		mOwners[i]->setRotation(toDegree(std::atan2(newVelocity.y, newVelocity.x)) + 90.f);
+	}
+}
+
+void EntityStore::integrate(sf::Time dt)
+{
+	float seconds = dt.asSeconds();
+
+	// Only the nodes that actually move are touched
+	for (std::size_t i = 0; i < mOwners.size(); ++i)
+	{
+		if (mHitpoints[i] <= 0 || (mVelocityX[i] == 0.f && mVelocityY[i] == 0.f))
+			continue;
+
+		mOwners[i]->move(mVelocityX[i] * seconds, mVelocityY[i] * seconds);
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "SpatialIndex.hpp"
+
+#include <SFML/Config.hpp>
+#include <SFML/System/NonCopyable.hpp>
+#include <SFML/System/Time.hpp>
+#include <SFML/Graphics/Rect.hpp>
+
+#include <vector>
+
+
+class Entity;
+class SceneNode;
+
+// Refers to an entity without owning it. Resolves to nullptr once the entity is destroyed, also after its slot
+// went to a newer entity, which carries the next generation
+struct EntityHandle
+{
+								EntityHandle();
+
+	sf::Uint32					index;
+	sf::Uint32					generation;
+};
+
+// Simulation data of every Entity as structure of arrays; an entity registers when constructed and is
+// swap-removed when destroyed, so the arrays stay dense. SceneNode remains the hierarchy and rendering layer
+// and owns the transform. update() runs the per-frame systems that used to be virtual updateCurrent() code
+class EntityStore : private sf::NonCopyable
+{
+	friend class Entity;
+
+
+public:
+								EntityStore();
+
+	// Missile guidance, then movement; destroyed entities stand still
+	void						update(sf::Time dt);
+
+	std::size_t					getEntityCount() const;
+
+	// O(1); nullptr for a default-constructed or stale handle
+	Entity*						resolve(EntityHandle handle) const;
+
+	// Spatial queries see the positions of the last refresh; entities created since aren't found yet
+	void						setSpatialBounds(const sf::FloatRect& bounds);
+	void						refreshSpatialIndex();
+
+	// Nearest live entity in categoryMask that accept(entity) agrees to, nullptr if none. A template like
+	// SpatialIndex::findNearest(), so the per-missile query doesn't go through a type-erased call
+	template <typename Accept>
+	Entity*						queryNearest(sf::Vector2f position, unsigned int categoryMask, Accept accept) const;
+
+	// Appends the live entities in categoryMask within radius, in no particular order
+	void						queryRadius(sf::Vector2f position, float radius, unsigned int categoryMask, std::vector<Entity*>& out) const;
+
+	// Appends the entities whose hitpoints ran out and that are now marked for removal. Only the graveyard is
+	// looked at, so a frame without deaths costs nothing; entities still dying (explosion playing) stay in it
+	void						collectWrecks(std::vector<SceneNode*>& wrecks);
+
+
+private:
+	std::size_t					add(Entity& owner, int hitpoints);
+	void						remove(std::size_t index);
+
+	EntityHandle				acquireHandle(Entity& owner);
+	void						releaseHandle(EntityHandle handle);
+
+	void						bury(Entity& entity);
+	void						unbury(Entity& entity);
+
+	void						guideMissiles(sf::Time dt);
+	void						integrate(sf::Time dt);
+
+
+private:
+	std::vector<Entity*>		mOwners;
+	std::vector<float>			mVelocityX;
+	std::vector<float>			mVelocityY;
+	std::vector<int>			mHitpoints;
+	std::vector<float>			mKnockback;
+	std::vector<sf::FloatRect>	mColliders;			// local bounds, see Entity::getBoundingRect()
+
+	// Guided projectiles steer towards their target direction at mMaxSpeed
+	std::vector<sf::Uint8>		mGuided;
+	std::vector<float>			mTargetDirectionX;
+	std::vector<float>			mTargetDirectionY;
+	std::vector<float>			mMaxSpeed;
+
+	// Handle slots, not moved by remove(); freed slots are reused with the generation bumped
+	std::vector<Entity*>		mHandleTargets;
+	std::vector<sf::Uint32>		mHandleGenerations;
+	std::vector<sf::Uint32>		mFreeHandles;
+
+	// Rows by world position, same ids as the arrays above
+	SpatialIndex				mSpatialIndex;
+
+	// Entities that were alive and reached zero hitpoints; see Entity::mGraveyardSlot
+	std::vector<Entity*>		mGraveyard;
+};
+
+#include "EntityStore.inl"
@@ -0,0 +1,10 @@
+template <typename Accept>
+Entity* EntityStore::queryNearest(sf::Vector2f position, unsigned int categoryMask, Accept accept) const
+{
+	sf::Uint32 nearest = mSpatialIndex.findNearest(position, categoryMask, [this, &accept](sf::Uint32 i)
+	{
+		return mHitpoints[i] > 0 && accept(*mOwners[i]);
+	});
+
+	return nearest != SpatialIndex::NoItem ? mOwners[nearest] : nullptr;
+}
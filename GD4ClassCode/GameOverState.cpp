@@ -8,10 +8,12 @@
 #include <SFML/Graphics/View.hpp>
 
 
-GameOverState::GameOverState(StateStack& stack, Context context, const std::string& text)
+GameOverState::GameOverState(StateStack& stack, Context context, const std::string& text, bool offerRematch)
 	: State(stack, context)
 	, mGameOverText()
+	, mRematchText()
 	, mElapsedTime(sf::Time::Zero)
+	, mOfferRematch(offerRematch)
 {
 	sf::Font& font = context.fonts->get(Fonts::Main);
 	sf::Vector2f windowSize(context.window->getSize());
@@ -21,6 +23,12 @@ GameOverState::GameOverState(StateStack& stack, Context context, const std::stri
 	mGameOverText.setCharacterSize(70);
 	centerOrigin(mGameOverText);
 	mGameOverText.setPosition(0.5f * windowSize.x, 0.4f * windowSize.y);
+
+	mRematchText.setFont(font);
+	mRematchText.setString("Enter: rematch    Escape: menu");
+	mRematchText.setCharacterSize(25);
+	centerOrigin(mRematchText);
+	mRematchText.setPosition(0.5f * windowSize.x, 0.55f * windowSize.y);
 }
 
 void GameOverState::draw()
@@ -35,13 +43,16 @@ void GameOverState::draw()
 
 	window.draw(backgroundShape);
 	window.draw(mGameOverText);
+
+	if (mOfferRematch)
+		window.draw(mRematchText);
 }
 
 bool GameOverState::update(sf::Time dt)
 {
-	// Show state for 3 seconds, after return to menu
+	// Show state for 3 seconds (10 with a rematch to decide on), after return to menu
 	mElapsedTime += dt;
-	if (mElapsedTime > sf::seconds(3))
+	if (mElapsedTime > sf::seconds(mOfferRematch ? 10.f : 3.f))
 	{
 		requestStackClear();
 		requestStackPush(States::Menu);
@@ -49,7 +60,20 @@ bool GameOverState::update(sf::Time dt)
 	return false;
 }
 
-bool GameOverState::handleEvent(const sf::Event&)
+bool GameOverState::handleEvent(const sf::Event& event)
 {
+	if (!mOfferRematch || event.type != sf::Event::KeyPressed)
+		return false;
+
+	if (event.key.code == sf::Keyboard::Return)
+	{
+		requestStackPop();
+	}
+	else if (event.key.code == sf::Keyboard::Escape)
+	{
+		requestStackClear();
+		requestStackPush(States::Menu);
+	}
+
 	return false;
 }
@@ -6,10 +6,12 @@
 #include <SFML/Graphics/Text.hpp>
 
 
+// Results screen on top of the finished match. With a rematch offered, Enter pops it and the match state below
+// starts the next round in place; otherwise, and on Escape, it returns to the menu
 class GameOverState : public State
 {
 public:
-	GameOverState(StateStack& stack, Context context, const std::string& text);
+	GameOverState(StateStack& stack, Context context, const std::string& text, bool offerRematch = false);
 
 	virtual void		draw();
 	virtual bool		update(sf::Time dt);
@@ -18,5 +20,7 @@ public:
 
 private:
 	sf::Text			mGameOverText;
+	sf::Text			mRematchText;
 	sf::Time			mElapsedTime;
+	bool				mOfferRematch;
 };
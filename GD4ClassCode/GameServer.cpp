@@ -5,29 +5,164 @@
 #include "Pickup.hpp"
 #include "Character.hpp"
 #include "DataTables.hpp"
+#include "PickupSpawner.hpp"
 
 #include <SFML/Network/Packet.hpp>
 
+#include <algorithm>
+#include <ctime>
+#include <functional>
+#include <limits>
+
+
+namespace
+{
+	// Per-peer budget for UpdateClientState, adapted between these bounds
+	const float MaxStateBudget = 8192.f;
+	const float MinStateBudget = 512.f;
+	const float StateBudgetIncrease = 256.f;		// bytes per second regained per uncongested tick
+
+	// [Int32:packetType] [Int32:count], then {[Int32:id] [float:x] [float:y] [Int32:hp] [Int32:missiles] [float:knockback] [Int32:survivability]}
+	const std::size_t StateHeaderSize = 8;
+	const std::size_t StateEntrySize = 28;
+
+	// A peer that got nothing else for this long is sent a Heartbeat (the client gives up after 2 seconds)
+	const sf::Time HeartbeatInterval = sf::seconds(0.5f);
+
+	// Retry delay for packets waiting in a peer's outbox
+	const sf::Time FlushDelay = sf::milliseconds(10);
+
+	// A peer that lets this many packets pile up in its outbox isn't reading anymore
+	const std::size_t MaxQueuedPackets = 1024;
+
+	// Per-peer state update rate, adapted between these bounds from round trips and socket backpressure
+	const float MinStateRate = 10.f;
+	const float MaxStateRate = 60.f;
+	const float InitialStateRate = 20.f;
+	const sf::Time PingInterval = sf::seconds(0.5f);
+	const sf::Time RateReportInterval = sf::seconds(10.f);
+
+	// Join stages advanced per loop iteration, over all joining peers
+	const std::size_t MaxJoinStepsPerUpdate = 16;
+
+	// Spectator relays per server; each one fans out to any number of spectators
+	const std::size_t MaxSubscribers = 4;
+
+	// Every player's rematch request for the same finished round arrives within this (how long the results
+	// screen waits), only the first one resets the round
+	const sf::Time RematchWindow = sf::seconds(10.f);
+
+	// A bot whose owner stopped reporting it for this long is considered dead, its slot is refilled
+	const sf::Time BotReportTimeout = sf::seconds(2.f);
+	const sf::Time BotUpdateInterval = sf::seconds(1.f / BotSystem::UpdatesPerSecond);
+	const sf::Time BotReportInterval = sf::seconds(10.f);
+
+	// Inbound packets handled per peer per loop iteration; the rest wait in the socket
+	const std::size_t MaxPacketsPerPeer = 64;
+
+	struct PacketLimit
+	{
+		float rate;		// packets per second
+		float burst;
+	};
+
+	// Generous compared to what an honest client sends, see MultiplayerGameState and LockstepGameState
+	PacketLimit getPacketLimit(sf::Int32 packetType)
+	{
+		switch (packetType)
+		{
+		case Client::PlayerEvent:			return { 10.f, 10.f };
+		case Client::PlayerRealtimeChange:	return { 30.f, 20.f };
+		case Client::PositionUpdate:		return { 90.f, 30.f };		// sent at 10 to 60 Hz
+		case Client::WorldSnapshotChunk:	return { 256.f, 256.f };	// a whole snapshot arrives at once
+		case Client::PickupSpawned:			return { 10.f, 10.f };
+		case Client::LockstepInput:			return { 90.f, 30.f };		// sent at 60 Hz
+		case Client::LockstepChecksum:		return { 5.f, 5.f };
+		case Client::Pong:					return { 5.f, 5.f };		// one per Ping, every 0.5 s
+		default:							return { 1.f, 2.f };
+		}
+	}
+}
+
 GameServer::RemotePeer::RemotePeer()
-	: ready(false)
+	: outbox(socket)
+	, ready(false)
 	, timedOut(false)
+	, snapshotState(SnapshotNone)
+	, joinStage(JoinNone)
+	, joinStageTimes()
+	, stateBudget(MaxStateBudget)
+	, stateAllowance(0.f)
+	, congestedSends(0)
+	, stateRate(MinStateRate, MaxStateRate, InitialStateRate)
+	, lastStateTime(sf::Time::Zero)
+	, lastRoundTrip(sf::Time::Zero)
+	, hasRoundTrip(false)
+	, unansweredPings(0)
+	, droppedPackets(0)
+	, lastDropReportTime(sf::Time::Zero)
+	, timeoutTimer(TimerWheel::NoTimer)
+	, heartbeatTimer(TimerWheel::NoTimer)
+	, flushTimer(TimerWheel::NoTimer)
+	, stateTimer(TimerWheel::NoTimer)
+	, pingTimer(TimerWheel::NoTimer)
+	, lastSendTime(sf::Time::Zero)
 {
+	for (sf::Int32 type = 0; type < Client::PacketTypeCount; ++type)
+	{
+		PacketLimit limit = getPacketLimit(type);
+		TokenBucket bucket = { limit.burst, limit.rate, limit.burst, sf::Time::Zero };
+		packetBuckets[type] = bucket;
+	}
+
 	socket.setBlocking(false);
 }
 
-GameServer::GameServer(sf::Vector2u windowSize)
+GameServer::GameServer(sf::Vector2u windowSize, bool lockstep, unsigned short port, sf::IpAddress gatewayAddress, std::size_t botSlots)
 	: mThread(&GameServer::executionThread, this)
 	, mListeningState(false)
+	, mPort(port)
 	, mClientTimeoutTime(sf::seconds(3.f))
-	, mMaxConnectedPlayers(10)
+	, mTimers(sf::milliseconds(10))
+	, mPendingDisconnections(false)
+	, mMaxConnectedPlayers(lockstep ? 4 : 10)
 	, mConnectedPlayers(0)
 	, mWindowSize(windowSize)
 	, mCharacterCount(0)
 	, mPeers(1)
 	, mCharacterIdentifierCounter(1)
 	, mWaitingThreadEnd(false)
+	, mPickupSeed(static_cast<sf::Uint32>(std::time(nullptr)))
+	, mPickupInterval(sf::seconds(15.f))
+	, mNextPickupIndex(0)
 	, mLastSpawnTime(sf::Time::Zero)
 	, mTimeForNextSpawn(sf::seconds(5.f))
+	, mLastScheduleBroadcast(sf::Time::Zero)
+	, mLastRoundReset(sf::Time::Zero)
+	, mSnapshotDonor(nullptr)
+	, mBots()
+	, mBotSlots(lockstep ? 0 : botSlots)
+	, mLastBotUpdate(sf::Time::Zero)
+	, mBotUpdateTime(sf::Time::Zero)
+	, mBotUpdateCount(0)
+	, mLastBotReport(sf::Time::Zero)
+	, mGatewayAddress(gatewayAddress)
+	, mGatewaySocket()
+	, mGatewayOutbox(mGatewaySocket)
+	, mGatewayConnecting(false)
+	, mGatewayConnected(false)
+	, mLastGatewayAttempt(sf::Time::Zero)
+	, mLastLoadReport(sf::Time::Zero)
+	, mBusyTime(sf::Time::Zero)
+	, mLastRateReport(sf::Time::Zero)
+	, mSubscriberListener()
+	, mSubscribers()
+	, mPendingSubscriber(new sf::TcpSocket())
+	, mJoinCount(0)
+	, mJoinTimeTotal(sf::Time::Zero)
+	, mJoinTimeMax(sf::Time::Zero)
+	, mLockstep(lockstep)
+	, mLockstepStarted(false)
 {
 	mListenerSocket.setBlocking(false);
 	mPeers[0].reset(new RemotePeer());
@@ -52,9 +187,13 @@ void GameServer::notifyPlayerRealtimeChange(sf::Int32 characterIdentifier, sf::I
 			packet << action;
 			packet << actionEnabled;
 
-			mPeers[i]->socket.send(packet);
+			sendToPeer(*mPeers[i], packet);
 		}
 	}
+
+	sf::Packet packet;
+	packet << static_cast<sf::Int32>(Server::PlayerRealtimeChange) << characterIdentifier << action << actionEnabled;
+	sendToSubscribers(packet);
 }
 
 void GameServer::notifyPlayerEvent(sf::Int32 characterIdentifier, sf::Int32 action)
@@ -68,23 +207,33 @@ void GameServer::notifyPlayerEvent(sf::Int32 characterIdentifier, sf::Int32 acti
 			packet << characterIdentifier;
 			packet << action;
 
-			mPeers[i]->socket.send(packet);
+			sendToPeer(*mPeers[i], packet);
 		}
 	}
+
+	sf::Packet packet;
+	packet << static_cast<sf::Int32>(Server::PlayerEvent) << characterIdentifier << action;
+	sendToSubscribers(packet);
 }
 
 void GameServer::notifyPlayerSpawn(sf::Int32 characterIdentifier)
 {
+	// Joiners that already got InitialState need to hear about later characters too
 	for (std::size_t i = 0; i < mConnectedPlayers; ++i)
 	{
-		if (mPeers[i]->ready)
+		if (mPeers[i]->joinStage >= JoinWorldSent)
 		{
 			sf::Packet packet;
 			packet << static_cast<sf::Int32>(Server::PlayerConnect);
 			packet << characterIdentifier << mCharacterInfo[characterIdentifier].position.x << mCharacterInfo[characterIdentifier].position.y;
-			mPeers[i]->socket.send(packet);
+			sendToPeer(*mPeers[i], packet);
 		}
 	}
+
+	sf::Packet packet;
+	packet << static_cast<sf::Int32>(Server::PlayerConnect);
+	packet << characterIdentifier << mCharacterInfo[characterIdentifier].position.x << mCharacterInfo[characterIdentifier].position.y;
+	sendToSubscribers(packet);
 }
 
 void GameServer::setListening(bool enable)
@@ -93,7 +242,7 @@ void GameServer::setListening(bool enable)
 	if (enable)
 	{
 		if (!mListeningState)
-			mListeningState = (mListenerSocket.listen(ServerPort) == sf::TcpListener::Done);
+			mListeningState = (mListenerSocket.listen(mPort) == sf::TcpListener::Done);
 	}
 	else
 	{
@@ -106,16 +255,31 @@ void GameServer::executionThread()
 {
 	setListening(true);
 
+	// Lockstep matches have no state stream to watch
+	mSubscriberListener.setBlocking(false);
+	if (!mLockstep)
+		mSubscriberListener.listen(mPort + SubscriberPortOffset);
+
 	sf::Time stepInterval = sf::seconds(1.f / 60.f);
 	sf::Time stepTime = sf::Time::Zero;
 	sf::Time tickInterval = sf::seconds(1.f / 20.f);
 	sf::Time tickTime = sf::Time::Zero;
-	sf::Clock stepClock, tickClock;
+	sf::Clock stepClock, tickClock, busyClock;
 
 	while (!mWaitingThreadEnd)
 	{
+		busyClock.restart();
 		handleIncomingPackets();
+
+		// Timeouts, heartbeats and send retries; idle peers cost nothing until one of their timers fires
+		mTimers.advance(now());
+		if (mPendingDisconnections)
+			handleDisconnections();
+
 		handleIncomingConnections();
+		bool joining = updateJoins();
+		handleSubscribers();
+		updateSnapshotStreaming();
 
 		//stepTime += stepClock.getElapsedTime();
 		//stepClock.restart();
@@ -136,14 +300,38 @@ void GameServer::executionThread()
 			tickTime -= tickInterval;
 		}
 
-		// Sleep to prevent server from consuming 100% CPU
-		sf::sleep(sf::milliseconds(100));
+		mBusyTime += busyClock.getElapsedTime();
+		updateGatewayReport();
+
+		// Sleep to prevent server from consuming 100% CPU; lockstep relays every tick's input and joins should
+		// finish quickly, so neither can wait long. Otherwise one timer wheel step, per-peer state updates run
+		// at up to MaxStateRate
+		sf::sleep((mLockstep || joining) ? sf::milliseconds(1) : sf::milliseconds(10));
 	}
 }
 
 void GameServer::tick()
 {
-	updateClientState();
+	// Lockstep peers need no state replication, they simulate from the relayed inputs
+	if (mLockstep)
+		return;
+
+	updatePickupSchedule();
+	reportSendRates();
+
+	if (now() >= mLastBotUpdate + BotUpdateInterval)
+		updateBots();
+
+	// Subscribers get everything each tick, encoded once for all of them
+	if (!mSubscribers.empty())
+	{
+		sf::Packet packet;
+		packet << static_cast<sf::Int32>(Server::UpdateClientState) << static_cast<sf::Int32>(mCharacterInfo.size());
+		FOREACH(auto& character, mCharacterInfo)
+			packet << character.first << character.second.position.x << character.second.position.y << character.second.hitpoints << character.second.missileAmmo << character.second.knockback << character.second.survivability;
+
+		sendToSubscribers(packet);
+	}
 
 	//Remove IDs of character that have been destroyed (relevant if a client has two, and loses one)
 	/*
@@ -169,22 +357,18 @@ void GameServer::handleIncomingPackets()
 	{
 		if (peer->ready)
 		{
+			// Bounded per peer, so one flooding client can't stall the loop
 			sf::Packet packet;
-			while (peer->socket.receive(packet) == sf::Socket::Done)
+			std::size_t handledPackets = 0;
+			while (handledPackets++ < MaxPacketsPerPeer && peer->socket.receive(packet) == sf::Socket::Done)
 			{
 				// Interpret packet and react to it
 				handleIncomingPacket(packet, *peer, detectedTimeout);
 
-				// Packet was indeed received, update the ping timer
+				// Packet was indeed received, update the ping timer; the timeout timer checks it when it fires
 				peer->lastPacketTime = now();
 				packet.clear();
 			}
-
-			if (now() >= peer->lastPacketTime + mClientTimeoutTime)
-			{
-				peer->timedOut = true;
-				detectedTimeout = true;
-			}
 		}
 	}
 
@@ -197,6 +381,10 @@ void GameServer::handleIncomingPacket(sf::Packet& packet, RemotePeer& receivingP
 	sf::Int32 packetType;
 	packet >> packetType;
 
+	if (!packet || !acceptPacket(receivingPeer, packetType))
+		return;
+
+	// Every field is read and range checked before anything is stored, see the cases below
 	switch (packetType)
 	{
 	case Client::Quit:
@@ -210,6 +398,8 @@ void GameServer::handleIncomingPacket(sf::Packet& packet, RemotePeer& receivingP
 		sf::Int32 characterIdentifier;
 		sf::Int32 action;
 		packet >> characterIdentifier >> action;
+		if (!packet || !packet.endOfPacket() || !ownsCharacter(receivingPeer, characterIdentifier) || action < 0 || action >= PlayerActions::ActionCount)
+			return;
 
 		notifyPlayerEvent(characterIdentifier, action);
 	} break;
@@ -220,6 +410,9 @@ void GameServer::handleIncomingPacket(sf::Packet& packet, RemotePeer& receivingP
 		sf::Int32 action;
 		bool actionEnabled;
 		packet >> characterIdentifier >> action >> actionEnabled;
+		if (!packet || !packet.endOfPacket() || !ownsCharacter(receivingPeer, characterIdentifier) || action < 0 || action >= PlayerActions::ActionCount)
+			return;
+
 		mCharacterInfo[characterIdentifier].realtimeActions[action] = actionEnabled;
 		notifyPlayerRealtimeChange(characterIdentifier, action, actionEnabled);
 	} break;
@@ -229,6 +422,12 @@ void GameServer::handleIncomingPacket(sf::Packet& packet, RemotePeer& receivingP
 		sf::Int32 numCharacters;
 		packet >> numCharacters;
 
+		// The count must match the packet size: [Int32:packetType] [Int32:count] {[Int32:id] 6 x [4 bytes]}
+		std::size_t simulatedCharacters = receivingPeer.characterIdentifiers.size() + receivingPeer.botIdentifiers.size();
+		if (!packet || numCharacters < 0 || static_cast<std::size_t>(numCharacters) > simulatedCharacters
+			|| packet.getDataSize() != 2 * sizeof(sf::Int32) + numCharacters * StateEntrySize)
+			return;
+
 		for (sf::Int32 i = 0; i < numCharacters; ++i)
 		{
 			sf::Int32 characterIdentifier;
@@ -238,7 +437,17 @@ void GameServer::handleIncomingPacket(sf::Packet& packet, RemotePeer& receivingP
 			sf::Vector2f characterPosition;
 			sf::Int32 characterSurvivability;
 			packet >> characterIdentifier >> characterPosition.x >> characterPosition.y >> characterHitpoints >> missileAmmo >> characterKnockback >> characterSurvivability;
+			if (!ownsCharacter(receivingPeer, characterIdentifier) && !simulatesBot(receivingPeer, characterIdentifier))
+				continue;
+
 			//std::cout <<  characterIdentifier << " position x: " << characterPosition.x << " position y: " << characterPosition.y << " hitpoints: " << characterHitpoints << " missle ammo: " << missileAmmo << " knockback: " << characterKnockback <<std::endl;
+			// Speed feeds the replication priority
+			CharacterInfo& info = mCharacterInfo[characterIdentifier];
+			sf::Time sinceLastUpdate = now() - info.lastUpdateTime;
+			if (info.lastUpdateTime != sf::Time::Zero && sinceLastUpdate > sf::Time::Zero)
+				info.velocity = (characterPosition - info.position) / sinceLastUpdate.asSeconds();
+			info.lastUpdateTime = now();
+
 			mCharacterInfo[characterIdentifier].position = characterPosition;
 			mCharacterInfo[characterIdentifier].hitpoints = characterHitpoints;
 			mCharacterInfo[characterIdentifier].missileAmmo = missileAmmo;
@@ -246,29 +455,329 @@ void GameServer::handleIncomingPacket(sf::Packet& packet, RemotePeer& receivingP
 			mCharacterInfo[characterIdentifier].survivability = characterSurvivability;
 		}
 	} break;
+
+	case Client::WorldSnapshotChunk:
+	{
+		handleSnapshotChunk(packet, receivingPeer);
+	} break;
+
+	case Client::PickupSpawned:
+	{
+		verifyPickupSpawn(packet);
+	} break;
+
+	case Client::LockstepStart:
+	{
+		if (mLockstep && !mLockstepStarted)
+			startLockstepMatch();
+	} break;
+
+	case Client::LockstepInput:
+	{
+		relayLockstepInput(packet, receivingPeer);
+	} break;
+
+	case Client::LockstepChecksum:
+	{
+		verifyLockstepChecksum(packet, receivingPeer);
+	} break;
+
+	case Client::Pong:
+	{
+		handlePong(packet, receivingPeer);
+	} break;
+
+	case Client::Rematch:
+	{
+		if (packet.endOfPacket() && !mLockstep)
+			resetRound();
+	} break;
 	}
 }
 
-void GameServer::updateClientState()
+bool GameServer::acceptPacket(RemotePeer& peer, sf::Int32 packetType)
 {
-	sf::Packet updateClientStatePacket;
-	updateClientStatePacket << static_cast<sf::Int32>(Server::UpdateClientState);
-	updateClientStatePacket << static_cast<sf::Int32>(mCharacterInfo.size());
+	bool accepted = false;
 
-	FOREACH(auto character, mCharacterInfo) {
-		updateClientStatePacket << character.first << character.second.position.x << character.second.position.y << character.second.hitpoints << character.second.missileAmmo << character.second.knockback << character.second.survivability;
-		//std::cout << character.first << " position x: " << character.second.position.x << " position y: " << character.second.position.y << " hitpoints: " << character.second.hitpoints << " missle ammo: " << character.second.missileAmmo << " knockback: " << character.second.knockback << std::endl;
+	if (packetType >= 0 && packetType < Client::PacketTypeCount)
+	{
+		TokenBucket& bucket = peer.packetBuckets[packetType];
+		bucket.tokens = std::min(bucket.burst, bucket.tokens + bucket.rate * (now() - bucket.lastRefill).asSeconds());
+		bucket.lastRefill = now();
 
+		if (bucket.tokens >= 1.f)
+		{
+			bucket.tokens -= 1.f;
+			accepted = true;
+		}
 	}
-	sendToAll(updateClientStatePacket);
+
+	if (!accepted)
+	{
+		peer.droppedPackets++;
+
+		// Report at most once per second per peer, the log would otherwise become the bottleneck
+		if (now() >= peer.lastDropReportTime + sf::seconds(1.f))
+		{
+			std::cout << "Server: dropped " << peer.droppedPackets << " packets from a peer (rate limit or unknown type)" << std::endl;
+			peer.lastDropReportTime = now();
+			peer.droppedPackets = 0;
+		}
+	}
+
+	return accepted;
 }
 
-void GameServer::handleIncomingConnections()
+bool GameServer::ownsCharacter(const RemotePeer& peer, sf::Int32 characterIdentifier) const
+{
+	return std::find(peer.characterIdentifiers.begin(), peer.characterIdentifiers.end(), characterIdentifier) != peer.characterIdentifiers.end();
+}
+
+bool GameServer::simulatesBot(const RemotePeer& peer, sf::Int32 characterIdentifier) const
+{
+	return std::find(peer.botIdentifiers.begin(), peer.botIdentifiers.end(), characterIdentifier) != peer.botIdentifiers.end();
+}
+
+void GameServer::updateGatewayReport()
+{
+	const sf::Time reportInterval = sf::seconds(1.f);
+	const sf::Time reconnectInterval = sf::seconds(5.f);
+	const sf::Time connectTimeout = sf::seconds(1.f);
+
+	if (mGatewayAddress == sf::IpAddress::None)
+		return;
+
+	if (!mGatewayConnected)
+	{
+		if (!mGatewayConnecting)
+		{
+			if (mLastGatewayAttempt != sf::Time::Zero && now() < mLastGatewayAttempt + reconnectInterval)
+				return;
+
+			// Non-blocking, so the loop keeps serving peers; later iterations poll for the result
+			mLastGatewayAttempt = now();
+			mGatewaySocket.setBlocking(false);
+			sf::Socket::Status status = mGatewaySocket.connect(mGatewayAddress, GatewayPort);
+			if (status != sf::Socket::Done && status != sf::Socket::NotReady)
+				return;
+
+			mGatewayConnecting = true;
+		}
+
+		// The peer address is only known once the connect succeeded
+		if (mGatewaySocket.getRemoteAddress() == sf::IpAddress::None)
+		{
+			// Refused or unanswered: give up, the next attempt starts reconnectInterval after this one did
+			if (now() >= mLastGatewayAttempt + connectTimeout)
+			{
+				mGatewaySocket.disconnect();
+				mGatewayConnecting = false;
+			}
+			return;
+		}
+
+		mGatewayConnecting = false;
+		mGatewayConnected = true;
+		mGatewayOutbox.clear();
+
+		sf::Packet packet;
+		packet << static_cast<sf::Int32>(Gateway::RegisterServer) << static_cast<sf::Uint16>(mPort) << static_cast<sf::Int32>(mMaxConnectedPlayers);
+		mGatewayOutbox.send(packet);
+	}
+
+	if (now() < mLastLoadReport + reportInterval)
+		return;
+
+	float load = mBusyTime.asSeconds() / std::max((now() - mLastLoadReport).asSeconds(), 0.001f);
+	mLastLoadReport = now();
+	mBusyTime = sf::Time::Zero;
+
+	// A running lockstep match takes nobody, report it as full
+	sf::Int32 capacity = static_cast<sf::Int32>(mMaxConnectedPlayers);
+	sf::Int32 players = mLockstepStarted ? capacity : static_cast<sf::Int32>(mConnectedPlayers);
+
+	// Droppable, the next report follows in a second
+	sf::Packet packet;
+	packet << static_cast<sf::Int32>(Gateway::ServerLoad) << players << capacity << load;
+	if (mGatewayOutbox.send(packet, true) == sf::Socket::Disconnected)
+	{
+		std::cout << "Server: lost the gateway, reconnecting" << std::endl;
+		mGatewaySocket.disconnect();
+		mGatewayConnected = false;
+	}
+}
+
+void GameServer::handleSubscribers()
+{
+	while (mSubscribers.size() < MaxSubscribers && mSubscriberListener.accept(*mPendingSubscriber) == sf::TcpListener::Done)
+	{
+		// Same start as a joining client, minus the character; like in sendToSubscribers(), one that can't take it is dropped
+		mPendingSubscriber->setBlocking(false);
+		sf::Packet worldState, schedule;
+		writeWorldState(worldState, false);
+		writePickupSchedule(schedule);
+		if (mPendingSubscriber->send(worldState) != sf::Socket::Done || mPendingSubscriber->send(schedule) != sf::Socket::Done)
+		{
+			mPendingSubscriber.reset(new sf::TcpSocket());
+			continue;
+		}
+
+		std::cout << "Server: subscriber connected from " << mPendingSubscriber->getRemoteAddress().toString() << std::endl;
+		mSubscribers.push_back(std::move(mPendingSubscriber));
+		mPendingSubscriber.reset(new sf::TcpSocket());
+	}
+}
+
+void GameServer::sendToSubscribers(sf::Packet& packet)
+{
+	// A subscriber that can't keep up is dropped rather than buffered for; the relay reconnects
+	for (auto itr = mSubscribers.begin(); itr != mSubscribers.end(); )
+	{
+		// A copy each: a partial send would leave the packet's send position advanced for the next subscriber
+		sf::Packet copy(packet);
+		if ((*itr)->send(copy) != sf::Socket::Done)
+		{
+			std::cout << "Server: subscriber dropped" << std::endl;
+			itr = mSubscribers.erase(itr);
+		}
+		else
+		{
+			++itr;
+		}
+	}
+}
+
+void GameServer::updateClientState(RemotePeer& peer, sf::Time elapsedTime)
 {
-	if (!mListeningState)
+	// Nothing new while older packets still wait in the outbox, the update would be dropped anyway
+	if (!peer.outbox.flush())
 		return;
 
-	if (mListenerSocket.accept(mPeers[mConnectedPlayers]->socket) == sf::TcpListener::Done)
+	// Allowance refills with the budget, capped so an idle peer can't burst
+	peer.stateAllowance = std::min(peer.stateAllowance + peer.stateBudget * elapsedTime.asSeconds(), peer.stateBudget * 2.f * elapsedTime.asSeconds());
+
+	// Priorities accumulate, so characters skipped now are sent eventually
+	std::vector<std::pair<float, sf::Int32>> candidates;
+	FOREACH(auto& character, mCharacterInfo)
+	{
+		float& priority = peer.statePriority[character.first];
+		priority += getStatePriorityWeight(peer, character.first) * elapsedTime.asSeconds();
+		candidates.push_back(std::make_pair(priority, character.first));
+	}
+
+	// Forget characters that left
+	for (auto itr = peer.statePriority.begin(); itr != peer.statePriority.end(); )
+	{
+		if (mCharacterInfo.find(itr->first) == mCharacterInfo.end())
+			itr = peer.statePriority.erase(itr);
+		else
+			++itr;
+	}
+
+	std::sort(candidates.begin(), candidates.end(), std::greater<std::pair<float, sf::Int32>>());
+
+	// Highest priorities first, until the allowance is used up
+	std::size_t affordable = 0;
+	if (peer.stateAllowance > StateHeaderSize)
+		affordable = static_cast<std::size_t>((peer.stateAllowance - StateHeaderSize) / StateEntrySize);
+
+	std::size_t count = std::min(affordable, candidates.size());
+	if (count == 0)
+		return;
+
+	sf::Packet packet;
+	packet << static_cast<sf::Int32>(Server::UpdateClientState);
+	packet << static_cast<sf::Int32>(count);
+
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		sf::Int32 identifier = candidates[i].second;
+		const CharacterInfo& info = mCharacterInfo[identifier];
+		packet << identifier << info.position.x << info.position.y << info.hitpoints << info.missileAmmo << info.knockback << info.survivability;
+
+		peer.statePriority[identifier] = 0.f;
+	}
+
+	peer.stateAllowance -= static_cast<float>(packet.getDataSize());
+	sendState(peer, packet);
+}
+
+float GameServer::getStatePriorityWeight(const RemotePeer& peer, sf::Int32 characterIdentifier) const
+{
+	const CharacterInfo& info = mCharacterInfo.find(characterIdentifier)->second;
+
+	// The owner simulates its characters locally and ignores our copy
+	if (ownsCharacter(peer, characterIdentifier))
+		return 0.1f;
+
+	// Closer to one of the peer's characters and faster means more relevant
+	float closest = std::numeric_limits<float>::max();
+	FOREACH(sf::Int32 identifier, peer.characterIdentifiers)
+	{
+		auto own = mCharacterInfo.find(identifier);
+		if (own != mCharacterInfo.end())
+			closest = std::min(closest, length(own->second.position - info.position));
+	}
+
+	float distanceFactor = (closest == std::numeric_limits<float>::max()) ? 1.f : 1.f / (1.f + closest / 500.f);
+	float speedFactor = 1.f + length(info.velocity) / 300.f;
+
+	return distanceFactor * speedFactor;
+}
+
+bool GameServer::sendState(RemotePeer& peer, sf::Packet& packet)
+{
+	// Droppable: the next update carries newer state anyway
+	sf::Socket::Status status = sendToPeer(peer, packet, true);
+
+	// Socket buffer full: halve the budget (a Partial update is finished from the outbox)
+	if (status == sf::Socket::Partial || status == sf::Socket::NotReady)
+	{
+		peer.stateBudget = std::max(MinStateBudget, peer.stateBudget / 2.f);
+		peer.stateRate.addBackpressure();
+		peer.congestedSends++;
+	}
+	else if (status == sf::Socket::Done)
+	{
+		peer.stateBudget = std::min(MaxStateBudget, peer.stateBudget + StateBudgetIncrease);
+	}
+
+	return status == sf::Socket::Done;
+}
+
+sf::Socket::Status GameServer::sendToPeer(RemotePeer& peer, const sf::Packet& packet, bool droppable)
+{
+	sf::Socket::Status status = peer.outbox.send(packet, droppable);
+	if (status == sf::Socket::Done)
+		peer.lastSendTime = now();
+
+	if (peer.outbox.isEmpty())
+		return status;
+
+	if (peer.outbox.getQueuedCount() > MaxQueuedPackets)
+	{
+		// Nothing sensible left to do for it; handleDisconnections() removes it like a timed out peer
+		if (!peer.timedOut)
+			std::cout << "Server: dropping a peer that stopped reading, " << peer.outbox.getQueuedCount() << " packets queued" << std::endl;
+
+		peer.outbox.clear();
+		peer.timedOut = true;
+		mPendingDisconnections = true;
+	}
+	else if (peer.flushTimer == TimerWheel::NoTimer)
+	{
+		// Finish what is queued soon instead of waiting for the next packet
+		RemotePeer* target = &peer;
+		peer.flushTimer = mTimers.schedule(FlushDelay, [this, target] () { flushPeer(*target); });
+	}
+
+	return status;
+}
+
+void GameServer::handleIncomingConnections()
+{
+	// Drain the whole accept backlog; only the character is reserved here, updateJoins() does the handshake
+	while (mListeningState && mListenerSocket.accept(mPeers[mConnectedPlayers]->socket) == sf::TcpListener::Done)
 	{
 		// order the new client to spawn its own plane ( player 1 )
 		mCharacterInfo[mCharacterIdentifierCounter].position = sf::Vector2f(mWindowSize.x / 2, mWindowSize.y / 2);
@@ -276,21 +785,12 @@ void GameServer::handleIncomingConnections()
 		mCharacterInfo[mCharacterIdentifierCounter].missileAmmo = 2;
 		mCharacterInfo[mCharacterIdentifierCounter].knockback = 0;
 
-		sf::Packet packet;
-		packet << static_cast<sf::Int32>(Server::SpawnSelf);
-		packet << mCharacterIdentifierCounter;
-		packet << mCharacterInfo[mCharacterIdentifierCounter].position.x;
-		packet << mCharacterInfo[mCharacterIdentifierCounter].position.y;
-
-		mPeers[mConnectedPlayers]->characterIdentifiers.push_back(mCharacterIdentifierCounter);
-
-		broadcastMessage("New player!");
-		informWorldState(mPeers[mConnectedPlayers]->socket);
-		notifyPlayerSpawn(mCharacterIdentifierCounter++);
+		RemotePeer& joiningPeer = *mPeers[mConnectedPlayers];
+		joiningPeer.characterIdentifiers.push_back(mCharacterIdentifierCounter++);
+		joiningPeer.joinStartTime = now();
+		joiningPeer.joinStage = JoinAccepted;
+		joiningPeer.joinStageTimes[JoinAccepted] = now();
 
-		mPeers[mConnectedPlayers]->socket.send(packet);
-		mPeers[mConnectedPlayers]->ready = true;
-		mPeers[mConnectedPlayers]->lastPacketTime = now(); // prevent initial timeouts
 		mCharacterCount++;
 		mConnectedPlayers++;
 
@@ -301,16 +801,127 @@ void GameServer::handleIncomingConnections()
 	}
 }
 
+bool GameServer::updateJoins()
+{
+	std::size_t steps = 0;
+	std::size_t announced = 0;
+	bool joining = false;
+
+	for (std::size_t i = 0; i < mConnectedPlayers; ++i)
+	{
+		RemotePeer& peer = *mPeers[i];
+		if (peer.joinStage == JoinNone || peer.joinStage == JoinPlaying)
+			continue;
+
+		if (steps++ < MaxJoinStepsPerUpdate)
+		{
+			advanceJoin(peer);
+			if (peer.joinStage == JoinPlaying)
+				announced++;
+		}
+
+		joining |= (peer.joinStage != JoinPlaying);
+	}
+
+	// One message for the whole burst
+	if (announced == 1)
+		broadcastMessage("New player!");
+	else if (announced > 1)
+		broadcastMessage(toString(announced) + " new players!");
+
+	return joining;
+}
+
+void GameServer::advanceJoin(RemotePeer& peer)
+{
+	sf::Int32 identifier = peer.characterIdentifiers.front();
+
+	switch (peer.joinStage)
+	{
+	// Join handshake first (SpawnSelf), then the world the client is joining (InitialState)
+	case JoinAccepted:
+	{
+		sf::Packet packet;
+		packet << static_cast<sf::Int32>(Server::SpawnSelf);
+		packet << identifier;
+		packet << mCharacterInfo[identifier].position.x;
+		packet << mCharacterInfo[identifier].position.y;
+		sendToPeer(peer, packet);
+
+		peer.joinStage = JoinWelcomed;
+	} break;
+
+	case JoinWelcomed:
+	{
+		// A late joiner gets the dynamic entities streamed from a peer that is already playing (lockstep peers build the world at start)
+		bool snapshotFollows = false;
+		for (std::size_t i = 0; i < mConnectedPlayers && !mLockstep; ++i)
+			snapshotFollows |= mPeers[i]->ready;
+
+		sf::Packet worldState;
+		writeWorldState(worldState, snapshotFollows);
+		sendToPeer(peer, worldState);
+
+		if (!mLockstep)
+		{
+			sf::Packet schedule;
+			writePickupSchedule(schedule);
+			sendToPeer(peer, schedule);
+		}
+
+		peer.snapshotState = snapshotFollows ? SnapshotWaiting : SnapshotNone;
+		peer.joinStage = JoinWorldSent;
+	} break;
+
+	case JoinWorldSent:
+	{
+		notifyPlayerSpawn(identifier);
+
+		peer.ready = true;
+		peer.lastPacketTime = now(); // prevent initial timeouts
+		startPeerTimers(peer);
+		peer.joinStage = JoinPlaying;
+	} break;
+
+	default:
+		break;
+	}
+
+	peer.joinStageTimes[peer.joinStage] = now();
+
+	// Without a snapshot the join is complete here, otherwise once the last chunk went out
+	if (peer.joinStage == JoinPlaying && peer.snapshotState == SnapshotNone)
+		reportJoinTime(peer);
+}
+
 void GameServer::handleDisconnections()
 {
+	mPendingDisconnections = false;
+	std::vector<sf::Int32> orphanedBots;
+
 	for (auto itr = mPeers.begin(); itr != mPeers.end(); )
 	{
 		if ((*itr)->timedOut)
 		{
-			// Inform everyone of the disconnection, erase 
+			cancelPeerTimers(**itr);
+			orphanedBots.insert(orphanedBots.end(), (*itr)->botIdentifiers.begin(), (*itr)->botIdentifiers.end());
+
+			// Donor left mid-snapshot: let the receivers finish with what they got
+			if (itr->get() == mSnapshotDonor)
+				finishSnapshotStreaming(false);
+
+			// Inform everyone of the disconnection, erase (joiners that got InitialState know the character too)
 			FOREACH(sf::Int32 identifier, (*itr)->characterIdentifiers)
 			{
-				sendToAll(sf::Packet() << static_cast<sf::Int32>(Server::PlayerDisconnect) << identifier);
+				sf::Packet packet;
+				packet << static_cast<sf::Int32>(Server::PlayerDisconnect) << identifier;
+
+				FOREACH(PeerPtr& peer, mPeers)
+				{
+					if (peer->joinStage >= JoinWorldSent && peer.get() != itr->get())
+						sendToPeer(*peer, packet);
+				}
+				sendToSubscribers(packet);
 
 				mCharacterInfo.erase(identifier);
 			}
@@ -324,35 +935,612 @@ void GameServer::handleDisconnections()
 			if (mConnectedPlayers < mMaxConnectedPlayers)
 			{
 				mPeers.push_back(PeerPtr(new RemotePeer()));
-				setListening(true);
+				setListening(!mLockstepStarted);
 			}
 
 			broadcastMessage("An oponent has disconnected.");
+
+			// A lockstep match can't continue without every player's input
+			if (mLockstepStarted)
+				broadcastMessage("Match aborted.");
 		}
 		else
 		{
 			++itr;
 		}
 	}
+
+	// Someone else takes over the bots; without anyone left, fillBotSlots() removes them
+	FOREACH(sf::Int32 identifier, orphanedBots)
+		assignBot(identifier);
 }
 
-// Tell the newly connected peer about how the world is currently
-void GameServer::informWorldState(sf::TcpSocket& socket)
+void GameServer::resetRound()
+{
+	if (mLastRoundReset != sf::Time::Zero && now() < mLastRoundReset + RematchWindow)
+		return;
+
+	mLastRoundReset = now();
+
+	// New pickup timeline from now on, the clients start theirs when the reset arrives
+	mPickupSeed = mPickupSeed * 2654435761u + static_cast<sf::Uint32>(std::time(nullptr));
+	mNextPickupIndex = 0;
+	mLastSpawnTime = now();
+	mTimeForNextSpawn = PickupSpawner::gapAfter(mPickupSeed, 0, mPickupInterval);
+	mLastScheduleBroadcast = now();
+
+	sf::Packet packet;
+	packet << static_cast<sf::Int32>(Server::RoundReset) << mPickupSeed << mPickupInterval.asMilliseconds();
+	packet << static_cast<sf::Int32>(mCharacterInfo.size());
+
+	// Connections, peer slots and bots stay; every character starts over, spread across the window
+	std::size_t slot = 0;
+	FOREACH(auto& character, mCharacterInfo)
+	{
+		CharacterInfo& info = character.second;
+		info = CharacterInfo();
+		info.position = sf::Vector2f(mWindowSize.x * ++slot / (mCharacterInfo.size() + 1.f), mWindowSize.y / 2.f);
+		info.hitpoints = 100;
+		info.missileAmmo = 2;
+		info.lastUpdateTime = now();
+
+		packet << character.first << info.position.x << info.position.y;
+	}
+
+	for (std::size_t i = 0; i < mConnectedPlayers; ++i)
+	{
+		if (mPeers[i]->joinStage >= JoinWorldSent)
+			sendToPeer(*mPeers[i], packet);
+	}
+
+	sendToSubscribers(packet);
+	std::cout << "Server: round reset, " << mCharacterInfo.size() << " characters" << std::endl;
+}
+
+void GameServer::startPeerTimers(RemotePeer& peer)
+{
+	RemotePeer* target = &peer;
+	peer.lastSendTime = now();
+	peer.timeoutTimer = mTimers.schedule(mClientTimeoutTime, [this, target] () { checkPeerTimeout(*target); });
+	peer.heartbeatTimer = mTimers.schedule(HeartbeatInterval, [this, target] () { sendHeartbeat(*target); });
+
+	// Lockstep peers get no state updates and don't answer pings
+	if (!mLockstep)
+	{
+		peer.lastStateTime = now();
+		peer.stateTimer = mTimers.schedule(peer.stateRate.getInterval(), [this, target] () { sendStateUpdate(*target); });
+		peer.pingTimer = mTimers.schedule(PingInterval, [this, target] () { sendPing(*target); });
+	}
+}
+
+void GameServer::cancelPeerTimers(RemotePeer& peer)
+{
+	mTimers.cancel(peer.timeoutTimer);
+	mTimers.cancel(peer.heartbeatTimer);
+	mTimers.cancel(peer.flushTimer);
+	mTimers.cancel(peer.stateTimer);
+	mTimers.cancel(peer.pingTimer);
+	peer.timeoutTimer = peer.heartbeatTimer = peer.flushTimer = peer.stateTimer = peer.pingTimer = TimerWheel::NoTimer;
+}
+
+void GameServer::checkPeerTimeout(RemotePeer& peer)
+{
+	peer.timeoutTimer = TimerWheel::NoTimer;
+
+	// Packets that arrived meanwhile only moved lastPacketTime; sleep until the deadline that results
+	sf::Time deadline = peer.lastPacketTime + mClientTimeoutTime;
+	if (now() >= deadline)
+	{
+		peer.timedOut = true;
+		mPendingDisconnections = true;
+	}
+	else
+	{
+		RemotePeer* target = &peer;
+		peer.timeoutTimer = mTimers.schedule(deadline - now(), [this, target] () { checkPeerTimeout(*target); });
+	}
+}
+
+void GameServer::sendHeartbeat(RemotePeer& peer)
+{
+	// Skipped when state updates went out recently, they keep the client's connection alive as well
+	if (now() >= peer.lastSendTime + HeartbeatInterval)
+	{
+		sf::Packet packet;
+		packet << static_cast<sf::Int32>(Server::Heartbeat);
+		sendToPeer(peer, packet, true);
+	}
+
+	RemotePeer* target = &peer;
+	sf::Time delay = std::max(peer.lastSendTime + HeartbeatInterval - now(), FlushDelay);
+	peer.heartbeatTimer = mTimers.schedule(delay, [this, target] () { sendHeartbeat(*target); });
+}
+
+void GameServer::flushPeer(RemotePeer& peer)
+{
+	peer.flushTimer = TimerWheel::NoTimer;
+
+	if (peer.outbox.flush())
+	{
+		peer.lastSendTime = now();
+	}
+	else
+	{
+		RemotePeer* target = &peer;
+		peer.flushTimer = mTimers.schedule(FlushDelay, [this, target] () { flushPeer(*target); });
+	}
+}
+
+void GameServer::sendStateUpdate(RemotePeer& peer)
 {
+	// The real time since the last update, the priorities and the allowance grow with it
+	updateClientState(peer, now() - peer.lastStateTime);
+	peer.lastStateTime = now();
+
+	RemotePeer* target = &peer;
+	peer.stateTimer = mTimers.schedule(peer.stateRate.getInterval(), [this, target] () { sendStateUpdate(*target); });
+}
+
+void GameServer::sendPing(RemotePeer& peer)
+{
+	// TCP hides loss as delay: a ping still unanswered one interval later counts as lost
+	if (peer.unansweredPings > 0)
+		peer.stateRate.addLoss();
+
+	sf::Int32 lastRoundTrip = peer.hasRoundTrip ? static_cast<sf::Int32>(peer.lastRoundTrip.asMilliseconds()) : -1;
+
 	sf::Packet packet;
+	packet << static_cast<sf::Int32>(Server::Ping) << static_cast<sf::Int32>(now().asMilliseconds()) << lastRoundTrip;
+	if (sendToPeer(peer, packet, true) == sf::Socket::Done)
+		peer.unansweredPings++;
+
+	RemotePeer* target = &peer;
+	peer.pingTimer = mTimers.schedule(PingInterval, [this, target] () { sendPing(*target); });
+}
+
+void GameServer::handlePong(sf::Packet& packet, RemotePeer& sendingPeer)
+{
+	sf::Int32 serverTime;
+	packet >> serverTime;
+
+	sf::Time roundTrip = now() - sf::milliseconds(serverTime);
+	if (!packet || !packet.endOfPacket() || roundTrip < sf::Time::Zero)
+		return;
+
+	sendingPeer.lastRoundTrip = roundTrip;
+	sendingPeer.hasRoundTrip = true;
+	sendingPeer.unansweredPings = 0;
+	sendingPeer.stateRate.addRoundTrip(roundTrip);
+}
+
+void GameServer::reportSendRates()
+{
+	if (now() < mLastRateReport + RateReportInterval)
+		return;
+
+	mLastRateReport = now();
+
+	for (std::size_t i = 0; i < mConnectedPlayers; ++i)
+	{
+		RemotePeer& peer = *mPeers[i];
+		if (peer.ready && !peer.characterIdentifiers.empty())
+		{
+			// Congestion is summed up here rather than logged per send, the log would otherwise add to the stall
+			std::cout << "Server: player " << peer.characterIdentifiers.front() << " state updates at " << peer.stateRate.getRate()
+				<< " Hz, RTT " << peer.stateRate.getRoundTripTime().asMilliseconds() << " ms, budget " << peer.stateBudget << " B/s, "
+				<< peer.congestedSends << " congested sends, " << peer.outbox.getQueuedCount() << " packets queued" << std::endl;
+			peer.congestedSends = 0;
+		}
+	}
+}
+
+// Tell the newly connected peer about how the world is currently
+void GameServer::writeWorldState(sf::Packet& packet, bool snapshotFollows)
+{
 	packet << static_cast<sf::Int32>(Server::InitialState);
-	packet << static_cast<sf::Int32>(mCharacterCount);
+	packet << WorldSnapshot::Version;
+
+	// Characters of ready peers plus the bots; peers still joining have reserved characters that don't exist yet
+	std::vector<sf::Int32> identifiers(mBots.getIdentifiers());
+	for (std::size_t i = 0; i < mConnectedPlayers; ++i)
+	{
+		if (mPeers[i]->ready)
+			identifiers.insert(identifiers.end(), mPeers[i]->characterIdentifiers.begin(), mPeers[i]->characterIdentifiers.end());
+	}
+
+	packet << static_cast<sf::Int32>(identifiers.size());
+	FOREACH(sf::Int32 identifier, identifiers)
+	{
+		const CharacterInfo& info = mCharacterInfo[identifier];
+		packet << identifier << info.position.x << info.position.y << info.hitpoints << info.missileAmmo << info.knockback << info.survivability;
+	}
+
+	packet << snapshotFollows;
+}
+
+void GameServer::handleSnapshotChunk(sf::Packet& packet, RemotePeer& sendingPeer)
+{
+	// Only the peer we asked may feed joiners
+	if (&sendingPeer != mSnapshotDonor)
+		return;
+
+	sf::Int32 version, chunkIndex, chunkCount;
+	packet >> version >> chunkIndex >> chunkCount;
+	if (!packet)
+		return;
+
+	// Forward the chunk unchanged, only the packet type differs
+	sf::Packet forward;
+	forward << static_cast<sf::Int32>(Server::WorldSnapshotChunk);
+	forward.append(static_cast<const char*>(packet.getData()) + sizeof(sf::Int32), packet.getDataSize() - sizeof(sf::Int32));
+
+	FOREACH(PeerPtr& peer, mPeers)
+	{
+		if (peer->snapshotState == SnapshotReceiving)
+			peer->pendingSnapshotChunks.push_back(forward);
+	}
+
+	if (chunkIndex + 1 >= chunkCount)
+		finishSnapshotStreaming(true);
+}
+
+void GameServer::updateSnapshotStreaming()
+{
+	// Bounded work per loop, so a large snapshot never stalls packet handling or the tick
+	const std::size_t maxChunksPerUpdate = 4;
+
+	bool anyWaiting = false;
+	FOREACH(PeerPtr& peer, mPeers)
+	{
+		// Handed to the outbox only while it is empty, a congested joiner doesn't get the whole snapshot queued there
+		for (std::size_t sent = 0; sent < maxChunksPerUpdate && !peer->pendingSnapshotChunks.empty() && peer->outbox.isEmpty(); ++sent)
+		{
+			sendToPeer(*peer, peer->pendingSnapshotChunks.front());
+			peer->pendingSnapshotChunks.pop_front();
+		}
+
+		if (peer->snapshotState == SnapshotQueued && peer->pendingSnapshotChunks.empty())
+		{
+			// Still mid-handshake: advanceJoin() reports once the peer is playing
+			peer->snapshotState = SnapshotNone;
+			if (peer->joinStage == JoinPlaying)
+				reportJoinTime(*peer);
+		}
+
+		anyWaiting |= (peer->snapshotState == SnapshotWaiting);
+	}
+
+	// One snapshot at a time; joiners that arrived meanwhile share the next one
+	if (!anyWaiting || mSnapshotDonor)
+		return;
+
+	FOREACH(PeerPtr& peer, mPeers)
+	{
+		if (peer->ready && !peer->timedOut && peer->snapshotState == SnapshotNone)
+		{
+			mSnapshotDonor = peer.get();
+			break;
+		}
+	}
+
+	if (!mSnapshotDonor)
+	{
+		// Nobody left who has a world: joiners proceed with InitialState only
+		finishSnapshotStreaming(false);
+		return;
+	}
+
+	FOREACH(PeerPtr& peer, mPeers)
+	{
+		if (peer->snapshotState == SnapshotWaiting)
+			peer->snapshotState = SnapshotReceiving;
+	}
+
+	sf::Packet request;
+	request << static_cast<sf::Int32>(Server::RequestWorldSnapshot);
+	sendToPeer(*mSnapshotDonor, request);
+}
+
+void GameServer::finishSnapshotStreaming(bool donorCompleted)
+{
+	// Receivers of an incomplete snapshot still need an end marker to finish joining
+	sf::Packet endChunk;
+	endChunk << static_cast<sf::Int32>(Server::WorldSnapshotChunk);
+	endChunk << WorldSnapshot::Version << static_cast<sf::Int32>(0) << static_cast<sf::Int32>(1) << static_cast<sf::Int32>(0);
+
+	FOREACH(PeerPtr& peer, mPeers)
+	{
+		if (peer->snapshotState == SnapshotReceiving || (peer->snapshotState == SnapshotWaiting && !mSnapshotDonor))
+		{
+			if (!donorCompleted)
+				peer->pendingSnapshotChunks.push_back(endChunk);
+
+			peer->snapshotState = SnapshotQueued;
+		}
+	}
+
+	mSnapshotDonor = nullptr;
+}
+
+void GameServer::reportJoinTime(const RemotePeer& peer)
+{
+	sf::Time joinTime = now() - peer.joinStartTime;
+	mJoinCount++;
+	mJoinTimeTotal += joinTime;
+	mJoinTimeMax = std::max(mJoinTimeMax, joinTime);
+
+	// Time spent waiting for each stage, then the snapshot (if any) until the last chunk went out
+	const std::array<sf::Time, JoinStageCount>& times = peer.joinStageTimes;
+	std::cout << "Server: peer joined in " << joinTime.asMilliseconds() << " ms"
+		<< " (welcome " << (times[JoinWelcomed] - times[JoinAccepted]).asMilliseconds()
+		<< ", world " << (times[JoinWorldSent] - times[JoinWelcomed]).asMilliseconds()
+		<< ", announce " << (times[JoinPlaying] - times[JoinWorldSent]).asMilliseconds()
+		<< ", snapshot " << (now() - times[JoinPlaying]).asMilliseconds() << " ms)"
+		<< ", average " << (mJoinTimeTotal / static_cast<sf::Int64>(mJoinCount)).asMilliseconds()
+		<< " ms, max " << mJoinTimeMax.asMilliseconds() << " ms over " << mJoinCount << " joins" << std::endl;
+}
+
+void GameServer::updateBots()
+{
+	mLastBotUpdate = now();
+	fillBotSlots();
+
+	if (mBots.getBotCount() == 0)
+		return;
+
+	sf::Clock clock;
+
+	// Gather: the latest reported state, bots first, then everything they may chase
+	const std::vector<sf::Int32>& identifiers = mBots.getIdentifiers();
+	for (std::size_t slot = 0; slot < identifiers.size(); ++slot)
+	{
+		const CharacterInfo& info = mCharacterInfo[identifiers[slot]];
+		mBots.setBotState(slot, info.position, info.missileAmmo);
+	}
+
+	mBots.clearTargets();
+	FOREACH(auto& character, mCharacterInfo)
+	{
+		if (character.second.hitpoints > 0)
+			mBots.addTarget(character.first, character.second.position);
+	}
+
+	mBots.update(BotUpdateInterval);
+
+	// Scatter: only the actions that changed go out, as the packets a human's client would cause
+	for (std::size_t slot = 0; slot < identifiers.size(); ++slot)
+	{
+		sf::Int32 identifier = identifiers[slot];
+		sf::Uint8 mask = mBots.getActionMask(slot);
+		sf::Uint8 changed = mask ^ mBots.getPreviousActionMask(slot);
+
+		for (sf::Int32 action = 0; action < PlayerActions::LaunchMissile; ++action)
+		{
+			if (changed & (1 << action))
+			{
+				bool enabled = (mask & (1 << action)) != 0;
+				mCharacterInfo[identifier].realtimeActions[action] = enabled;
+				notifyPlayerRealtimeChange(identifier, action, enabled);
+			}
+		}
+
+		if (mask & (1 << PlayerActions::LaunchMissile))
+			notifyPlayerEvent(identifier, PlayerActions::LaunchMissile);
+	}
+
+	mBotUpdateTime += clock.getElapsedTime();
+	mBotUpdateCount++;
+
+	if (now() >= mLastBotReport + BotReportInterval)
+	{
+		float perUpdate = mBotUpdateTime.asMicroseconds() / static_cast<float>(mBotUpdateCount);
+		std::cout << "Server: bot AI for " << mBots.getBotCount() << " bots took " << perUpdate << " us per update ("
+			<< perUpdate / mBots.getBotCount() << " us per bot, sends included)" << std::endl;
+
+		mLastBotReport = now();
+		mBotUpdateTime = sf::Time::Zero;
+		mBotUpdateCount = 0;
+	}
+}
 
+void GameServer::fillBotSlots()
+{
+	// Bots keep a match going, they don't play on their own: no human peer, no bots
+	std::size_t humans = 0;
 	for (std::size_t i = 0; i < mConnectedPlayers; ++i)
 	{
 		if (mPeers[i]->ready)
+			humans += mPeers[i]->characterIdentifiers.size();
+	}
+
+	// Dead bots leave like players do; their owner reported them at zero hitpoints or stopped reporting them
+	std::vector<sf::Int32> deadBots;
+	FOREACH(sf::Int32 identifier, mBots.getIdentifiers())
+	{
+		const CharacterInfo& info = mCharacterInfo[identifier];
+		if (info.hitpoints <= 0 || (info.lastUpdateTime != sf::Time::Zero && now() >= info.lastUpdateTime + BotReportTimeout))
+			deadBots.push_back(identifier);
+	}
+
+	FOREACH(sf::Int32 identifier, deadBots)
+		removeBot(identifier);
+
+	std::size_t wanted = (humans > 0 && humans < mBotSlots) ? mBotSlots - humans : 0;
+	while (mBots.getBotCount() > wanted)
+		removeBot(mBots.getIdentifiers().back());
+
+	// One at a time, so a refilled match doesn't get a wave of bots in the same spot
+	if (mBots.getBotCount() < wanted)
+		addBot();
+}
+
+void GameServer::addBot()
+{
+	sf::Int32 identifier = mCharacterIdentifierCounter++;
+
+	CharacterInfo& info = mCharacterInfo[identifier];
+	info.position = sf::Vector2f(mWindowSize.x * (1 + identifier % 4) / 5.f, mWindowSize.y / 2.f);
+	info.hitpoints = 100;
+	info.missileAmmo = 2;
+	info.knockback = 0;
+
+	mBots.addBot(identifier, static_cast<sf::Uint32>(identifier) * 2654435761u);
+
+	notifyPlayerSpawn(identifier);
+	assignBot(identifier);
+}
+
+void GameServer::removeBot(sf::Int32 identifier)
+{
+	mBots.removeBot(identifier);
+
+	sf::Packet packet;
+	packet << static_cast<sf::Int32>(Server::PlayerDisconnect) << identifier;
+
+	for (std::size_t i = 0; i < mConnectedPlayers; ++i)
+	{
+		std::vector<sf::Int32>& bots = mPeers[i]->botIdentifiers;
+		bots.erase(std::remove(bots.begin(), bots.end(), identifier), bots.end());
+
+		if (mPeers[i]->joinStage >= JoinWorldSent)
+			sendToPeer(*mPeers[i], packet);
+	}
+
+	sendToSubscribers(packet);
+	mCharacterInfo.erase(identifier);
+}
+
+void GameServer::assignBot(sf::Int32 identifier)
+{
+	// The ready peer simulating the fewest bots takes it
+	RemotePeer* owner = nullptr;
+	for (std::size_t i = 0; i < mConnectedPlayers; ++i)
+	{
+		RemotePeer& peer = *mPeers[i];
+		if (peer.ready && !peer.timedOut && (!owner || peer.botIdentifiers.size() < owner->botIdentifiers.size()))
+			owner = &peer;
+	}
+
+	if (!owner)
+		return;
+
+	owner->botIdentifiers.push_back(identifier);
+
+	sf::Packet packet;
+	packet << static_cast<sf::Int32>(Server::AssignBot) << identifier;
+	sendToPeer(*owner, packet);
+}
+
+void GameServer::updatePickupSchedule()
+{
+	// The server only keeps the timeline; clients spawn the pickups themselves from the seed
+	while (now() >= mLastSpawnTime + mTimeForNextSpawn)
+	{
+		mLastSpawnTime += mTimeForNextSpawn;
+		mTimeForNextSpawn = PickupSpawner::gapAfter(mPickupSeed, mNextPickupIndex, mPickupInterval);
+		++mNextPickupIndex;
+	}
+
+	// Occasional resync keeps the clients' local timers from drifting apart
+	if (now() >= mLastScheduleBroadcast + sf::seconds(10.f))
+	{
+		sf::Packet schedule;
+		writePickupSchedule(schedule);
+
+		FOREACH(PeerPtr& peer, mPeers)
 		{
-			FOREACH(sf::Int32 identifier, mPeers[i]->characterIdentifiers)
-				packet << identifier << mCharacterInfo[identifier].position.x << mCharacterInfo[identifier].position.y << mCharacterInfo[identifier].hitpoints << mCharacterInfo[identifier].missileAmmo << mCharacterInfo[identifier].knockback;
+			if (peer->ready)
+				sendToPeer(*peer, schedule);
 		}
+
+		sendToSubscribers(schedule);
+
+		mLastScheduleBroadcast = now();
+	}
+}
+
+void GameServer::writePickupSchedule(sf::Packet& packet) const
+{
+	sf::Time untilNext = mLastSpawnTime + mTimeForNextSpawn - now();
+
+	packet << static_cast<sf::Int32>(Server::PickupSchedule);
+	packet << mPickupSeed << mPickupInterval.asMilliseconds() << mNextPickupIndex << untilNext.asMilliseconds();
+}
+
+void GameServer::verifyPickupSpawn(sf::Packet& packet)
+{
+	sf::Uint32 index;
+	sf::Int32 type;
+	float x;
+	packet >> index >> type >> x;
+	if (!packet)
+		return;
+
+	PickupSpawner::Spawn expected = PickupSpawner::spawnAt(mPickupSeed, index);
+	if (expected.type != type || expected.position.x != x)
+		std::cout << "Server: pickup " << index << " desynchronized (type " << type << " at " << x << ", expected type " << expected.type << " at " << expected.position.x << ")" << std::endl;
+}
+
+void GameServer::startLockstepMatch()
+{
+	// Everyone seeds the same RNG and creates the characters in this order
+	sf::Packet packet;
+	packet << static_cast<sf::Int32>(Server::LockstepStart);
+	packet << static_cast<sf::Uint32>(std::time(nullptr));
+
+	// One character per peer, lockstep input is keyed by the peer's first character
+	std::vector<sf::Int32> identifiers;
+	for (std::size_t i = 0; i < mConnectedPlayers; ++i)
+	{
+		if (mPeers[i]->ready && !mPeers[i]->characterIdentifiers.empty())
+			identifiers.push_back(mPeers[i]->characterIdentifiers.front());
 	}
 
-	socket.send(packet);
+	packet << static_cast<sf::Int32>(identifiers.size());
+	FOREACH(sf::Int32 identifier, identifiers)
+		packet << identifier;
+
+	sendToAll(packet);
+	mLockstepStarted = true;
+	setListening(false);
+}
+
+void GameServer::relayLockstepInput(sf::Packet& packet, RemotePeer& sendingPeer)
+{
+	sf::Uint32 tick;
+	sf::Uint8 actionMask;
+	packet >> tick >> actionMask;
+	if (!packet || sendingPeer.characterIdentifiers.empty())
+		return;
+
+	sf::Packet relay;
+	relay << static_cast<sf::Int32>(Server::LockstepInput);
+	relay << sendingPeer.characterIdentifiers.front() << tick << actionMask;
+
+	FOREACH(PeerPtr& peer, mPeers)
+	{
+		if (peer->ready && peer.get() != &sendingPeer)
+			sendToPeer(*peer, relay);
+	}
+}
+
+void GameServer::verifyLockstepChecksum(sf::Packet& packet, RemotePeer& sendingPeer)
+{
+	sf::Uint32 tick, checksum;
+	packet >> tick >> checksum;
+	if (!packet)
+		return;
+
+	// First report of a tick becomes the reference, later ones must match it
+	auto found = mLockstepChecksums.find(tick);
+	if (found == mLockstepChecksums.end())
+		mLockstepChecksums[tick] = checksum;
+	else if (found->second != checksum)
+		std::cout << "Server: lockstep desync at tick " << tick << " (player " << sendingPeer.characterIdentifiers.front() << ")" << std::endl;
+
+	// Keep only recent ticks
+	while (mLockstepChecksums.size() > 64)
+		mLockstepChecksums.erase(mLockstepChecksums.begin());
 }
 
 void GameServer::broadcastMessage(const std::string& message)
@@ -365,9 +1553,13 @@ void GameServer::broadcastMessage(const std::string& message)
 			packet << static_cast<sf::Int32>(Server::BroadcastMessage);
 			packet << message;
 
-			mPeers[i]->socket.send(packet);
+			sendToPeer(*mPeers[i], packet);
 		}
 	}
+
+	sf::Packet packet;
+	packet << static_cast<sf::Int32>(Server::BroadcastMessage) << message;
+	sendToSubscribers(packet);
 }
 
 void GameServer::sendToAll(sf::Packet& packet)
@@ -375,6 +1567,6 @@ void GameServer::sendToAll(sf::Packet& packet)
 	FOREACH(PeerPtr& peer, mPeers)
 	{
 		if (peer->ready)
-			peer->socket.send(packet);
+			sendToPeer(*peer, packet);
 	}
 }
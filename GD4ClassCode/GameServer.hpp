@@ -1,4 +1,9 @@
 #pragma once
+#include "NetworkProtocol.hpp"
+#include "TimerWheel.hpp"
+#include "BotSystem.hpp"
+#include "SendRate.hpp"
+#include "PacketOutbox.hpp"
 
 #include <SFML/System/Vector2.hpp>
 #include <SFML/System/Thread.hpp>
@@ -7,17 +12,28 @@
 #include <SFML/Graphics/Rect.hpp>
 #include <SFML/Network/TcpListener.hpp>
 #include <SFML/Network/TcpSocket.hpp>
+#include <SFML/Network/Packet.hpp>
+#include <SFML/Network/IpAddress.hpp>
 #include <iostream>
 
+#include <array>
 #include <vector>
 #include <memory>
 #include <map>
+#include <deque>
 
 
 class GameServer
 {
 public:
-	explicit							GameServer(sf::Vector2u windowSize);
+	// Characters a match is topped up to with bots
+	static const std::size_t			DefaultBotSlots = 4;
+
+
+public:
+	// With a gateway address the server registers with that LobbyGateway and reports its load to it
+	explicit							GameServer(sf::Vector2u windowSize, bool lockstep = false, unsigned short port = ServerPort,
+											sf::IpAddress gatewayAddress = sf::IpAddress::None, std::size_t botSlots = DefaultBotSlots);
 	~GameServer();
 
 	void								notifyPlayerSpawn(sf::Int32 characterIdentifier);
@@ -26,16 +42,79 @@ public:
 
 
 private:
+	// Progress of a late joiner receiving the world snapshot from an already playing peer
+	enum SnapshotState
+	{
+		SnapshotNone,			// not joining, or joined without a snapshot
+		SnapshotWaiting,		// needs a snapshot, no donor asked yet
+		SnapshotReceiving,		// chunks from the current donor are queued for this peer
+		SnapshotQueued,			// final chunk queued, waiting for the queue to drain
+	};
+
+	// Refills at rate tokens per second up to burst; every accepted packet costs one token
+	struct TokenBucket
+	{
+		float					tokens;
+		float					rate;
+		float					burst;
+		sf::Time				lastRefill;
+	};
+
+	// Join handshake, advanced one stage per server loop so a burst of joins never stalls the loop
+	enum JoinStage
+	{
+		JoinNone,				// waiting for a connection
+		JoinAccepted,			// character reserved, nothing sent yet
+		JoinWelcomed,			// SpawnSelf sent
+		JoinWorldSent,			// InitialState sent; from here on the peer is told about other joiners
+		JoinPlaying,			// announced to everyone, ready
+		JoinStageCount
+	};
+
 	// A GameServerRemotePeer refers to one instance of the game, may it be local or from another computer
 	struct RemotePeer
 	{
 		RemotePeer();
 
 		sf::TcpSocket			socket;
+		PacketOutbox			outbox;					// every send to the peer goes through here, see sendToPeer()
 		sf::Time				lastPacketTime;
 		std::vector<sf::Int32>	characterIdentifiers;
+		std::vector<sf::Int32>	botIdentifiers;			// bots this peer simulates and reports in PositionUpdate
 		bool					ready;
 		bool					timedOut;
+
+		SnapshotState			snapshotState;
+		std::deque<sf::Packet>	pendingSnapshotChunks;
+		sf::Time				joinStartTime;
+		JoinStage				joinStage;
+		std::array<sf::Time, JoinStageCount> joinStageTimes;	// when each stage was reached
+
+		// State updates are limited to a per-peer budget, filled by the characters with the highest priority
+		float					stateBudget;			// bytes per second, halved when the socket backs up
+		float					stateAllowance;			// bytes that may be sent right now
+		std::map<sf::Int32, float> statePriority;		// grows every tick until the character is sent
+		std::size_t				congestedSends;			// since the last reportSendRates()
+
+		// How often state updates go out, adapted to the round trips measured with Ping/Pong
+		SendRate				stateRate;
+		sf::Time				lastStateTime;
+		sf::Time				lastRoundTrip;
+		bool					hasRoundTrip;
+		std::size_t				unansweredPings;
+
+		// Inbound limits, one bucket per Client::PacketType
+		std::array<TokenBucket, Client::PacketTypeCount> packetBuckets;
+		std::size_t				droppedPackets;
+		sf::Time				lastDropReportTime;
+
+		// Pending timers in mTimers, NoTimer when not scheduled
+		TimerWheel::TimerId		timeoutTimer;
+		TimerWheel::TimerId		heartbeatTimer;
+		TimerWheel::TimerId		flushTimer;
+		TimerWheel::TimerId		stateTimer;
+		TimerWheel::TimerId		pingTimer;
+		sf::Time				lastSendTime;
 	};
 
 	// Structure to store information about current Character state
@@ -47,6 +126,8 @@ private:
 		float						knockback;
 		sf::Int32                   survivability;
 		std::map<sf::Int32, bool>	realtimeActions;
+		sf::Vector2f				velocity;			// estimated from consecutive position updates
+		sf::Time					lastUpdateTime;
 	};
 
 	// Unique pointer to remote peers
@@ -61,14 +142,54 @@ private:
 
 	void								handleIncomingPackets();
 	void								handleIncomingPacket(sf::Packet& packet, RemotePeer& receivingPeer, bool& detectedTimeout);
+	bool								acceptPacket(RemotePeer& peer, sf::Int32 packetType);
+	bool								ownsCharacter(const RemotePeer& peer, sf::Int32 characterIdentifier) const;
+	bool								simulatesBot(const RemotePeer& peer, sf::Int32 characterIdentifier) const;
 
 	void								handleIncomingConnections();
+	bool								updateJoins();
+	void								advanceJoin(RemotePeer& peer);
 	void								handleDisconnections();
+	void								resetRound();
+
+	void								startPeerTimers(RemotePeer& peer);
+	void								cancelPeerTimers(RemotePeer& peer);
+	void								checkPeerTimeout(RemotePeer& peer);
+	void								sendHeartbeat(RemotePeer& peer);
+	void								flushPeer(RemotePeer& peer);
+	void								sendStateUpdate(RemotePeer& peer);
+	void								sendPing(RemotePeer& peer);
+	void								handlePong(sf::Packet& packet, RemotePeer& sendingPeer);
+	void								reportSendRates();
+
+	void								writeWorldState(sf::Packet& packet, bool snapshotFollows);
+	void								handleSnapshotChunk(sf::Packet& packet, RemotePeer& sendingPeer);
+	void								updateSnapshotStreaming();
+	void								finishSnapshotStreaming(bool donorCompleted);
+	void								reportJoinTime(const RemotePeer& peer);
+
+	void								updateBots();
+	void								fillBotSlots();
+	void								addBot();
+	void								removeBot(sf::Int32 identifier);
+	void								assignBot(sf::Int32 identifier);
+
+	void								updatePickupSchedule();
+	void								writePickupSchedule(sf::Packet& packet) const;
+	void								verifyPickupSpawn(sf::Packet& packet);
 
-	void								informWorldState(sf::TcpSocket& socket);
+	void								startLockstepMatch();
+	void								relayLockstepInput(sf::Packet& packet, RemotePeer& sendingPeer);
+	void								verifyLockstepChecksum(sf::Packet& packet, RemotePeer& sendingPeer);
 	void								broadcastMessage(const std::string& message);
 	void								sendToAll(sf::Packet& packet);
-	void								updateClientState();
+	void								updateGatewayReport();
+	void								handleSubscribers();
+	void								sendToSubscribers(sf::Packet& packet);
+	void								updateClientState(RemotePeer& peer, sf::Time elapsedTime);
+	float								getStatePriorityWeight(const RemotePeer& peer, sf::Int32 characterIdentifier) const;
+	bool								sendState(RemotePeer& peer, sf::Packet& packet);
+	sf::Socket::Status					sendToPeer(RemotePeer& peer, const sf::Packet& packet, bool droppable = false);
 
 
 private:
@@ -76,7 +197,10 @@ private:
 	sf::Clock							mClock;
 	sf::TcpListener						mListenerSocket;
 	bool								mListeningState;
+	unsigned short						mPort;
 	sf::Time							mClientTimeoutTime;
+	TimerWheel							mTimers;
+	bool								mPendingDisconnections;
 
 	std::size_t							mMaxConnectedPlayers;
 	std::size_t							mConnectedPlayers;
@@ -90,6 +214,49 @@ private:
 	sf::Int32							mCharacterIdentifierCounter;
 	bool								mWaitingThreadEnd;
 
+	sf::Uint32							mPickupSeed;
+	sf::Time							mPickupInterval;
+	sf::Uint32							mNextPickupIndex;
 	sf::Time							mLastSpawnTime;
 	sf::Time							mTimeForNextSpawn;
+	sf::Time							mLastScheduleBroadcast;
+	sf::Time							mLastRoundReset;
+
+	RemotePeer*							mSnapshotDonor;
+
+	// Bots fill the match up to mBotSlots characters. The server only decides their inputs; one ready peer
+	// simulates each bot and reports its position, everyone else sees it as a remote player
+	BotSystem							mBots;
+	std::size_t							mBotSlots;
+	sf::Time							mLastBotUpdate;
+	sf::Time							mBotUpdateTime;			// AI cost since the last report
+	sf::Uint32							mBotUpdateCount;
+	sf::Time							mLastBotReport;
+
+	// LobbyGateway registration; load is the busy fraction of the server loop since the last report
+	sf::IpAddress						mGatewayAddress;
+	sf::TcpSocket						mGatewaySocket;
+	PacketOutbox						mGatewayOutbox;
+	bool								mGatewayConnecting;		// non-blocking connect in progress
+	bool								mGatewayConnected;
+	sf::Time							mLastGatewayAttempt;
+	sf::Time							mLastLoadReport;
+	sf::Time							mBusyTime;
+	sf::Time							mLastRateReport;
+
+	// Read-only subscribers (spectator relays): they get every broadcast and one full state update per tick,
+	// and never take a peer slot
+	sf::TcpListener						mSubscriberListener;
+	std::vector<std::unique_ptr<sf::TcpSocket>> mSubscribers;
+	std::unique_ptr<sf::TcpSocket>		mPendingSubscriber;
+
+	// Join latency, reported by reportJoinTime
+	sf::Uint32							mJoinCount;
+	sf::Time							mJoinTimeTotal;
+	sf::Time							mJoinTimeMax;
+
+	// Lockstep mode: the server only relays inputs, every peer simulates the match itself
+	bool								mLockstep;
+	bool								mLockstepStarted;
+	std::map<sf::Uint32, sf::Uint32>	mLockstepChecksums;
 };
\ No newline at end of file
@@ -1,18 +1,30 @@
 #include "GameState.hpp"
+#include "ReplayState.hpp"
 #include "MusicPlayer.hpp"
+#include "Utility.hpp"
 
 #include <SFML/Graphics/RenderWindow.hpp>
+#include <SFML/System/Clock.hpp>
+
+#include <ctime>
+#include <iostream>
 
 GameState::GameState(StateStack& stack, Context context)
 	: State(stack, context)
 	, mWorld(*context.window, *context.fonts, *context.sounds, false)
 	, mPlayer(nullptr, 1, context.keys1)
 	, mPlayer2(nullptr, 2, context.keys2)
+	, mRoundOver(false)
 {
 	//add both players
 	mWorld.addCharacter(1, 100.f, 100.f);
 	mWorld.addCharacter(2, 500.f, 100.f);
 
+	// Restart the random sequence, keeps the replay's random positions small
+	setRandomSeed(static_cast<unsigned int>(std::time(nullptr)));
+	mReplay.begin({ 1, 2 });
+	mWorld.saveState(mRoundStart);
+
 	// Play game theme
 	context.music->play(Music::MissionTheme);
 }
@@ -24,6 +36,24 @@ void GameState::draw()
 
 bool GameState::update(sf::Time dt)
 {
+	// Updated again after the round ended: the results screen was left with a rematch
+	if (mRoundOver)
+		startRematch();
+
+	// Record the match: a keyframe every few seconds and the input bitmasks of every tick
+	if (mReplay.needsKeyframe())
+	{
+		mWorld.saveState(mKeyframe);
+		mReplay.addKeyframe(mKeyframe);
+	}
+
+	std::vector<sf::Uint8> inputs = { mPlayer.sampleInputMask(), mPlayer2.sampleInputMask() };
+	mReplay.recordTick(inputs, dt);
+
+	CommandQueue& commands = mWorld.getCommandQueue();
+	mPlayer.handleInputMask(inputs[0], commands);
+	mPlayer2.handleInputMask(inputs[1], commands);
+
 	mWorld.update(dt);
 
 	//check for winner of game
@@ -36,26 +66,45 @@ bool GameState::update(sf::Time dt)
 		requestStackPush(States::MissionSuccess2);
 	}
 	else if (lastOne == 0) {
-		requestStackPush(States::MissionDraw);
+		requestStackPush(States::RematchDraw);
 	}
 
-	CommandQueue& commands = mWorld.getCommandQueue();
-	mPlayer.handleRealtimeInput(commands);
-	mPlayer2.handleRealtimeInput(commands);
+	// Save the replay while the results are showing, a rematch then only has to reset the world
+	if (lastOne != -1)
+	{
+		mRoundOver = true;
+		mReplay.saveToFile(ReplayState::LastMatchFile);
+	}
 
 	return true;
 }
 
 bool GameState::handleEvent(const sf::Event& event)
 {
-	// Game input handling
-	CommandQueue& commands = mWorld.getCommandQueue();
-	mPlayer.handleEvent(event, commands);
-	mPlayer2.handleEvent(event, commands);
+	// Game input handling, one-shot actions are applied with the next tick's input
+	mPlayer.bufferEvent(event);
+	mPlayer2.bufferEvent(event);
 
 	// Escape pressed, trigger the pause screen
 	if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Escape)
 		requestStackPush(States::Pause);
 
 	return true;
+}
+
+void GameState::onDestroy()
+{
+	if (!mRoundOver && mReplay.getTickCount() > 0)
+		mReplay.saveToFile(ReplayState::LastMatchFile);
+}
+
+void GameState::startRematch()
+{
+	sf::Clock clock;
+
+	mWorld.resetRound(mRoundStart, static_cast<unsigned int>(std::time(nullptr)));
+	mReplay.begin({ 1, 2 });
+	mRoundOver = false;
+
+	std::cout << "Rematch: playable after " << clock.getElapsedTime().asMicroseconds() << " us" << std::endl;
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include "State.hpp"
 #include "World.hpp"
 #include "Player.hpp"
+#include "Replay.hpp"
 
 #include <SFML/Graphics/Sprite.hpp>
 #include <SFML/Graphics/Text.hpp>
@@ -15,10 +16,22 @@ public:
 	virtual void		draw();
 	virtual bool		update(sf::Time dt);
 	virtual bool		handleEvent(const sf::Event& event);
+	virtual void		onDestroy();
+
+
+private:
+	void				startRematch();
 
 
 private:
 	World				mWorld;
 	Player				mPlayer;
 	Player				mPlayer2;
+
+	Replay				mReplay;
+	World::Snapshot		mKeyframe;
+
+	// Taken once both characters are placed, a rematch restores it instead of building a new World
+	World::Snapshot		mRoundStart;
+	bool				mRoundOver;
 };
\ No newline at end of file
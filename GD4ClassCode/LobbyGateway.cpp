@@ -0,0 +1,231 @@
+#include "LobbyGateway.hpp"
+#include "NetworkProtocol.hpp"
+#include "Foreach.hpp"
+
+#include <SFML/System/Sleep.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+
+namespace
+{
+	// Servers report every second; one that stays silent this long is dropped from the registry
+	const sf::Time ServerTimeout = sf::seconds(5.f);
+
+	// Clients only stay connected for one request
+	const sf::Time ClientTimeout = sf::seconds(5.f);
+
+	// A redirected client counts against the server until it shows up in a report, or this long at most
+	const sf::Time AssignmentTimeout = sf::seconds(5.f);
+}
+
+LobbyGateway::Connection::Connection()
+	: lastPacketTime(sf::Time::Zero)
+	, isServer(false)
+	, matchId(0)
+	, port(0)
+	, players(0)
+	, capacity(0)
+	, load(0.f)
+	, pendingAssignments()
+{
+	socket.setBlocking(false);
+}
+
+LobbyGateway::LobbyGateway(std::size_t localServers)
+	: mThread(&LobbyGateway::executionThread, this)
+	, mConnections()
+	, mPendingConnection(new Connection())
+	, mNextMatchId(1)
+	, mWaitingThreadEnd(false)
+	, mLocalServers()
+{
+	mListenerSocket.setBlocking(false);
+	if (mListenerSocket.listen(GatewayPort) != sf::TcpListener::Done)
+		std::cout << "Gateway: can't listen on port " << GatewayPort << std::endl;
+
+	mThread.launch();
+
+	// Stand-in fleet: the servers find us over loopback like any remote server would
+	for (std::size_t i = 0; i < localServers; ++i)
+	{
+		unsigned short port = static_cast<unsigned short>(ServerPort + 1 + i);
+		mLocalServers.push_back(std::unique_ptr<GameServer>(new GameServer(sf::Vector2u(1024, 768), false, port, sf::IpAddress::LocalHost)));
+	}
+}
+
+LobbyGateway::~LobbyGateway()
+{
+	mLocalServers.clear();
+	mWaitingThreadEnd = true;
+	mThread.wait();
+}
+
+void LobbyGateway::executionThread()
+{
+	while (!mWaitingThreadEnd)
+	{
+		handleIncomingConnections();
+		handleIncomingPackets();
+
+		// Requests are tiny, a short sleep keeps the redirect latency low
+		sf::sleep(sf::milliseconds(10));
+	}
+}
+
+void LobbyGateway::handleIncomingConnections()
+{
+	while (mListenerSocket.accept(mPendingConnection->socket) == sf::TcpListener::Done)
+	{
+		mPendingConnection->lastPacketTime = now();
+		mConnections.push_back(std::move(mPendingConnection));
+		mPendingConnection.reset(new Connection());
+	}
+}
+
+void LobbyGateway::handleIncomingPackets()
+{
+	for (auto itr = mConnections.begin(); itr != mConnections.end(); )
+	{
+		Connection& connection = **itr;
+		bool disconnected = false;
+
+		sf::Packet packet;
+		sf::Socket::Status status;
+		while ((status = connection.socket.receive(packet)) == sf::Socket::Done)
+		{
+			connection.lastPacketTime = now();
+			handlePacket(packet, connection);
+			packet.clear();
+		}
+
+		disconnected |= (status == sf::Socket::Disconnected || status == sf::Socket::Error);
+		disconnected |= (now() >= connection.lastPacketTime + (connection.isServer ? ServerTimeout : ClientTimeout));
+
+		if (disconnected)
+		{
+			if (connection.isServer)
+				std::cout << "Gateway: server on port " << connection.port << " left" << std::endl;
+
+			itr = mConnections.erase(itr);
+		}
+		else
+		{
+			++itr;
+		}
+	}
+}
+
+void LobbyGateway::handlePacket(sf::Packet& packet, Connection& connection)
+{
+	sf::Int32 packetType;
+	packet >> packetType;
+
+	switch (packetType)
+	{
+	case Gateway::RegisterServer:
+	{
+		sf::Uint16 port;
+		sf::Int32 capacity;
+		packet >> port >> capacity;
+		if (!packet || connection.isServer)
+			return;
+
+		connection.isServer = true;
+		connection.matchId = mNextMatchId++;
+		connection.port = port;
+		connection.capacity = capacity;
+
+		std::cout << "Gateway: server " << connection.socket.getRemoteAddress().toString() << ":" << port
+			<< " registered as match " << connection.matchId << std::endl;
+	} break;
+
+	case Gateway::ServerLoad:
+	{
+		sf::Int32 players, capacity;
+		float load;
+		packet >> players >> capacity >> load;
+		if (!packet || !connection.isServer)
+			return;
+
+		// Players that joined since the last report are in this count now
+		sf::Int32 arrived = std::max(players - connection.players, 0);
+		while (arrived-- > 0 && !connection.pendingAssignments.empty())
+			connection.pendingAssignments.pop_front();
+
+		connection.players = players;
+		connection.capacity = capacity;
+		connection.load = load;
+	} break;
+
+	case Gateway::RequestMatch:
+	{
+		if (!connection.isServer)
+			assignMatch(connection);
+	} break;
+	}
+}
+
+void LobbyGateway::assignMatch(Connection& client)
+{
+	sf::Packet packet;
+
+	Connection* server = findServerFor();
+	if (server)
+	{
+		// Loopback servers are reachable under the address the client used for us
+		sf::IpAddress address = server->socket.getRemoteAddress();
+		if (address == sf::IpAddress::LocalHost && client.socket.getRemoteAddress() != sf::IpAddress::LocalHost)
+			address = sf::IpAddress::getLocalAddress();
+
+		server->pendingAssignments.push_back(now());
+
+		packet << static_cast<sf::Int32>(Gateway::MatchAssignment) << server->matchId << address.toString() << static_cast<sf::Uint16>(server->port);
+		std::cout << "Gateway: client sent to match " << server->matchId << " (" << server->players << "+" << server->pendingAssignments.size() - 1
+			<< "/" << server->capacity << " players, load " << server->load << ")" << std::endl;
+	}
+	else
+	{
+		packet << static_cast<sf::Int32>(Gateway::NoMatchAvailable);
+		std::cout << "Gateway: no server with room for a client" << std::endl;
+	}
+
+	client.socket.send(packet);
+}
+
+LobbyGateway::Connection* LobbyGateway::findServerFor()
+{
+	Connection* best = nullptr;
+	bool bestStarted = false;
+
+	FOREACH(ConnectionPtr& connection, mConnections)
+	{
+		if (!connection->isServer)
+			continue;
+
+		// Forget assignments that never turned up
+		std::deque<sf::Time>& pending = connection->pendingAssignments;
+		while (!pending.empty() && now() >= pending.front() + AssignmentTimeout)
+			pending.pop_front();
+
+		sf::Int32 expected = connection->players + static_cast<sf::Int32>(pending.size());
+		if (expected >= connection->capacity)
+			continue;
+
+		// Fill matches that already have players, then prefer the least loaded process
+		bool started = expected > 0;
+		if (!best || (started && !bestStarted) || (started == bestStarted && connection->load < best->load))
+		{
+			best = connection.get();
+			bestStarted = started;
+		}
+	}
+
+	return best;
+}
+
+sf::Time LobbyGateway::now() const
+{
+	return mClock.getElapsedTime();
+}
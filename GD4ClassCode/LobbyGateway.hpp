@@ -0,0 +1,70 @@
+#pragma once
+#include "GameServer.hpp"
+
+#include <SFML/System/Clock.hpp>
+#include <SFML/System/Thread.hpp>
+#include <SFML/Network/IpAddress.hpp>
+#include <SFML/Network/Packet.hpp>
+#include <SFML/Network/TcpListener.hpp>
+#include <SFML/Network/TcpSocket.hpp>
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+
+// Matchmaking front door. Game servers register and report their player count and load once a second;
+// clients ask for a match and are redirected to the server with room that suits best: matches that already
+// have players are filled first, otherwise the least loaded server opens a new one. Each server is a
+// separate process (or thread), so spreading matches spreads them over cores.
+// With localServers > 0 the gateway starts that many GameServers itself on the following ports, all on
+// loopback, standing in for a real fleet
+class LobbyGateway
+{
+public:
+	explicit					LobbyGateway(std::size_t localServers = 0);
+								~LobbyGateway();
+
+
+private:
+	struct Connection
+	{
+								Connection();
+
+		sf::TcpSocket			socket;
+		sf::Time				lastPacketTime;
+
+		// Only for registered game servers
+		bool					isServer;
+		sf::Uint32				matchId;
+		unsigned short			port;
+		sf::Int32				players;
+		sf::Int32				capacity;
+		float					load;
+		std::deque<sf::Time>	pendingAssignments;		// redirected clients the server hasn't reported yet
+	};
+
+	typedef std::unique_ptr<Connection> ConnectionPtr;
+
+
+private:
+	void						executionThread();
+	void						handleIncomingConnections();
+	void						handleIncomingPackets();
+	void						handlePacket(sf::Packet& packet, Connection& connection);
+	void						assignMatch(Connection& client);
+	Connection*					findServerFor();
+	sf::Time					now() const;
+
+
+private:
+	sf::Thread					mThread;
+	sf::Clock					mClock;
+	sf::TcpListener				mListenerSocket;
+	std::vector<ConnectionPtr>	mConnections;
+	ConnectionPtr				mPendingConnection;
+	sf::Uint32					mNextMatchId;
+	bool						mWaitingThreadEnd;
+
+	std::vector<std::unique_ptr<GameServer>> mLocalServers;
+};
@@ -0,0 +1,509 @@
+#include "LockstepGameState.hpp"
+#include "MultiplayerGameState.hpp"
+#include "ReplayState.hpp"
+#include "MusicPlayer.hpp"
+#include "PickupSpawner.hpp"
+#include "Foreach.hpp"
+#include "Utility.hpp"
+
+#include <SFML/Graphics/RenderWindow.hpp>
+
+#include <iostream>
+#include <limits>
+
+
+namespace
+{
+	const sf::Uint32 NoTick = std::numeric_limits<sf::Uint32>::max();
+}
+
+LockstepGameState::LockstepGameState(StateStack& stack, Context context, bool isHost)
+	: State(stack, context)
+	, mWorld(*context.window, *context.fonts, *context.sounds, false)
+	, mWindow(*context.window)
+	, mGameServer(nullptr)
+	, mPhase(Connecting)
+	, mLocalIdentifier(0)
+	, mLobbyPlayers(0)
+	, mCurrentTick(0)
+	, mConfirmedTick(0)
+	, mRollbackTick(NoTick)
+	, mMatchOverTick(NoTick)
+	, mMatchResult(-1)
+	, mNextInputTick(InputDelay)
+	, mStalledFrames(0)
+	, mReplay()
+	, mSaveTime(sf::Time::Zero)
+	, mRestoreTime(sf::Time::Zero)
+	, mSaveCount(0)
+	, mRestoreCount(0)
+	, mResimulationTime()
+	, mResimulationMaxTime()
+	, mResimulationCount()
+	, mResimulationOverruns()
+	, mActiveState(true)
+	, mHasFocus(true)
+	, mHost(isHost)
+{
+	mStatusText.setFont(context.fonts->get(Fonts::Main));
+	mStatusText.setCharacterSize(35);
+	mStatusText.setColor(sf::Color::White);
+
+	if (isHost)
+	{
+		mGameServer.reset(new GameServer(mWindow.getSize(), true));
+		mServerAddress = "127.0.0.1";
+	}
+	else
+	{
+		mServerAddress = getAddressFromFile();
+	}
+
+	mSocket.setBlocking(false);
+	mSocket.connect(mServerAddress, ServerPort);
+	mConnectClock.restart();
+	setStatus("Attempting to connect...");
+
+	context.music->play(Music::MissionTheme);
+}
+
+void LockstepGameState::draw()
+{
+	if (mPhase == Running)
+	{
+		mWorld.draw();
+	}
+	else
+	{
+		mWindow.setView(mWindow.getDefaultView());
+		mWindow.draw(mStatusText);
+	}
+}
+
+void LockstepGameState::onActivate()
+{
+	mActiveState = true;
+}
+
+void LockstepGameState::onDestroy()
+{
+	if (mSaveCount > 0)
+		reportRollbackTimes();
+
+	if (mReplay.getTickCount() > 0)
+		mReplay.saveToFile(ReplayState::LastMatchFile);
+
+	if (mPhase == Lobby || mPhase == Running)
+	{
+		sf::Packet packet;
+		packet << static_cast<sf::Int32>(Client::Quit);
+		mSocket.send(packet);
+	}
+}
+
+bool LockstepGameState::update(sf::Time dt)
+{
+	if (mPhase == Connecting)
+	{
+		updateConnection();
+		return true;
+	}
+
+	if (mPhase == Failed)
+	{
+		if (mFailedClock.getElapsedTime() >= sf::seconds(5.f))
+		{
+			requestStackClear();
+			requestStackPush(States::Menu);
+		}
+		return true;
+	}
+
+	// Inputs of remote players, lobby updates and the match start
+	sf::Packet packet;
+	while (mPhase != Failed && mSocket.receive(packet) == sf::Socket::Done)
+	{
+		sf::Int32 packetType;
+		packet >> packetType;
+		handlePacket(packetType, packet);
+		packet.clear();
+	}
+
+	if (mPhase == Lobby)
+	{
+		// Keep the server from timing us out while nothing is simulated
+		if (mConnectClock.getElapsedTime() > sf::seconds(1.f))
+		{
+			sf::Packet keepAlive;
+			keepAlive << static_cast<sf::Int32>(Client::PositionUpdate) << static_cast<sf::Int32>(0);
+			mSocket.send(keepAlive);
+			mConnectClock.restart();
+		}
+	}
+	else if (mPhase == Running)
+	{
+		sendLocalInput();
+
+		// Late inputs that contradict a prediction rewind the world first, then the new tick is predicted
+		rollback(dt);
+		confirmTicks(dt);
+		advanceTick(dt);
+		checkMatchEnd();
+	}
+
+	return true;
+}
+
+bool LockstepGameState::handleEvent(const sf::Event& event)
+{
+	if (event.type == sf::Event::KeyPressed)
+	{
+		// One-shot actions are buffered until the next input sample
+		if (mActiveState && mPhase == Running)
+			mPlayers[mLocalIdentifier]->bufferEvent(event);
+
+		if (event.key.code == sf::Keyboard::Return && mHost && mPhase == Lobby && mLobbyPlayers >= 2)
+		{
+			sf::Packet packet;
+			packet << static_cast<sf::Int32>(Client::LockstepStart);
+			mSocket.send(packet);
+		}
+
+		// Escape pressed, trigger the pause screen; the match keeps running underneath
+		if (event.key.code == sf::Keyboard::Escape)
+		{
+			mActiveState = false;
+			requestStackPush(States::NetworkPause);
+		}
+	}
+	else if (event.type == sf::Event::GainedFocus)
+	{
+		mHasFocus = true;
+	}
+	else if (event.type == sf::Event::LostFocus)
+	{
+		mHasFocus = false;
+	}
+
+	return true;
+}
+
+void LockstepGameState::handlePacket(sf::Int32 packetType, sf::Packet& packet)
+{
+	switch (packetType)
+	{
+	case Server::SpawnSelf:
+	{
+		packet >> mLocalIdentifier;
+		mLobbyPlayers++;
+	} break;
+
+	// Players that were already waiting in the lobby
+	case Server::InitialState:
+	{
+		sf::Int32 snapshotVersion, characterCount;
+		packet >> snapshotVersion >> characterCount;
+		if (packet)
+			mLobbyPlayers += characterCount;
+	} break;
+
+	case Server::PlayerConnect:
+	{
+		mLobbyPlayers++;
+	} break;
+
+	case Server::PlayerDisconnect:
+	{
+		// The missing inputs would stall every peer forever, so a running match ends here
+		if (mPhase == Running)
+		{
+			mPhase = Failed;
+			mFailedClock.restart();
+			setStatus("A player left, match aborted");
+		}
+		else if (mLobbyPlayers > 0)
+		{
+			mLobbyPlayers--;
+		}
+	} break;
+
+	case Server::LockstepStart:
+	{
+		sf::Uint32 seed;
+		sf::Int32 count;
+		packet >> seed >> count;
+
+		std::vector<sf::Int32> identifiers;
+		for (sf::Int32 i = 0; i < count; ++i)
+		{
+			sf::Int32 identifier;
+			packet >> identifier;
+			identifiers.push_back(identifier);
+		}
+
+		startMatch(seed, identifiers);
+	} break;
+
+	case Server::LockstepInput:
+	{
+		sf::Int32 identifier;
+		sf::Uint32 tick;
+		sf::Uint8 actionMask;
+		packet >> identifier >> tick >> actionMask;
+
+		receiveInput(identifier, tick, actionMask);
+	} break;
+	}
+
+	if (mPhase == Lobby)
+	{
+		std::string status = toString(mLobbyPlayers) + " player(s) connected";
+		if (mHost)
+			status += mLobbyPlayers >= 2 ? "\nPress Enter to start" : "\nWaiting for players...";
+		else
+			status += "\nWaiting for host to start...";
+
+		setStatus(status);
+	}
+}
+
+void LockstepGameState::updateConnection()
+{
+	if (mSocket.getRemoteAddress() != sf::IpAddress::None)
+	{
+		mPhase = Lobby;
+		mConnectClock.restart();
+		setStatus("Waiting for players...");
+	}
+	else if (mConnectClock.getElapsedTime() >= sf::seconds(5.f))
+	{
+		mPhase = Failed;
+		mFailedClock.restart();
+		setStatus("Could not connect to the remote server!");
+	}
+	else
+	{
+		// Our own server thread may not be listening yet, keep retrying until the timeout
+		mSocket.connect(mServerAddress, ServerPort);
+	}
+}
+
+void LockstepGameState::startMatch(sf::Uint32 seed, const std::vector<sf::Int32>& identifiers)
+{
+	// Same seed, same creation order: every peer now holds an identical world
+	setRandomSeed(seed);
+	mWorld.setPickupSchedule(seed, sf::seconds(15.f), 0, PickupSpawner::gapAfter(seed, 0, sf::seconds(15.f)));
+
+	for (std::size_t i = 0; i < identifiers.size(); ++i)
+	{
+		sf::Int32 identifier = identifiers[i];
+		mWorld.addCharacter(identifier, 100.f + 200.f * i, 100.f);
+		mPlayers[identifier].reset(new Player(nullptr, identifier, identifier == mLocalIdentifier ? getContext().keys1 : nullptr));
+
+		// Nobody has input for the first ticks, they are covered by the input delay
+		for (sf::Uint32 tick = 0; tick < InputDelay; ++tick)
+			mInputs[tick][identifier] = 0;
+		mLastConfirmedInputs[identifier] = 0;
+	}
+
+	std::vector<sf::Int32> recordedIdentifiers;
+	FOREACH(auto& pair, mPlayers)
+		recordedIdentifiers.push_back(pair.first);
+	mReplay.begin(recordedIdentifiers);
+
+	mPhase = Running;
+	std::cout << "Lockstep match started, seed " << seed << ", " << identifiers.size() << " players" << std::endl;
+}
+
+void LockstepGameState::sendLocalInput()
+{
+	// One sample per simulated tick, scheduled InputDelay ticks ahead
+	if (mNextInputTick > mCurrentTick + InputDelay)
+		return;
+
+	sf::Uint8 actionMask = mPlayers[mLocalIdentifier]->sampleInputMask();
+	if (!mActiveState || !mHasFocus)
+		actionMask = 0;
+
+	mInputs[mNextInputTick][mLocalIdentifier] = actionMask;
+
+	sf::Packet packet;
+	packet << static_cast<sf::Int32>(Client::LockstepInput) << mNextInputTick << actionMask;
+	mSocket.send(packet);
+
+	mNextInputTick++;
+}
+
+void LockstepGameState::receiveInput(sf::Int32 identifier, sf::Uint32 tick, sf::Uint8 actionMask)
+{
+	if (tick < mConfirmedTick || mPlayers.find(identifier) == mPlayers.end())
+		return;
+
+	mInputs[tick][identifier] = actionMask;
+
+	// Already simulated with a guess: rewind if the guess was wrong
+	if (tick < mCurrentTick && mUsedInputs[tick % SnapshotRingSize][identifier] != actionMask)
+		mRollbackTick = std::min(mRollbackTick, tick);
+}
+
+void LockstepGameState::rollback(sf::Time dt)
+{
+	if (mRollbackTick >= mCurrentTick)
+	{
+		mRollbackTick = NoTick;
+		return;
+	}
+
+	sf::Clock clock;
+	sf::Uint32 depth = mCurrentTick - mRollbackTick;
+
+	mWorld.restoreState(mSnapshots[mRollbackTick % SnapshotRingSize]);
+	mRestoreTime += clock.getElapsedTime();
+	mRestoreCount++;
+
+	// The match may not be over in the corrected timeline
+	if (mMatchOverTick >= mRollbackTick)
+		mMatchOverTick = NoTick;
+
+	mWorld.setMuted(true);
+	for (sf::Uint32 tick = mRollbackTick; tick < mCurrentTick; ++tick)
+		simulateTick(tick, dt);
+	mWorld.setMuted(false);
+
+	sf::Time elapsed = clock.getElapsedTime();
+	mResimulationTime[depth] += elapsed;
+	mResimulationMaxTime[depth] = std::max(mResimulationMaxTime[depth], elapsed);
+	mResimulationCount[depth]++;
+	if (elapsed > dt)
+		mResimulationOverruns[depth]++;
+
+	mRollbackTick = NoTick;
+}
+
+void LockstepGameState::confirmTicks(sf::Time dt)
+{
+	while (mConfirmedTick < mCurrentTick)
+	{
+		auto inputs = mInputs.find(mConfirmedTick);
+		if (inputs == mInputs.end() || inputs->second.size() < mPlayers.size())
+			break;
+
+		// Everything up to here was simulated with the real inputs, the checksum is final
+		if (mConfirmedTick % ChecksumInterval == 0)
+		{
+			sf::Packet packet;
+			packet << static_cast<sf::Int32>(Client::LockstepChecksum) << mConfirmedTick << mChecksums[mConfirmedTick % SnapshotRingSize];
+			mSocket.send(packet);
+		}
+
+		// Confirmed ticks go to the replay, their snapshots are final keyframes
+		if (mReplay.needsKeyframe())
+			mReplay.addKeyframe(mSnapshots[mConfirmedTick % SnapshotRingSize]);
+
+		std::vector<sf::Uint8> recordedInputs;
+		FOREACH(auto& pair, inputs->second)
+			recordedInputs.push_back(pair.second);
+		mReplay.recordTick(recordedInputs, dt);
+
+		mLastConfirmedInputs = inputs->second;
+		mInputs.erase(inputs);
+		mConfirmedTick++;
+	}
+}
+
+bool LockstepGameState::advanceTick(sf::Time dt)
+{
+	// Too far ahead of the confirmed inputs, the snapshot ring can't rewind further
+	if (mCurrentTick - mConfirmedTick >= MaxRollbackTicks)
+	{
+		mStalledFrames++;
+		return false;
+	}
+
+	if (mStalledFrames > 0)
+	{
+		std::cout << "Lockstep: waited " << mStalledFrames << " frames for tick " << mConfirmedTick << std::endl;
+		mStalledFrames = 0;
+	}
+
+	simulateTick(mCurrentTick, dt);
+	mCurrentTick++;
+	return true;
+}
+
+void LockstepGameState::simulateTick(sf::Uint32 tick, sf::Time dt)
+{
+	std::size_t slot = tick % SnapshotRingSize;
+
+	sf::Clock clock;
+	mWorld.saveState(mSnapshots[slot]);
+	mSaveTime += clock.getElapsedTime();
+	mSaveCount++;
+
+	// Real input where we have it, the last confirmed one otherwise
+	auto received = mInputs.find(tick);
+	TickInputs& used = mUsedInputs[slot];
+	FOREACH(auto& pair, mPlayers)
+	{
+		sf::Uint8 actionMask = mLastConfirmedInputs[pair.first];
+		if (received != mInputs.end())
+		{
+			auto input = received->second.find(pair.first);
+			if (input != received->second.end())
+				actionMask = input->second;
+		}
+
+		used[pair.first] = actionMask;
+	}
+
+	// std::map keeps the players sorted by identifier, so all peers queue commands in the same order
+	CommandQueue& commands = mWorld.getCommandQueue();
+	FOREACH(auto& pair, mPlayers)
+		pair.second->handleInputMask(used[pair.first], commands);
+
+	mWorld.update(dt);
+	mChecksums[slot] = mWorld.getStateChecksum();
+
+	if (mMatchOverTick == NoTick && mWorld.isLastOneStanding() != -1)
+	{
+		mMatchOverTick = tick;
+		mMatchResult = mWorld.isLastOneStanding();
+	}
+}
+
+void LockstepGameState::checkMatchEnd()
+{
+	// Only act on an outcome no late input can roll back anymore
+	if (mMatchOverTick == NoTick || mConfirmedTick <= mMatchOverTick)
+		return;
+
+	if (mMatchResult == mLocalIdentifier)
+		requestStackPush(States::MissionSuccess);
+	else if (mMatchResult == 0)
+		requestStackPush(States::MissionDraw);
+	else
+		requestStackPush(States::GameOver);
+}
+
+void LockstepGameState::reportRollbackTimes()
+{
+	std::cout << "Rollback: " << mSaveCount << " saves, avg " << mSaveTime.asMicroseconds() / mSaveCount << " us; "
+		<< mRestoreCount << " restores, avg " << (mRestoreCount > 0 ? mRestoreTime.asMicroseconds() / mRestoreCount : 0) << " us" << std::endl;
+
+	for (sf::Uint32 depth = 1; depth <= MaxRollbackTicks; ++depth)
+	{
+		if (mResimulationCount[depth] == 0)
+			continue;
+
+		std::cout << "  re-simulate " << depth << " ticks: " << mResimulationCount[depth] << "x, avg "
+			<< mResimulationTime[depth].asMicroseconds() / mResimulationCount[depth] << " us, max "
+			<< mResimulationMaxTime[depth].asMicroseconds() << " us, " << mResimulationOverruns[depth] << " longer than a frame" << std::endl;
+	}
+}
+
+void LockstepGameState::setStatus(const std::string& status)
+{
+	mStatusText.setString(status);
+	centerOrigin(mStatusText);
+	mStatusText.setPosition(mWindow.getSize().x / 2.f, mWindow.getSize().y / 2.f);
+}
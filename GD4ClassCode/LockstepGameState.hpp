@@ -0,0 +1,123 @@
+#pragma once
+
+#include "State.hpp"
+#include "World.hpp"
+#include "Player.hpp"
+#include "GameServer.hpp"
+#include "NetworkProtocol.hpp"
+#include "Replay.hpp"
+
+#include <SFML/System/Clock.hpp>
+#include <SFML/Graphics/Text.hpp>
+#include <SFML/Network/TcpSocket.hpp>
+#include <SFML/Network/Packet.hpp>
+#include <SFML/Network/IpAddress.hpp>
+
+#include <array>
+#include <map>
+#include <vector>
+
+
+// Deterministic lockstep match: only inputs travel over the network and every peer runs the full simulation.
+// Remote inputs that haven't arrived yet are predicted (repeat the last confirmed one); when a prediction turns
+// out wrong, the world is restored from the snapshot ring and re-simulated up to the present (rollback)
+class LockstepGameState : public State
+{
+public:
+	LockstepGameState(StateStack& stack, Context context, bool isHost);
+
+	virtual void				draw();
+	virtual bool				update(sf::Time dt);
+	virtual bool				handleEvent(const sf::Event& event);
+	virtual void				onActivate();
+	void						onDestroy();
+
+
+private:
+	enum Phase
+	{
+		Connecting,
+		Lobby,			// connected, waiting for the host to start the match
+		Running,
+		Failed
+	};
+
+	// Ticks between sampling an input and simulating it; small, rollback hides the rest of the latency
+	static const sf::Uint32		InputDelay = 1;
+
+	// How far the simulation may run ahead of the confirmed inputs before it stalls like plain lockstep
+	static const sf::Uint32		MaxRollbackTicks = 8;
+	static const sf::Uint32		SnapshotRingSize = MaxRollbackTicks + 1;
+
+	// Ticks between checksum reports to the server
+	static const sf::Uint32		ChecksumInterval = 60;
+
+
+private:
+	void						handlePacket(sf::Int32 packetType, sf::Packet& packet);
+	void						updateConnection();
+	void						startMatch(sf::Uint32 seed, const std::vector<sf::Int32>& identifiers);
+	void						sendLocalInput();
+	void						receiveInput(sf::Int32 identifier, sf::Uint32 tick, sf::Uint8 actionMask);
+	void						rollback(sf::Time dt);
+	void						confirmTicks(sf::Time dt);
+	bool						advanceTick(sf::Time dt);
+	void						simulateTick(sf::Uint32 tick, sf::Time dt);
+	void						checkMatchEnd();
+	void						reportRollbackTimes();
+	void						setStatus(const std::string& status);
+
+
+private:
+	typedef std::unique_ptr<Player> PlayerPtr;
+	typedef std::map<sf::Int32, sf::Uint8> TickInputs;
+
+
+private:
+	World						mWorld;
+	sf::RenderWindow&			mWindow;
+
+	sf::TcpSocket				mSocket;
+	sf::IpAddress				mServerAddress;
+	std::unique_ptr<GameServer> mGameServer;
+	sf::Clock					mConnectClock;
+	Phase						mPhase;
+
+	std::map<sf::Int32, PlayerPtr> mPlayers;
+	sf::Int32					mLocalIdentifier;
+	std::size_t					mLobbyPlayers;
+
+	std::map<sf::Uint32, TickInputs> mInputs;				// received, not yet confirmed ticks
+	TickInputs					mLastConfirmedInputs;		// prediction for inputs still missing
+	sf::Uint32					mCurrentTick;
+	sf::Uint32					mConfirmedTick;				// first tick not all inputs are known for
+	sf::Uint32					mRollbackTick;				// earliest mispredicted tick, NoTick if none
+	sf::Uint32					mMatchOverTick;
+	int							mMatchResult;
+	sf::Uint32					mNextInputTick;
+	sf::Uint32					mStalledFrames;
+	Replay						mReplay;				// confirmed ticks only
+
+	// Indexed by tick % SnapshotRingSize: world state at the start of the tick, the inputs it was simulated with
+	// and the checksum after it
+	std::array<World::Snapshot, SnapshotRingSize>	mSnapshots;
+	std::array<TickInputs, SnapshotRingSize>		mUsedInputs;
+	std::array<sf::Uint32, SnapshotRingSize>		mChecksums;
+
+	// Timings, printed when the state is left
+	sf::Time					mSaveTime;
+	sf::Time					mRestoreTime;
+	sf::Uint32					mSaveCount;
+	sf::Uint32					mRestoreCount;
+	std::array<sf::Time, MaxRollbackTicks + 1>		mResimulationTime;
+	std::array<sf::Time, MaxRollbackTicks + 1>		mResimulationMaxTime;
+	std::array<sf::Uint32, MaxRollbackTicks + 1>	mResimulationCount;
+	std::array<sf::Uint32, MaxRollbackTicks + 1>	mResimulationOverruns;	// took longer than a frame
+
+	sf::Text					mStatusText;
+	sf::Clock					mFailedClock;
+
+	bool						mActiveState;
+	bool						mHasFocus;
+	bool						mHost;
+};
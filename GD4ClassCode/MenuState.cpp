@@ -16,7 +16,7 @@ MenuState::MenuState(StateStack& stack, Context context)
 	mBackgroundSprite.setTexture(texture);
 
 	auto playButton = std::make_shared<GUI::Button>(context);
-	playButton->setPosition(420, 270);
+	playButton->setPosition(420, 190);
 	playButton->setText("Play");
 	playButton->setCallback([this]()
 	{
@@ -24,8 +24,17 @@ MenuState::MenuState(StateStack& stack, Context context)
 		requestStackPush(States::Game);
 	});
 
+	auto replayButton = std::make_shared<GUI::Button>(context);
+	replayButton->setPosition(420, 242);
+	replayButton->setText("Replay");
+	replayButton->setCallback([this]()
+	{
+		requestStackPop();
+		requestStackPush(States::Replay);
+	});
+
 	auto hostPlayButton = std::make_shared<GUI::Button>(context);
-	hostPlayButton->setPosition(420, 325);
+	hostPlayButton->setPosition(420, 294);
 	hostPlayButton->setText("Host");
 	hostPlayButton->setCallback([this]()
 	{
@@ -34,7 +43,7 @@ MenuState::MenuState(StateStack& stack, Context context)
 	});
 
 	auto joinPlayButton = std::make_shared<GUI::Button>(context);
-	joinPlayButton->setPosition(420, 380);
+	joinPlayButton->setPosition(420, 346);
 	joinPlayButton->setText("Join");
 	joinPlayButton->setCallback([this]()
 	{
@@ -42,8 +51,35 @@ MenuState::MenuState(StateStack& stack, Context context)
 		requestStackPush(States::JoinGame);
 	});
 
+	auto spectateButton = std::make_shared<GUI::Button>(context);
+	spectateButton->setPosition(420, 398);
+	spectateButton->setText("Spectate");
+	spectateButton->setCallback([this]()
+	{
+		requestStackPop();
+		requestStackPush(States::Spectate);
+	});
+
+	auto lockstepHostButton = std::make_shared<GUI::Button>(context);
+	lockstepHostButton->setPosition(420, 450);
+	lockstepHostButton->setText("Lockstep Host");
+	lockstepHostButton->setCallback([this]()
+	{
+		requestStackPop();
+		requestStackPush(States::LockstepHost);
+	});
+
+	auto lockstepJoinButton = std::make_shared<GUI::Button>(context);
+	lockstepJoinButton->setPosition(420, 502);
+	lockstepJoinButton->setText("Lockstep Join");
+	lockstepJoinButton->setCallback([this]()
+	{
+		requestStackPop();
+		requestStackPush(States::LockstepJoin);
+	});
+
 	auto optionsPlayButton = std::make_shared<GUI::Button>(context);
-	optionsPlayButton->setPosition(420, 435);
+	optionsPlayButton->setPosition(420, 554);
 	optionsPlayButton->setText("Options");
 	optionsPlayButton->setCallback([this]()
 	{
@@ -51,7 +87,7 @@ MenuState::MenuState(StateStack& stack, Context context)
 	});
 
 	auto settingsButton = std::make_shared<GUI::Button>(context);
-	settingsButton->setPosition(420, 490);
+	settingsButton->setPosition(420, 606);
 	settingsButton->setText("Controls");
 	settingsButton->setCallback([this]()
 	{
@@ -59,7 +95,7 @@ MenuState::MenuState(StateStack& stack, Context context)
 	});
 	
 	auto HighScoreButton = std::make_shared<GUI::Button>(context);
-	HighScoreButton->setPosition(420, 545);
+	HighScoreButton->setPosition(420, 658);
 	HighScoreButton->setText("HighScore");
 	HighScoreButton->setCallback([this]()
 	{
@@ -67,7 +103,7 @@ MenuState::MenuState(StateStack& stack, Context context)
 	});
 
 	auto exitButton = std::make_shared<GUI::Button>(context);
-	exitButton->setPosition(420, 600);
+	exitButton->setPosition(420, 710);
 	exitButton->setText("Exit");
 	exitButton->setCallback([this]()
 	{
@@ -75,8 +111,12 @@ MenuState::MenuState(StateStack& stack, Context context)
 	});
 
 	mGUIContainer.pack(playButton);
+	mGUIContainer.pack(replayButton);
 	mGUIContainer.pack(hostPlayButton);
 	mGUIContainer.pack(joinPlayButton);
+	mGUIContainer.pack(spectateButton);
+	mGUIContainer.pack(lockstepHostButton);
+	mGUIContainer.pack(lockstepJoinButton);
 	mGUIContainer.pack(optionsPlayButton);
 	mGUIContainer.pack(settingsButton);
 	mGUIContainer.pack(HighScoreButton);
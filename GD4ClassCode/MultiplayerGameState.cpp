@@ -6,10 +6,24 @@
 
 #include <SFML/Graphics/RenderWindow.hpp>
 #include <SFML/Network/IpAddress.hpp>
+#include <SFML/Network/SocketSelector.hpp>
 
 #include <fstream>
+#include <iostream>
 
 
+namespace
+{
+	// PositionUpdate rate, adapted between these bounds
+	const float MinPositionRate = 10.f;
+	const float MaxPositionRate = 60.f;
+	const float InitialPositionRate = 20.f;
+	const sf::Time RateReportInterval = sf::seconds(10.f);
+
+	// A connect attempt without an answer for this long is given up and started over
+	const sf::Time ConnectAttemptTimeout = sf::seconds(2.f);
+}
+
 sf::IpAddress getAddressFromFile()
 {
 	{ // Try to open existing file (RAII block)
@@ -26,55 +40,67 @@ sf::IpAddress getAddressFromFile()
 	return localAddress;
 }
 
-MultiplayerGameState::MultiplayerGameState(StateStack& stack, Context context, bool isHost)
+MultiplayerGameState::MultiplayerGameState(StateStack& stack, Context context, bool isHost, bool isSpectator)
 	: State(stack, context)
 	, mWorld(*context.window, *context.fonts, *context.sounds, true)
+	, mMatchStart()
 	, mWindow(*context.window)
 	, mTextureHolder(*context.textures)
-	, mConnected(false)
+	, mReportedPickupIndex(0)
+	, mOutbox(mSocket)
+	, mServerPort(ServerPort)
+	, mMatchRequested(false)
+	, mConnectionPhase(Connecting)
+	, mConnectPending(false)
+	, mPhaseStartTimes()
+	, mJoinTimesReported(false)
 	, mGameServer(nullptr)
+	, mPositionRate(MinPositionRate, MaxPositionRate, InitialPositionRate)
 	, mActiveState(true)
 	, mHasFocus(true)
 	, mHost(isHost)
+	, mSpectator(isSpectator)
 	, mGameStarted(false)
+	, mRoundOver(false)
+	, mRematchPending(false)
 	, mClientTimeout(sf::seconds(2.f))
 	, mTimeSinceLastPacket(sf::seconds(0.f))
 {
 	mBroadcastText.setFont(context.fonts->get(Fonts::Main));
 	mBroadcastText.setPosition(1024.f / 2, 100.f);
 
-	// We reuse this text for "Attempt to connect" and "Failed to connect" messages
+	// We reuse this text for the join progress and "Failed to connect" messages
 	mFailedConnectionText.setFont(context.fonts->get(Fonts::Main));
-	mFailedConnectionText.setString("Attempting to connect...");
 	mFailedConnectionText.setCharacterSize(35);
 	mFailedConnectionText.setColor(sf::Color::White);
-	centerOrigin(mFailedConnectionText);
-	mFailedConnectionText.setPosition(mWindow.getSize().x / 2.f, mWindow.getSize().y / 2.f);
 
-	// Render a "establishing connection" frame for user feedback
-	mWindow.clear(sf::Color::Black);
-	mWindow.draw(mFailedConnectionText);
-	mWindow.display();
-	mFailedConnectionText.setString("Could not connect to the remote server!");
-	centerOrigin(mFailedConnectionText);
+	mWorld.saveState(mMatchStart);
+
+	// Connect in the background, update() polls for completion so the window keeps rendering
+	mSocket.setBlocking(false);
+	mJoinClock.restart();
 
-	sf::IpAddress ip;
 	if (isHost)
 	{
 		mGameServer.reset(new GameServer(mWindow.getSize()));
-		ip = "127.0.0.1";
+		mServerAddress = "127.0.0.1";
+		connectToServer();
 	}
-	else
+	else if (isSpectator)
 	{
-		ip = getAddressFromFile();
+		mServerAddress = getAddressFromFile();
+		mServerPort = SpectatorRelayPort;
+		connectToServer();
 	}
-
-	if (mSocket.connect(ip, ServerPort, sf::seconds(5.f)) == sf::TcpSocket::Done)
-		mConnected = true;
 	else
-		mFailedConnectionClock.restart();
-
-	mSocket.setBlocking(false);
+	{
+		// Ask the gateway at that address first; without one, it is the game server itself
+		mServerAddress = getAddressFromFile();
+		mGatewaySocket.setBlocking(false);
+		setConnectionPhase(Matchmaking);
+		mConnectAttemptClock.restart();
+		mGatewaySocket.connect(mServerAddress, GatewayPort);
+	}
 
 	// Play game theme
 	context.music->play(Music::MissionTheme);
@@ -82,10 +108,13 @@ MultiplayerGameState::MultiplayerGameState(StateStack& stack, Context context, b
 
 void MultiplayerGameState::draw()
 {
-	if (mConnected)
+	if (mConnectionPhase == Ready)
 	{
 		mWorld.draw();
 
+		if (!mJoinTimesReported)
+			reportJoinTimes();
+
 		// Broadcast messages in default view
 		mWindow.setView(mWindow.getDefaultView());
 
@@ -108,22 +137,46 @@ void MultiplayerGameState::onActivate()
 
 void MultiplayerGameState::onDestroy()
 {
-	if (!mHost && mConnected)
+	if (!mHost && !mSpectator && mConnectionPhase != Matchmaking && mConnectionPhase != Connecting && mConnectionPhase != Failed)
 	{
 		// Inform server this client is dying
 		sf::Packet packet;
 		packet << static_cast<sf::Int32>(Client::Quit);
-		mSocket.send(packet);
+		mOutbox.send(packet);
 	}
 }
 
 bool MultiplayerGameState::update(sf::Time dt)
 {
+	// Still joining: Advance the connection state machine, the world is not simulated yet
+	if (mConnectionPhase != Ready && mConnectionPhase != Failed)
+	{
+		updateConnection();
+	}
+
 	// Connected to server: Handle all the network logic
-	if (mConnected)
+	else if (mConnectionPhase == Ready)
 	{
+		// Updated again after the results screen: it was left with a rematch
+		if (mRoundOver)
+			requestRematch();
+
 		mWorld.update(dt);
 
+		// Report locally generated pickups, so the server can check every client follows its schedule
+		const PickupSpawner& pickups = mWorld.getPickupSpawner();
+		if (pickups.getNextIndex() != mReportedPickupIndex && !mSpectator)
+		{
+			PickupSpawner::Spawn spawn = PickupSpawner::spawnAt(pickups.getSeed(), pickups.getNextIndex() - 1);
+
+			sf::Packet packet;
+			packet << static_cast<sf::Int32>(Client::PickupSpawned);
+			packet << spawn.index << static_cast<sf::Int32>(spawn.type) << spawn.position.x;
+			mOutbox.send(packet);
+
+			mReportedPickupIndex = pickups.getNextIndex();
+		}
+
 		// Remove players whose characters were destroyed
 		bool foundLocalPlane = false;
 		for (auto itr = mPlayers.begin(); itr != mPlayers.end(); )
@@ -152,7 +205,8 @@ bool MultiplayerGameState::update(sf::Time dt)
 					{
 						outputFile << "Player" << it->first << " survivability = " << it->second << std::endl;
 					}
-					requestStackPush(States::GameOver);
+					requestStackPush(mSpectator ? States::GameOver : States::RematchGameOver);
+					mRoundOver = true;
 				}
 					
 			}
@@ -180,26 +234,29 @@ bool MultiplayerGameState::update(sf::Time dt)
 		FOREACH(auto& pair, mPlayers)
 			pair.second->handleRealtimeNetworkInput(commands);
 
-		// Handle messages from server that may have arrived
+		// Handle all messages from server that may have arrived; one per frame falls behind once the server
+		// sends faster than the frame rate and the backlog piles up in the socket
 		sf::Packet packet;
-		if (mSocket.receive(packet) == sf::Socket::Done)
+		bool receivedPacket = false;
+		while (mConnectionPhase == Ready && mSocket.receive(packet) == sf::Socket::Done)
 		{
+			receivedPacket = true;
 			mTimeSinceLastPacket = sf::seconds(0.f);
 			sf::Int32 packetType;
 			packet >> packetType;
 			handlePacket(packetType, packet);
+			packet.clear();
 		}
-		else
+
+		if (!receivedPacket)
 		{
 			// Check for timeout with the server
 			if (mTimeSinceLastPacket > mClientTimeout)
 			{
-				mConnected = false;
+				setConnectionPhase(Failed);
 
 				mFailedConnectionText.setString("Lost connection to server");
 				centerOrigin(mFailedConnectionText);
-
-				mFailedConnectionClock.restart();
 			}
 		}
 
@@ -210,27 +267,43 @@ bool MultiplayerGameState::update(sf::Time dt)
 		if (mPlayerInvitationTime > sf::seconds(1.f))
 			mPlayerInvitationTime = sf::Time::Zero;
 
-		// Events occurring in the game
+		// Events occurring in the game; the relay doesn't listen, spectators keep them to themselves.
+		// Polled either way, so a spectator's queue doesn't grow all match
 		GameActions::Action gameAction;
 		while (mWorld.pollGameAction(gameAction))
 		{
+			if (mSpectator)
+				continue;
+
 			sf::Packet packet;
 			packet << static_cast<sf::Int32>(Client::GameEvent);
 			packet << static_cast<sf::Int32>(gameAction.type);
 			packet << gameAction.position.x;
 			packet << gameAction.position.y;
 
-			mSocket.send(packet);
+			mOutbox.send(packet);
 		}
 
-		// Regular position updates
-		if (mTickClock.getElapsedTime() > sf::seconds(1.f / 20.f))
+		// Regular position updates, at the rate the link currently allows; none while older packets still wait
+		bool outboxEmpty = mOutbox.flush();
+		if (mTickClock.getElapsedTime() > mPositionRate.getInterval() && !mSpectator && outboxEmpty)
 		{
+			// Count only the characters still alive, the server checks the count against the packet size
+			std::vector<sf::Int32> simulatedIdentifiers(mLocalPlayerIdentifiers);
+			simulatedIdentifiers.insert(simulatedIdentifiers.end(), mBotIdentifiers.begin(), mBotIdentifiers.end());
+
+			sf::Int32 numCharacters = 0;
+			FOREACH(sf::Int32 identifier, simulatedIdentifiers)
+			{
+				if (mWorld.getCharacter(identifier))
+					++numCharacters;
+			}
+
 			sf::Packet positionUpdatePacket;
 			positionUpdatePacket << static_cast<sf::Int32>(Client::PositionUpdate);
-			positionUpdatePacket << static_cast<sf::Int32>(mLocalPlayerIdentifiers.size());
+			positionUpdatePacket << numCharacters;
 
-			FOREACH(sf::Int32 identifier, mLocalPlayerIdentifiers)
+			FOREACH(sf::Int32 identifier, simulatedIdentifiers)
 			{
 				if (Character* character = mWorld.getCharacter(identifier)) {
 					positionUpdatePacket << identifier << character->getPosition().x << character->getPosition().y << static_cast<sf::Int32>(character->getHitpoints()) << static_cast<sf::Int32>(character->getMissileAmmo()) << static_cast<float>(character->getKnockback()) << static_cast<sf::Int32>(character->getSurvivability());
@@ -238,10 +311,21 @@ bool MultiplayerGameState::update(sf::Time dt)
 				}
 			}
 			
-			mSocket.send(positionUpdatePacket);
+			// A full socket buffer means we send faster than the link drains; the next update replaces a dropped one
+			sf::Socket::Status status = mOutbox.send(positionUpdatePacket, true);
+			if (status == sf::Socket::Partial || status == sf::Socket::NotReady)
+				mPositionRate.addBackpressure();
+
 			mTickClock.restart();
 		}
 
+		if (mRateReportClock.getElapsedTime() >= RateReportInterval && !mSpectator)
+		{
+			std::cout << "Client: position updates at " << mPositionRate.getRate() << " Hz, RTT "
+				<< mPositionRate.getRoundTripTime().asMilliseconds() << " ms" << std::endl;
+			mRateReportClock.restart();
+		}
+
 		mTimeSinceLastPacket += dt;
 	}
 
@@ -342,12 +426,16 @@ void MultiplayerGameState::handlePacket(sf::Int32 packetType, sf::Packet& packet
 		sf::Vector2f characterPosition;
 		packet >> characterIdentifier >> characterPosition.x >> characterPosition.y;
 
-		Character* character = mWorld.addCharacter(characterIdentifier, characterPosition.x, characterPosition.y);
+		mWorld.addCharacter(characterIdentifier, characterPosition.x, characterPosition.y);
 
-		mPlayers[characterIdentifier].reset(new Player(&mSocket, characterIdentifier, getContext().keys1));
+		mPlayers[characterIdentifier].reset(new Player(&mOutbox, characterIdentifier, getContext().keys1));
 		mLocalPlayerIdentifiers.push_back(characterIdentifier);
+		mSimulatedIdentifiers.insert(characterIdentifier);
 
 		mGameStarted = true;
+
+		if (mConnectionPhase == Handshaking)
+			setConnectionPhase(DownloadingWorld);
 	} break;
 
 	// 
@@ -357,9 +445,13 @@ void MultiplayerGameState::handlePacket(sf::Int32 packetType, sf::Packet& packet
 		sf::Vector2f characterPosition;
 		packet >> characterIdentifier >> characterPosition.x >> characterPosition.y;
 
+		// A RoundReset during the joiner's handshake already placed its character
+		if (mWorld.getCharacter(characterIdentifier))
+			break;
+
 		Character* character = mWorld.addCharacter(characterIdentifier);
 
-		mPlayers[characterIdentifier].reset(new Player(&mSocket, characterIdentifier, nullptr));
+		mPlayers[characterIdentifier].reset(new Player(&mOutbox, characterIdentifier, nullptr));
 	} break;
 
 	// 
@@ -370,25 +462,157 @@ void MultiplayerGameState::handlePacket(sf::Int32 packetType, sf::Packet& packet
 
 		mWorld.removeCharacter(characterIdentifier);
 		mPlayers.erase(characterIdentifier);
+		mBotIdentifiers.erase(std::remove(mBotIdentifiers.begin(), mBotIdentifiers.end(), characterIdentifier), mBotIdentifiers.end());
+		if (std::find(mLocalPlayerIdentifiers.begin(), mLocalPlayerIdentifiers.end(), characterIdentifier) == mLocalPlayerIdentifiers.end())
+			mSimulatedIdentifiers.erase(characterIdentifier);
+	} break;
+
+	// Answered right away, the server measures the round trip and tells us the result with the next Ping
+	case Server::Ping:
+	{
+		sf::Int32 serverTime;
+		sf::Int32 lastRoundTrip;
+		packet >> serverTime >> lastRoundTrip;
+
+		if (lastRoundTrip >= 0)
+			mPositionRate.addRoundTrip(sf::milliseconds(lastRoundTrip));
+
+		sf::Packet pong;
+		pong << static_cast<sf::Int32>(Client::Pong) << serverTime;
+		mOutbox.send(pong);
+	} break;
+
+	// The server's inputs drive the bot like any remote player, but this client's simulation is the authority
+	case Server::AssignBot:
+	{
+		sf::Int32 characterIdentifier;
+		packet >> characterIdentifier;
+
+		if (std::find(mBotIdentifiers.begin(), mBotIdentifiers.end(), characterIdentifier) == mBotIdentifiers.end())
+			mBotIdentifiers.push_back(characterIdentifier);
+		mSimulatedIdentifiers.insert(characterIdentifier);
 	} break;
 
 	// 
 	case Server::InitialState:
 	{
+		sf::Int32 snapshotVersion;
+		packet >> snapshotVersion;
+		if (snapshotVersion != WorldSnapshot::Version)
+		{
+			setConnectionPhase(Failed);
+			mFailedConnectionText.setString("Server runs an incompatible version!");
+			centerOrigin(mFailedConnectionText);
+			break;
+		}
+
 		sf::Int32 characterCount;
 		packet >> characterCount;
 		for (sf::Int32 i = 0; i < characterCount; ++i)
 		{
 			sf::Int32 characterIdentifier;
 			sf::Vector2f characterPosition;
-			packet >> characterIdentifier >> characterPosition.x >> characterPosition.y;
+			sf::Int32 characterHitpoints;
+			sf::Int32 missileAmmo;
+			float characterKnockback;
+			sf::Int32 characterSurvivability;
+			packet >> characterIdentifier >> characterPosition.x >> characterPosition.y >> characterHitpoints >> missileAmmo >> characterKnockback >> characterSurvivability;
 
 			Character* character = mWorld.addCharacter(characterIdentifier, characterPosition.x, characterPosition.y);
+			character->setHitpoints(characterHitpoints);
+			character->setMissileAmmo(missileAmmo);
+			character->setKnockback(characterKnockback);
+			character->setSurvivability(characterSurvivability);
+
+			mPlayers[characterIdentifier].reset(new Player(&mOutbox, characterIdentifier, nullptr));
+		}
+
+		// Projectiles, pickups etc. follow as WorldSnapshotChunk packets when the match is already running
+		bool snapshotFollows;
+		packet >> snapshotFollows;
+		if (mConnectionPhase == DownloadingWorld && !snapshotFollows)
+			setConnectionPhase(Ready);
+	} break;
+
+	// Another client joined and needs our view of the world
+	case Server::RequestWorldSnapshot:
+	{
+		std::vector<sf::Packet> chunks;
+		mWorld.writeSnapshot(chunks, WorldSnapshot::EntriesPerChunk);
+
+		FOREACH(sf::Packet& chunk, chunks)
+			mOutbox.send(chunk);
+	} break;
+
+	// The server started the next round: back to the world before anyone joined, then every character (bots
+	// included) at its new spawn, and a new pickup timeline starting now
+	case Server::RoundReset:
+	{
+		sf::Uint32 seed;
+		sf::Int32 meanInterval, characterCount;
+		packet >> seed >> meanInterval >> characterCount;
+		if (!packet || meanInterval <= 0)
+			break;
+
+		mWorld.resetRound(mMatchStart, seed);
+		mPlayers.clear();
+
+		for (sf::Int32 i = 0; i < characterCount; ++i)
+		{
+			sf::Int32 characterIdentifier;
+			sf::Vector2f characterPosition;
+			packet >> characterIdentifier >> characterPosition.x >> characterPosition.y;
+			if (!packet)
+				break;
+
+			mWorld.addCharacter(characterIdentifier, characterPosition.x, characterPosition.y);
 
-			mPlayers[characterIdentifier].reset(new Player(&mSocket, characterIdentifier, nullptr));
+			bool isLocal = std::find(mLocalPlayerIdentifiers.begin(), mLocalPlayerIdentifiers.end(), characterIdentifier) != mLocalPlayerIdentifiers.end();
+			mPlayers[characterIdentifier].reset(new Player(&mOutbox, characterIdentifier, isLocal ? getContext().keys1 : nullptr));
+		}
+
+		sf::Time interval = sf::milliseconds(meanInterval);
+		mWorld.setPickupSchedule(seed, interval, 0, PickupSpawner::gapAfter(seed, 0, interval));
+		mReportedPickupIndex = 0;
+
+		if (mRematchPending)
+		{
+			std::cout << "Rematch: playable after " << mRematchClock.getElapsedTime().asMilliseconds() << " ms" << std::endl;
+			mRematchPending = false;
 		}
 	} break;
 
+	// Seed and timeline of the pickup spawns, every client generates the same pickups from it
+	case Server::PickupSchedule:
+	{
+		sf::Uint32 seed, nextIndex;
+		sf::Int32 meanInterval, untilNext;
+		packet >> seed >> meanInterval >> nextIndex >> untilNext;
+
+		// A mean below a millisecond would divide by zero in PickupSpawner::gapAfter()
+		if (!packet || meanInterval <= 0)
+			break;
+
+		mWorld.setPickupSchedule(seed, sf::milliseconds(meanInterval), nextIndex, sf::milliseconds(untilNext));
+		mReportedPickupIndex = mWorld.getPickupSpawner().getNextIndex();
+	} break;
+
+	// Part of the world snapshot we are joining with
+	case Server::WorldSnapshotChunk:
+	{
+		sf::Int32 snapshotVersion, chunkIndex, chunkCount;
+		packet >> snapshotVersion >> chunkIndex >> chunkCount;
+
+		if (mConnectionPhase != DownloadingWorld)
+			break;
+
+		if (snapshotVersion == WorldSnapshot::Version)
+			mWorld.applySnapshotChunk(packet);
+
+		if (chunkIndex + 1 >= chunkCount)
+			setConnectionPhase(Ready);
+	} break;
+
 	// Player event (like missile fired) occurs
 	case Server::PlayerEvent:
 	{
@@ -437,8 +661,9 @@ void MultiplayerGameState::handlePacket(sf::Int32 packetType, sf::Packet& packet
 			//std::cout << "Update Client from server:" << characterIdentifier << " x: " << characterPosition.x << "  y: " << characterPosition.y << " hp: " << characterHitpoints << " m: " << missileAmmo << " k: " << characterKnockback << characterSurvivability << std::endl;
 
 			Character* character = mWorld.getCharacter(characterIdentifier);
-			bool isLocalPlane = std::find(mLocalPlayerIdentifiers.begin(), mLocalPlayerIdentifiers.end(), characterIdentifier) != mLocalPlayerIdentifiers.end();
-			if (character && !isLocalPlane)
+			// Our own planes and the bots we simulate are ahead of the server's view of them
+			bool isSimulatedHere = mSimulatedIdentifiers.count(characterIdentifier) != 0;
+			if (character && !isSimulatedHere)
 			{
 				sf::Vector2f interpolatedPosition = character->getPosition() + (characterPosition - character->getPosition()) * 0.1f;
 				character->setPosition(characterPosition.x, characterPosition.y);
@@ -451,3 +676,206 @@ void MultiplayerGameState::handlePacket(sf::Int32 packetType, sf::Packet& packet
 	} break;
 	}
 }
+
+void MultiplayerGameState::requestRematch()
+{
+	// Same connection, same World: the server resets the round for everyone (RoundReset), also when another
+	// player asked first
+	mRoundOver = false;
+	if (mSpectator)
+		return;
+
+	sf::Packet packet;
+	packet << static_cast<sf::Int32>(Client::Rematch);
+	mOutbox.send(packet);
+
+	mRematchPending = true;
+	mRematchClock.restart();
+}
+
+void MultiplayerGameState::updateConnection()
+{
+	const sf::Time joinTimeout = sf::seconds(5.f);
+	const sf::Time connectRetryInterval = sf::seconds(0.5f);
+
+	if (mJoinClock.getElapsedTime() >= joinTimeout)
+	{
+		setConnectionPhase(Failed);
+		return;
+	}
+
+	if (mConnectionPhase == Matchmaking)
+	{
+		updateMatchmaking();
+		return;
+	}
+
+	if (mConnectionPhase == Connecting)
+	{
+		// A non-blocking connect finishes in the background; the peer address is only known once it succeeded
+		if (mSocket.getRemoteAddress() != sf::IpAddress::None)
+		{
+			setConnectionPhase(Handshaking);
+		}
+
+		// connect() aborts an attempt still in progress, so a new one only starts once the last one failed
+		// (e.g. refused because our own server thread isn't listening yet)
+		else if (mConnectAttemptClock.getElapsedTime() >= connectRetryInterval && hasConnectAttemptFailed())
+		{
+			startConnectAttempt();
+		}
+
+		return;
+	}
+
+	// Handshake and world download: drain everything the server sent this frame
+	sf::Packet packet;
+	while (mConnectionPhase != Ready && mSocket.receive(packet) == sf::Socket::Done)
+	{
+		sf::Int32 packetType;
+		packet >> packetType;
+		handlePacket(packetType, packet);
+		packet.clear();
+	}
+
+	mTimeSinceLastPacket = sf::Time::Zero;
+}
+
+void MultiplayerGameState::updateMatchmaking()
+{
+	const sf::Time gatewayTimeout = sf::seconds(1.f);
+
+	// Nobody answers on the gateway port: ip.txt names a game server, join it directly
+	if (mGatewaySocket.getRemoteAddress() == sf::IpAddress::None)
+	{
+		if (mConnectAttemptClock.getElapsedTime() >= gatewayTimeout)
+		{
+			mGatewaySocket.disconnect();
+			connectToServer();
+		}
+		return;
+	}
+
+	if (!mMatchRequested)
+	{
+		sf::Packet packet;
+		packet << static_cast<sf::Int32>(Gateway::RequestMatch);
+		mGatewaySocket.send(packet);
+		mMatchRequested = true;
+	}
+
+	sf::Packet packet;
+	if (mGatewaySocket.receive(packet) != sf::Socket::Done)
+		return;
+
+	sf::Int32 packetType;
+	packet >> packetType;
+
+	if (packetType == Gateway::MatchAssignment)
+	{
+		sf::Uint32 matchId;
+		std::string address;
+		sf::Uint16 port;
+		packet >> matchId >> address >> port;
+
+		std::cout << "Matchmaking: assigned to match " << matchId << " at " << address << ":" << port << std::endl;
+		mServerAddress = address;
+		mServerPort = port;
+		mGatewaySocket.disconnect();
+		connectToServer();
+	}
+	else if (packetType == Gateway::NoMatchAvailable)
+	{
+		mGatewaySocket.disconnect();
+		setConnectionPhase(Failed);
+		mFailedConnectionText.setString("No match available, try again later");
+		centerOrigin(mFailedConnectionText);
+	}
+}
+
+void MultiplayerGameState::connectToServer()
+{
+	setConnectionPhase(Connecting);
+	startConnectAttempt();
+}
+
+void MultiplayerGameState::startConnectAttempt()
+{
+	mConnectAttemptClock.restart();
+
+	// NotReady: in progress, updateConnection() polls for the result; anything else is already final
+	sf::Socket::Status status = mSocket.connect(mServerAddress, mServerPort);
+	mConnectPending = (status == sf::Socket::NotReady);
+
+	if (status == sf::Socket::Done)
+		setConnectionPhase(Handshaking);
+}
+
+bool MultiplayerGameState::hasConnectAttemptFailed()
+{
+	if (!mConnectPending || mConnectAttemptClock.getElapsedTime() >= ConnectAttemptTimeout)
+		return true;
+
+	// A refused attempt leaves its error pending on the socket, which makes it readable while still unconnected
+	sf::SocketSelector selector;
+	selector.add(mSocket);
+	return selector.wait(sf::microseconds(1)) && selector.isReady(mSocket) && mSocket.getRemoteAddress() == sf::IpAddress::None;
+}
+
+void MultiplayerGameState::setConnectionPhase(ConnectionPhase phase)
+{
+	// Spectators get no character (SpawnSelf), the relay sends the world right away
+	if (phase == Handshaking && mSpectator)
+		phase = DownloadingWorld;
+
+	mConnectionPhase = phase;
+	mPhaseStartTimes[phase] = mJoinClock.getElapsedTime();
+
+	switch (phase)
+	{
+	case Matchmaking:
+		mFailedConnectionText.setString("Finding a match...");
+		break;
+
+	case Connecting:
+		mFailedConnectionText.setString("Attempting to connect...");
+		break;
+
+	case Handshaking:
+		mFailedConnectionText.setString("Joining match...");
+		break;
+
+	case DownloadingWorld:
+		mFailedConnectionText.setString("Downloading world...");
+		break;
+
+	case Failed:
+		mFailedConnectionText.setString("Could not connect to the remote server!");
+		mFailedConnectionClock.restart();
+		break;
+
+	default:
+		break;
+	}
+
+	centerOrigin(mFailedConnectionText);
+	mFailedConnectionText.setPosition(mWindow.getSize().x / 2.f, mWindow.getSize().y / 2.f);
+}
+
+void MultiplayerGameState::reportJoinTimes()
+{
+	// Called on the first rendered match frame, so "total" is the time-to-first-frame
+	sf::Time matchmaking = mPhaseStartTimes[Connecting] - mPhaseStartTimes[Matchmaking];
+	sf::Time connect = mPhaseStartTimes[Handshaking] - mPhaseStartTimes[Connecting];
+	sf::Time handshake = mPhaseStartTimes[DownloadingWorld] - mPhaseStartTimes[Handshaking];
+	sf::Time download = mPhaseStartTimes[Ready] - mPhaseStartTimes[DownloadingWorld];
+	sf::Time total = mJoinClock.getElapsedTime();
+
+	std::cout << "Join times (ms): matchmaking " << matchmaking.asMilliseconds()
+		<< ", connect " << connect.asMilliseconds()
+		<< ", handshake " << handshake.asMilliseconds()
+		<< ", world " << download.asMilliseconds()
+		<< ", first frame " << total.asMilliseconds() << std::endl;
+
+	mJoinTimesReported = true;
+}
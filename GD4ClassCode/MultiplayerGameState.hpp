@@ -5,17 +5,27 @@
 #include "Player.hpp"
 #include "GameServer.hpp"
 #include "NetworkProtocol.hpp"
+#include "SendRate.hpp"
+#include "PacketOutbox.hpp"
 
 #include <SFML/System/Clock.hpp>
 #include <SFML/Graphics/Text.hpp>
 #include <SFML/Network/TcpSocket.hpp>
 #include <SFML/Network/Packet.hpp>
+#include <SFML/Network/IpAddress.hpp>
 
+#include <array>
+#include <unordered_set>
+
+
+// Server (or LobbyGateway) address from ip.txt, the file is created with the local address if missing
+sf::IpAddress getAddressFromFile();
 
 class MultiplayerGameState : public State
 {
 public:
-	MultiplayerGameState(StateStack& stack, Context context, bool isHost);
+	// A spectator watches through the SpectatorRelay at the ip.txt address, without a character of its own
+	MultiplayerGameState(StateStack& stack, Context context, bool isHost, bool isSpectator = false);
 
 	virtual void				draw();
 	virtual bool				update(sf::Time dt);
@@ -26,10 +36,33 @@ public:
 	void						disableAllRealtimeActions();
 
 
+private:
+	// Steps a client goes through before the match can be played, driven from update() without blocking
+	enum ConnectionPhase
+	{
+		Matchmaking,		// asking the LobbyGateway which server to join; skipped by the host
+		Connecting,			// TCP connect in progress
+		Handshaking,		// waiting for the server to assign our character (SpawnSelf)
+		DownloadingWorld,	// waiting for the characters already in the match (InitialState)
+		Ready,
+		Failed,
+		PhaseCount
+	};
+
+
 private:
 	void						updateBroadcastMessage(sf::Time elapsedTime);
 	void						handlePacket(sf::Int32 packetType, sf::Packet& packet);
 
+	void						updateConnection();
+	void						updateMatchmaking();
+	void						connectToServer();
+	void						startConnectAttempt();
+	bool						hasConnectAttemptFailed();
+	void						setConnectionPhase(ConnectionPhase phase);
+	void						reportJoinTimes();
+	void						requestRematch();
+
 
 private:
 	typedef std::unique_ptr<Player> PlayerPtr;
@@ -37,15 +70,31 @@ private:
 
 private:
 	World						mWorld;
+	World::Snapshot				mMatchStart;			// before any character joined, every RoundReset starts from it
 	sf::RenderWindow&			mWindow;
 	TextureHolder&				mTextureHolder;
 
 	std::map<int, PlayerPtr>	mPlayers;
 	std::vector<sf::Int32>		mLocalPlayerIdentifiers;
+	std::vector<sf::Int32>		mBotIdentifiers;			// server bots this client simulates and reports
+	std::unordered_set<sf::Int32> mSimulatedIdentifiers;	// both of the above, looked up per character update
+	sf::Uint32					mReportedPickupIndex;
 	sf::TcpSocket				mSocket;
-	bool						mConnected;
+	PacketOutbox				mOutbox;				// every send to the server goes through here
+	sf::IpAddress				mServerAddress;
+	unsigned short				mServerPort;
+	sf::TcpSocket				mGatewaySocket;
+	bool						mMatchRequested;
+	ConnectionPhase				mConnectionPhase;
+	sf::Clock					mJoinClock;
+	sf::Clock					mConnectAttemptClock;
+	bool						mConnectPending;		// the last connect() is still in progress
+	std::array<sf::Time, PhaseCount> mPhaseStartTimes;
+	bool						mJoinTimesReported;
 	std::unique_ptr<GameServer> mGameServer;
 	sf::Clock					mTickClock;
+	SendRate					mPositionRate;			// fed the round trips the server measures with Ping
+	sf::Clock					mRateReportClock;
 
 	std::vector<std::string>	mBroadcasts;
 	sf::Text					mBroadcastText;
@@ -60,7 +109,11 @@ private:
 	bool						mActiveState;
 	bool						mHasFocus;
 	bool						mHost;
+	bool						mSpectator;
 	bool						mGameStarted;
+	bool						mRoundOver;				// results screen pushed, a rematch is asked for once we update again
+	bool						mRematchPending;
+	sf::Clock					mRematchClock;
 	sf::Time					mClientTimeout;
 	sf::Time					mTimeSinceLastPacket;
 };
@@ -5,6 +5,7 @@
 NetworkNode::NetworkNode()
 	: SceneNode()
 	, mPendingActions()
+	, mMuted(false)
 {
 }
 
@@ -15,7 +16,13 @@ unsigned int NetworkNode::getCategory() const
 
 void NetworkNode::notifyGameAction(GameActions::Type type, sf::Vector2f position)
 {
-	mPendingActions.push(GameActions::Action(type, position));
+	if (!mMuted)
+		mPendingActions.push(GameActions::Action(type, position));
+}
+
+void NetworkNode::setMuted(bool flag)
+{
+	mMuted = flag;
 }
 
 bool NetworkNode::pollGameAction(GameActions::Action& out)
@@ -13,10 +13,12 @@ public:
 
 	void					notifyGameAction(GameActions::Type type, sf::Vector2f position);
 	bool					pollGameAction(GameActions::Action& out);
+	void					setMuted(bool flag);
 
 	virtual unsigned int	getCategory() const;
 
 
 private:
 	std::queue<GameActions::Action>	mPendingActions;
+	bool							mMuted;
 };
\ No newline at end of file
@@ -5,6 +5,25 @@
 
 
 const unsigned short ServerPort = 5000;
+const unsigned short GatewayPort = 5100;
+const unsigned short SpectatorRelayPort = 5200;
+
+// A GameServer on port p takes read-only subscribers (SpectatorRelay) on p + SubscriberPortOffset
+const unsigned short SubscriberPortOffset = 1000;
+
+// Layout of the join-in-progress world snapshot; bump the version whenever an entry's fields change
+namespace WorldSnapshot
+{
+	const sf::Int32 Version = 1;
+	const unsigned int EntriesPerChunk = 32;
+
+	enum EntryType
+	{
+		CharacterEntry,		// [Int32:id] [float:x,y,vx,vy] [Int32:hitpoints,missiles] [float:knockback] [Int32:survivability] [bool:grounded]
+		ProjectileEntry,	// [Int32:type,owner] [float:x,y,vx,vy,rotation]
+		PickupEntry,		// [Int32:type] [float:x,y,vx,vy] [bool:grounded]
+	};
+}
 
 namespace Server
 {
@@ -13,7 +32,7 @@ namespace Server
 	{
 		BroadcastMessage,	// format: [Int32:packetType] [string:message]
 		SpawnSelf,			// format: [Int32:packetType]
-		InitialState,
+		InitialState,		// format: [Int32:packetType] [Int32:snapshotVersion] [Int32:count] {[Int32:id] [float:x,y] [Int32:hp,missiles] [float:knockback] [Int32:survivability]} [bool:snapshotFollows]
 		PlayerEvent,
 		PlayerRealtimeChange,
 		PlayerConnect,
@@ -22,7 +41,16 @@ namespace Server
 		SpawnEnemy,
 		SpawnPickup,
 		UpdateClientState,
-		MissionSuccess
+		MissionSuccess,
+		RequestWorldSnapshot,	// format: [Int32:packetType]
+		WorldSnapshotChunk,		// format: [Int32:packetType] [Int32:version] [Int32:index] [Int32:count] [Int32:entries] {entry}
+		PickupSchedule,			// format: [Int32:packetType] [Uint32:seed] [Int32:meanIntervalMs] [Uint32:nextIndex] [Int32:untilNextMs]
+		LockstepStart,			// format: [Int32:packetType] [Uint32:seed] [Int32:count] {[Int32:id]}
+		LockstepInput,			// format: [Int32:packetType] [Int32:id] [Uint32:tick] [Uint8:actionMask]
+		Heartbeat,				// format: [Int32:packetType], sent to peers that got nothing else for a while
+		AssignBot,				// format: [Int32:packetType] [Int32:id], the receiver simulates this bot and reports it in PositionUpdate
+		Ping,					// format: [Int32:packetType] [Int32:serverTimeMs] [Int32:lastRoundTripMs], -1 before the first Pong
+		RoundReset				// format: [Int32:packetType] [Uint32:pickupSeed] [Int32:meanIntervalMs] [Int32:count] {[Int32:id] [float:x,y]}, every character starts over
 	};
 }
 
@@ -36,7 +64,28 @@ namespace Client
 		RequestCoopPartner,
 		PositionUpdate,
 		GameEvent,
-		Quit
+		Quit,
+		WorldSnapshotChunk,		// same layout as Server::WorldSnapshotChunk
+		PickupSpawned,			// format: [Int32:packetType] [Uint32:index] [Int32:type] [float:x], checked by the server against its schedule
+		LockstepStart,			// format: [Int32:packetType], host asks the server to start the match
+		LockstepInput,			// format: [Int32:packetType] [Uint32:tick] [Uint8:actionMask]
+		LockstepChecksum,		// format: [Int32:packetType] [Uint32:tick] [Uint32:checksum]
+		Pong,					// format: [Int32:packetType] [Int32:serverTimeMs], echoes Server::Ping
+		Rematch,				// format: [Int32:packetType], start the next round (answered with RoundReset to everyone)
+		PacketTypeCount
+	};
+}
+
+namespace Gateway
+{
+	// Packets exchanged with the LobbyGateway, by game servers and by clients looking for a match
+	enum PacketType
+	{
+		RegisterServer,			// format: [Int32:packetType] [Uint16:port] [Int32:capacity], server -> gateway
+		ServerLoad,				// format: [Int32:packetType] [Int32:players] [Int32:capacity] [float:load], server -> gateway, every second
+		RequestMatch,			// format: [Int32:packetType], client -> gateway
+		MatchAssignment,		// format: [Int32:packetType] [Uint32:matchId] [string:address] [Uint16:port], gateway -> client
+		NoMatchAvailable		// format: [Int32:packetType], gateway -> client
 	};
 }
 
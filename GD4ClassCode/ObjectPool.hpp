@@ -0,0 +1,60 @@
+#pragma once
+
+#include <SFML/System/NonCopyable.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+
+// Fixed-size slots for one class, handed out through the class's own operator new/delete, so the scene graph
+// keeps owning nodes with plain unique_ptrs. A freed slot goes onto an intrusive free list and the next object
+// of that type is constructed in place in it; chunks are only released at exit. Game thread only
+template <typename T>
+class ObjectPool : private sf::NonCopyable
+{
+public:
+	static const std::size_t				SlotsPerChunk = 64;
+
+	struct Statistics
+	{
+		std::size_t							live;
+		std::size_t							highWaterMark;
+		std::size_t							capacity;
+		std::size_t							allocations;
+		std::size_t							recycled;		// allocations served from the free list
+	};
+
+
+public:
+	static ObjectPool&						instance();
+
+	// Sizes other than sizeof(T) (a derived class without its own pool) go to the global heap
+	void*									allocate(std::size_t size);
+	void									deallocate(void* pointer, std::size_t size);
+
+	const Statistics&						getStatistics() const;
+	void									printStatistics(const std::string& name) const;
+
+
+private:
+											ObjectPool();
+
+	void									grow();
+
+
+private:
+	union Slot
+	{
+		Slot*								next;
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+	};
+
+	std::vector<std::unique_ptr<Slot[]>>	mChunks;
+	Slot*									mFreeList;
+	Statistics								mStatistics;
+};
+
+#include "ObjectPool.inl"
@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <iostream>
+#include <new>
+
+
+template <typename T>
+ObjectPool<T>& ObjectPool<T>::instance()
+{
+	static ObjectPool pool;
+	return pool;
+}
+
+template <typename T>
+ObjectPool<T>::ObjectPool()
+: mChunks()
+, mFreeList(nullptr)
+, mStatistics()
+{
+}
+
+template <typename T>
+void* ObjectPool<T>::allocate(std::size_t size)
+{
+	if (size != sizeof(T))
+		return ::operator new(size);
+
+	if (mFreeList)
+		++mStatistics.recycled;
+	else
+		grow();
+
+	Slot* slot = mFreeList;
+	mFreeList = slot->next;
+
+	++mStatistics.allocations;
+	++mStatistics.live;
+	mStatistics.highWaterMark = std::max(mStatistics.highWaterMark, mStatistics.live);
+
+	return slot;
+}
+
+template <typename T>
+void ObjectPool<T>::deallocate(void* pointer, std::size_t size)
+{
+	if (!pointer)
+		return;
+
+	if (size != sizeof(T))
+	{
+		::operator delete(pointer);
+		return;
+	}
+
+	// Most recently freed slot is reused first, it's the one most likely still in cache
+	Slot* slot = static_cast<Slot*>(pointer);
+	slot->next = mFreeList;
+	mFreeList = slot;
+
+	--mStatistics.live;
+}
+
+template <typename T>
+const typename ObjectPool<T>::Statistics& ObjectPool<T>::getStatistics() const
+{
+	return mStatistics;
+}
+
+template <typename T>
+void ObjectPool<T>::printStatistics(const std::string& name) const
+{
+	std::size_t recycledPercent = mStatistics.allocations > 0 ? mStatistics.recycled * 100 / mStatistics.allocations : 0;
+
+	std::cout << "Pool " << name << ": peak " << mStatistics.highWaterMark << " live of " << mStatistics.capacity
+		<< " slots, " << mStatistics.allocations << " allocations, " << recycledPercent << "% recycled" << std::endl;
+}
+
+template <typename T>
+void ObjectPool<T>::grow()
+{
+	std::unique_ptr<Slot[]> chunk(new Slot[SlotsPerChunk]);
+
+	// Thread the new slots onto the free list in address order
+	for (std::size_t i = 0; i + 1 < SlotsPerChunk; ++i)
+		chunk[i].next = &chunk[i + 1];
+	chunk[SlotsPerChunk - 1].next = mFreeList;
+
+	mFreeList = &chunk[0];
+	mStatistics.capacity += SlotsPerChunk;
+	mChunks.push_back(std::move(chunk));
+}
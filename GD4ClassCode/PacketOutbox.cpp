@@ -0,0 +1,63 @@
+#include "PacketOutbox.hpp"
+
+
+PacketOutbox::PacketOutbox(sf::TcpSocket& socket)
+	: mSocket(socket)
+	, mQueue()
+{
+}
+
+sf::Socket::Status PacketOutbox::send(const sf::Packet& packet, bool droppable)
+{
+	// Whatever waits goes out first
+	if (!flush())
+	{
+		if (!droppable)
+			mQueue.push_back(packet);
+
+		return sf::Socket::NotReady;
+	}
+
+	// Sent from the queued copy: a partial send advances the packet's send position
+	mQueue.push_back(packet);
+	sf::Socket::Status status = mSocket.send(mQueue.back());
+
+	// NotReady wrote nothing, so a droppable packet can go without breaking the stream
+	if (status != sf::Socket::Partial && (status != sf::Socket::NotReady || droppable))
+		mQueue.pop_back();
+
+	return status;
+}
+
+bool PacketOutbox::flush()
+{
+	while (!mQueue.empty())
+	{
+		sf::Socket::Status status = mSocket.send(mQueue.front());
+		if (status == sf::Socket::Partial || status == sf::Socket::NotReady)
+			return false;
+
+		// Otherwise written, or the connection is gone and nothing queued can be delivered anymore
+		if (status == sf::Socket::Done)
+			mQueue.pop_front();
+		else
+			mQueue.clear();
+	}
+
+	return true;
+}
+
+bool PacketOutbox::isEmpty() const
+{
+	return mQueue.empty();
+}
+
+std::size_t PacketOutbox::getQueuedCount() const
+{
+	return mQueue.size();
+}
+
+void PacketOutbox::clear()
+{
+	mQueue.clear();
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <SFML/Network/Packet.hpp>
+#include <SFML/Network/TcpSocket.hpp>
+#include <SFML/System/NonCopyable.hpp>
+
+#include <deque>
+
+
+// Outgoing packets of one non-blocking TcpSocket. A packet is a length prefix plus data on a byte stream, so
+// once one was sent partially nothing else may be written until it is finished. Packets sent meanwhile wait
+// behind it in order; droppable ones (state updates, heartbeats, pings) are dropped instead, a newer one follows
+class PacketOutbox : private sf::NonCopyable
+{
+public:
+	explicit					PacketOutbox(sf::TcpSocket& socket);
+
+	// Done once the packet is written completely, Partial when the rest follows with flush(), NotReady when it
+	// was queued or dropped. The packet itself is never modified, so it can be sent to several sockets
+	sf::Socket::Status			send(const sf::Packet& packet, bool droppable = false);
+
+	// Writes as much of the queue as the socket takes; true once it is empty
+	bool						flush();
+
+	bool						isEmpty() const;
+	std::size_t					getQueuedCount() const;
+	void						clear();
+
+
+private:
+	sf::TcpSocket&				mSocket;
+	std::deque<sf::Packet>		mQueue;				// the front packet may be partially sent
+};
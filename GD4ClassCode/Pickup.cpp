@@ -4,6 +4,7 @@
 #include "CommandQueue.hpp"
 #include "Utility.hpp"
 #include "ResourceHolder.hpp"
+#include "ObjectPool.hpp"
 
 #include <SFML/Graphics/RenderTarget.hpp>
 
@@ -13,22 +14,28 @@ namespace
 	const std::vector<PickupData> Table = initializePickupData();
 }
 
-Pickup::Pickup(Type type, const TextureHolder& textures)
-	: Entity(1)
+Pickup::Pickup(Type type, EntityStore& entities, const TextureHolder& textures)
+	: Entity(entities, 1)
 	, mType(type)
 	, mSprite(textures.get(Table[type].texture), Table[type].textureRect)
 {
 	centerOrigin(mSprite);
+	setCollider(mSprite.getGlobalBounds());
 }
 
-unsigned int Pickup::getCategory() const
+void* Pickup::operator new(std::size_t size)
 {
-	return Category::Pickup;
+	return ObjectPool<Pickup>::instance().allocate(size);
+}
+
+void Pickup::operator delete(void* pointer, std::size_t size)
+{
+	ObjectPool<Pickup>::instance().deallocate(pointer, size);
 }
 
-sf::FloatRect Pickup::getBoundingRect() const
+unsigned int Pickup::getCategory() const
 {
-	return getWorldTransform().transformRect(mSprite.getGlobalBounds());
+	return Category::Pickup;
 }
 
 void Pickup::apply(Character& player) const
@@ -36,6 +43,11 @@ void Pickup::apply(Character& player) const
 	Table[mType].action(player);
 }
 
+Pickup::Type Pickup::getType() const
+{
+	return mType;
+}
+
 void Pickup::drawCurrent(sf::RenderTarget& target, sf::RenderStates states) const
 {
 	target.draw(mSprite, states);
@@ -21,12 +21,16 @@ public:
 
 
 public:
-	Pickup(Type type, const TextureHolder& textures);
+	Pickup(Type type, EntityStore& entities, const TextureHolder& textures);
+
+	// Recycled through ObjectPool<Pickup>
+	static void*			operator new(std::size_t size);
+	static void				operator delete(void* pointer, std::size_t size);
 
 	virtual unsigned int	getCategory() const;
-	virtual sf::FloatRect	getBoundingRect() const;
 
 	void 					apply(Character& player) const;
+	Type					getType() const;
 
 protected:
 	virtual void			drawCurrent(sf::RenderTarget& target, sf::RenderStates states) const;
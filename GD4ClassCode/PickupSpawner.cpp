@@ -0,0 +1,100 @@
+#include "PickupSpawner.hpp"
+
+#include <cassert>
+
+
+namespace
+{
+	// Counter-based generator (integer hash), identical on every platform and independent of call order
+	sf::Uint32 hashedRandom(sf::Uint32 seed, sf::Uint32 index, sf::Uint32 stream)
+	{
+		sf::Uint32 h = seed ^ (index * 0x9E3779B9u) ^ (stream * 0x85EBCA6Bu);
+		h ^= h >> 16;
+		h *= 0x7FEB352Du;
+		h ^= h >> 15;
+		h *= 0x846CA68Bu;
+		h ^= h >> 16;
+		return h;
+	}
+}
+
+PickupSpawner::PickupSpawner()
+	: mHasSchedule(false)
+	, mSeed(0)
+	, mMeanInterval(sf::Time::Zero)
+	, mNextIndex(0)
+	, mUntilNext(sf::Time::Zero)
+{
+}
+
+void PickupSpawner::setSchedule(sf::Uint32 seed, sf::Time meanInterval, sf::Uint32 nextIndex, sf::Time untilNext)
+{
+	assert(meanInterval.asMilliseconds() > 0);
+
+	// Resync from the server: never step back, that would spawn an index twice
+	if (mHasSchedule && seed == mSeed && nextIndex < mNextIndex)
+		return;
+
+	mHasSchedule = true;
+	mSeed = seed;
+	mMeanInterval = meanInterval;
+	mNextIndex = nextIndex;
+	mUntilNext = untilNext;
+}
+
+bool PickupSpawner::hasSchedule() const
+{
+	return mHasSchedule;
+}
+
+bool PickupSpawner::update(sf::Time dt, Spawn& out)
+{
+	if (!mHasSchedule)
+		return false;
+
+	mUntilNext -= dt;
+	if (mUntilNext > sf::Time::Zero)
+		return false;
+
+	out = spawnAt(mSeed, mNextIndex);
+	mUntilNext += gapAfter(mSeed, mNextIndex, mMeanInterval);
+	++mNextIndex;
+	return true;
+}
+
+sf::Uint32 PickupSpawner::getSeed() const
+{
+	return mSeed;
+}
+
+sf::Time PickupSpawner::getMeanInterval() const
+{
+	return mMeanInterval;
+}
+
+sf::Uint32 PickupSpawner::getNextIndex() const
+{
+	return mNextIndex;
+}
+
+sf::Time PickupSpawner::getTimeUntilNext() const
+{
+	return mUntilNext;
+}
+
+PickupSpawner::Spawn PickupSpawner::spawnAt(sf::Uint32 seed, sf::Uint32 index)
+{
+	Spawn spawn;
+	spawn.index = index;
+	spawn.type = static_cast<Pickup::Type>(hashedRandom(seed, index, 0) % Pickup::TypeCount);
+	spawn.position = sf::Vector2f(static_cast<float>(hashedRandom(seed, index, 1) % 600 + 200), 10.f);
+	return spawn;
+}
+
+sf::Time PickupSpawner::gapAfter(sf::Uint32 seed, sf::Uint32 index, sf::Time meanInterval)
+{
+	// Uniform in [0.5, 1.5) * mean, in whole milliseconds so every peer accumulates the same value
+	sf::Int32 mean = meanInterval.asMilliseconds();
+	assert(mean > 0);
+	return sf::milliseconds(mean / 2 + static_cast<sf::Int32>(hashedRandom(seed, index, 2) % static_cast<sf::Uint32>(mean)));
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "Pickup.hpp"
+
+#include <SFML/Config.hpp>
+#include <SFML/System/Time.hpp>
+#include <SFML/System/Vector2.hpp>
+
+
+// Deterministic pickup schedule: every spawn is derived from (seed, index) only,
+// so all peers that share the seed produce the same pickups without per-pickup packets
+class PickupSpawner
+{
+public:
+	struct Spawn
+	{
+		sf::Uint32				index;
+		Pickup::Type			type;
+		sf::Vector2f			position;
+	};
+
+
+public:
+							PickupSpawner();
+
+	// meanInterval must be at least a millisecond, callers validate what came from the network or a file
+	void					setSchedule(sf::Uint32 seed, sf::Time meanInterval, sf::Uint32 nextIndex, sf::Time untilNext);
+	bool					hasSchedule() const;
+
+	// Advance the schedule by one frame; returns true and fills out when a spawn is due
+	bool					update(sf::Time dt, Spawn& out);
+
+	sf::Uint32				getSeed() const;
+	sf::Time				getMeanInterval() const;
+	sf::Uint32				getNextIndex() const;
+	sf::Time				getTimeUntilNext() const;
+
+	static Spawn			spawnAt(sf::Uint32 seed, sf::Uint32 index);
+	static sf::Time			gapAfter(sf::Uint32 seed, sf::Uint32 index, sf::Time meanInterval);
+
+
+private:
+	bool					mHasSchedule;
+	sf::Uint32				mSeed;
+	sf::Time				mMeanInterval;
+	sf::Uint32				mNextIndex;
+	sf::Time				mUntilNext;
+};
@@ -12,12 +12,13 @@ namespace
 	const std::vector<PlatformData> Table = initializePlatformData();
 }
 
-Platform::Platform(Type type, const TextureHolder& textures)
-	: Entity(1)
+Platform::Platform(Type type, EntityStore& entities, const TextureHolder& textures)
+	: Entity(entities, 1)
 	, mType(type)
 	, mSprite(textures.get(Table[type].texture))
 {
 	centerOrigin(mSprite);
+	setCollider(mSprite.getGlobalBounds());
 }
 
 unsigned int Platform::getCategory() const
@@ -25,11 +26,6 @@ unsigned int Platform::getCategory() const
 	return Category::Platform;
 }
 
-sf::FloatRect Platform::getBoundingRect() const
-{
-	return getWorldTransform().transformRect(mSprite.getGlobalBounds());
-}
-
 void Platform::drawCurrent(sf::RenderTarget& target, sf::RenderStates states) const
 {
 	target.draw(mSprite, states);
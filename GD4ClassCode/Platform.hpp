@@ -18,9 +18,8 @@ public:
 	Type 					mType;
 
 public:
-	Platform(Type type, const TextureHolder& textures);
+	Platform(Type type, EntityStore& entities, const TextureHolder& textures);
 	virtual unsigned int	getCategory() const;
-	virtual sf::FloatRect	getBoundingRect() const;
 
 protected:
 	virtual void			drawCurrent(sf::RenderTarget& target, sf::RenderStates states) const;
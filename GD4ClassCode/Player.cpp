@@ -12,33 +12,32 @@
 
 using namespace std::placeholders;
 
+// Player commands carry the character identifier as Command::target, World hands them to that character only
 struct CharacterMover
 {
-	CharacterMover(float vx, float vy, int identifier)
-		: velocity(vx, vy), characterID(identifier)
+	CharacterMover(float vx, float vy)
+		: velocity(vx, vy)
 	{
 	}
 
 	void operator() (Character& character, sf::Time) const
 	{
-		if (character.getIdentifier() == characterID)
-			character.accelerate(velocity * character.getMaxSpeed());
+		character.accelerate(velocity * character.getMaxSpeed());
 	}
 
 	sf::Vector2f velocity;
-	int characterID;
 };
 
 struct CharacterJumpTrigger
 {
-	CharacterJumpTrigger(float vx, float vy, int identifier)
-		: velocity(vx, vy), characterID(identifier)
+	CharacterJumpTrigger(float vx, float vy)
+		: velocity(vx, vy)
 	{
 	}
 
 	void operator() (Character& character, sf::Time) const
 	{
-		if (character.getIdentifier() == characterID && character.mIsGrounded)
+		if (character.mIsGrounded)
 		{
 			character.accelerate(velocity.x, velocity.y);
 			character.mIsGrounded = false;
@@ -46,53 +45,40 @@ struct CharacterJumpTrigger
 	}
 
 	sf::Vector2f velocity;
-	int characterID;
 };
 
 struct CharacterFireTrigger
 {
-	CharacterFireTrigger(int identifier)
-		: characterID(identifier)
-	{
-	}
-
 	void operator() (Character& character, sf::Time) const
 	{
-		if (character.getIdentifier() == characterID)
-			character.fire();
+		character.fire();
 	}
-
-	int characterID;
 };
 
 struct CharacterMissileTrigger
 {
-	CharacterMissileTrigger(int identifier)
-		: characterID(identifier)
-	{
-	}
-
 	void operator() (Character& character, sf::Time) const
 	{
-		if (character.getIdentifier() == characterID)
-			character.launchMissile();
+		character.launchMissile();
 	}
-
-	int characterID;
 };
 
-Player::Player(sf::TcpSocket* socket, sf::Int32 identifier, const KeyBinding* binding)
+Player::Player(PacketOutbox* outbox, sf::Int32 identifier, const KeyBinding* binding)
 	: mKeyBinding(binding)
 	, mCurrentMissionStatus(MissionRunning)
 	, mIdentifier(identifier)
-	, mSocket(socket)
+	, mOutbox(outbox)
+	, mBufferedEvents(0)
 {
 	// Set initial action bindings
 	initializeActions();
 
 	// Assign all categories to player's character
 	FOREACH(auto& pair, mActionBinding)
+	{
 		pair.second.category = Category::PlayerCharacter;
+		pair.second.target = mIdentifier;
+	}
 }
 
 void Player::handleEvent(const sf::Event& event, CommandQueue& commands)
@@ -103,13 +89,13 @@ void Player::handleEvent(const sf::Event& event, CommandQueue& commands)
 		if (mKeyBinding && mKeyBinding->checkAction(event.key.code, action) && !isRealtimeAction(action))
 		{
 			// Network connected -> send event over network
-			if (mSocket)
+			if (mOutbox)
 			{
 				sf::Packet packet;
 				packet << static_cast<sf::Int32>(Client::PlayerEvent);
 				packet << mIdentifier;
 				packet << static_cast<sf::Int32>(action);
-				mSocket->send(packet);
+				mOutbox->send(packet);
 			}
 
 			// Network disconnected -> local event
@@ -120,7 +106,7 @@ void Player::handleEvent(const sf::Event& event, CommandQueue& commands)
 		}
 	}
 	// Realtime change (network connected)
-	if ((event.type == sf::Event::KeyPressed || event.type == sf::Event::KeyReleased) && mSocket)
+	if ((event.type == sf::Event::KeyPressed || event.type == sf::Event::KeyReleased) && mOutbox)
 	{
 		Action action;
 		if (mKeyBinding && mKeyBinding->checkAction(event.key.code, action) && isRealtimeAction(action))
@@ -131,7 +117,7 @@ void Player::handleEvent(const sf::Event& event, CommandQueue& commands)
 			packet << mIdentifier;
 			packet << static_cast<sf::Int32>(action);
 			packet << (event.type == sf::Event::KeyPressed);
-			mSocket->send(packet);
+			mOutbox->send(packet);
 		}
 	}
 }
@@ -151,14 +137,14 @@ void Player::disableAllRealtimeActions()
 		packet << mIdentifier;
 		packet << static_cast<sf::Int32>(action.first);
 		packet << false;
-		mSocket->send(packet);
+		mOutbox->send(packet);
 	}
 }
 
 void Player::handleRealtimeInput(CommandQueue& commands)
 {
 	// Check if this is a networked game and local player or just a single player game
-	if ((mSocket && isLocal()) || !mSocket)
+	if ((mOutbox && isLocal()) || !mOutbox)
 	{
 		// Lookup all actions and push corresponding commands to queue
 		std::vector<Action> activeActions = mKeyBinding->getRealtimeActions();
@@ -169,7 +155,7 @@ void Player::handleRealtimeInput(CommandQueue& commands)
 
 void Player::handleRealtimeNetworkInput(CommandQueue& commands)
 {
-	if (mSocket && !isLocal())
+	if (mOutbox && !isLocal())
 	{
 		// Traverse all realtime input proxies. Because this is a networked game, the input isn't handled directly
 		FOREACH(auto pair, mActionProxies)
@@ -190,6 +176,36 @@ void Player::handleNetworkRealtimeChange(Action action, bool actionEnabled)
 	mActionProxies[action] = actionEnabled;
 }
 
+void Player::bufferEvent(const sf::Event& event)
+{
+	Action action;
+	if (event.type == sf::Event::KeyPressed && mKeyBinding && mKeyBinding->checkAction(event.key.code, action) && !isRealtimeAction(action))
+		mBufferedEvents |= 1 << action;
+}
+
+sf::Uint8 Player::sampleInputMask()
+{
+	sf::Uint8 mask = mBufferedEvents;
+	mBufferedEvents = 0;
+
+	if (mKeyBinding)
+	{
+		FOREACH(Action action, mKeyBinding->getRealtimeActions())
+			mask |= 1 << action;
+	}
+
+	return mask;
+}
+
+void Player::handleInputMask(sf::Uint8 mask, CommandQueue& commands)
+{
+	for (int action = 0; action < PlayerAction::Count; ++action)
+	{
+		if (mask & (1 << action))
+			commands.push(mActionBinding[static_cast<Action>(action)]);
+	}
+}
+
 void Player::setMissionStatus(MissionStatus status)
 {
 	mCurrentMissionStatus = status;
@@ -202,11 +218,11 @@ Player::MissionStatus Player::getMissionStatus() const
 
 void Player::initializeActions()
 {
-	mActionBinding[PlayerAction::MoveLeft].action = derivedAction<Character>(CharacterMover(-1, 0, mIdentifier));
-	mActionBinding[PlayerAction::MoveRight].action = derivedAction<Character>(CharacterMover(+1, 0, mIdentifier));
-	mActionBinding[PlayerAction::Jump].action = derivedAction<Character>(CharacterJumpTrigger(0, -7500, mIdentifier));
-	mActionBinding[PlayerAction::Fire].action = derivedAction<Character>(CharacterFireTrigger(mIdentifier));
-	mActionBinding[PlayerAction::LaunchMissile].action = derivedAction<Character>(CharacterMissileTrigger(mIdentifier));
+	mActionBinding[PlayerAction::MoveLeft].action = derivedAction<Character>(CharacterMover(-1, 0));
+	mActionBinding[PlayerAction::MoveRight].action = derivedAction<Character>(CharacterMover(+1, 0));
+	mActionBinding[PlayerAction::Jump].action = derivedAction<Character>(CharacterJumpTrigger(0, -7500));
+	mActionBinding[PlayerAction::Fire].action = derivedAction<Character>(CharacterFireTrigger());
+	mActionBinding[PlayerAction::LaunchMissile].action = derivedAction<Character>(CharacterMissileTrigger());
 }
 
 
@@ -2,10 +2,10 @@
 
 #include "Command.hpp"
 #include "KeyBinding.hpp"
+#include "PacketOutbox.hpp"
 
 #include <SFML/System/NonCopyable.hpp>
 #include <SFML/Window/Event.hpp>
-#include <SFML/Network/TcpSocket.hpp>
 
 #include <map>
 
@@ -26,7 +26,7 @@ public:
 
 
 public:
-	Player(sf::TcpSocket* socket, sf::Int32 identifier, const KeyBinding* binding);
+	Player(PacketOutbox* outbox, sf::Int32 identifier, const KeyBinding* binding);
 
 	void					handleEvent(const sf::Event& event, CommandQueue& commands);
 	void					handleRealtimeInput(CommandQueue& commands);
@@ -36,6 +36,11 @@ public:
 	void					handleNetworkEvent(Action action, CommandQueue& commands);
 	void					handleNetworkRealtimeChange(Action action, bool actionEnabled);
 
+	// Input as one bit per PlayerAction (lockstep, replays); one-shot actions are buffered until the next sample
+	void					bufferEvent(const sf::Event& event);
+	sf::Uint8				sampleInputMask();
+	void					handleInputMask(sf::Uint8 mask, CommandQueue& commands);
+
 	void 					setMissionStatus(MissionStatus status);
 	MissionStatus 			getMissionStatus() const;
 
@@ -52,5 +57,6 @@ private:
 	std::map<Action, bool>		mActionProxies;
 	MissionStatus 				mCurrentMissionStatus;
 	int							mIdentifier;
-	sf::TcpSocket*				mSocket;
+	PacketOutbox*				mOutbox;
+	sf::Uint8					mBufferedEvents;
 };
\ No newline at end of file
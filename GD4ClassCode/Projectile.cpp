@@ -3,6 +3,7 @@
 #include "Utility.hpp"
 #include "ResourceHolder.hpp"
 #include "EmitterNode.hpp"
+#include "ObjectPool.hpp"
 
 #include <SFML/Graphics/RenderTarget.hpp>
 #include <SFML/Graphics/RenderStates.hpp>
@@ -16,18 +17,20 @@ namespace
 	const std::vector<ProjectileData> Table = initializeProjectileData();
 }
 
-Projectile::Projectile(Type type, const TextureHolder& textures, int playerID)
-	: Entity(1)
+Projectile::Projectile(Type type, EntityStore& entities, const TextureHolder& textures, int playerID)
+	: Entity(entities, 1)
 	, mType(type)
 	, mSprite(textures.get(Table[type].texture), Table[type].textureRect)
-	, mTargetDirection()
 	, playerID(playerID)
 {
 	centerOrigin(mSprite);
+	setCollider(mSprite.getGlobalBounds());
 
-	// Add particle system for missiles
+	// Add particle system for missiles; EntityStore does the steering
 	if (isGuided())
 	{
+		setGuided(getMaxSpeed());
+
 		std::unique_ptr<EmitterNode> smoke(new EmitterNode(Particle::Smoke));
 		smoke->setPosition(0.f, getBoundingRect().height / 2.f);
 		attachChild(std::move(smoke));
@@ -39,32 +42,40 @@ Projectile::Projectile(Type type, const TextureHolder& textures, int playerID)
 	}
 }
 
+void* Projectile::operator new(std::size_t size)
+{
+	return ObjectPool<Projectile>::instance().allocate(size);
+}
+
+void Projectile::operator delete(void* pointer, std::size_t size)
+{
+	ObjectPool<Projectile>::instance().deallocate(pointer, size);
+}
+
 void Projectile::guideTowards(sf::Vector2f position)
 {
 	assert(isGuided());
-	mTargetDirection = unitVector(position - getWorldPosition());
+	setTargetDirection(unitVector(position - getWorldPosition()));
 }
 
-bool Projectile::isGuided() const
+sf::Vector2f Projectile::getTargetDirection() const
 {
-	return mType == Missile;
+	return Entity::getTargetDirection();
 }
 
-void Projectile::updateCurrent(sf::Time dt, CommandQueue& commands)
+void Projectile::setTargetDirection(sf::Vector2f direction)
 {
-	if (isGuided())
-	{
-		const float approachRate = 200.f;
-
-		sf::Vector2f newVelocity = unitVector(approachRate * dt.asSeconds() * mTargetDirection + getVelocity());
-		newVelocity *= getMaxSpeed();
-		float angle = std::atan2(newVelocity.y, newVelocity.x);
+	Entity::setTargetDirection(direction);
+}
 
-		setRotation(toDegree(angle) + 90.f);
-		setVelocity(newVelocity);
-	}
+bool Projectile::isGuided() const
+{
+	return mType == Missile;
+}
 
-	Entity::updateCurrent(dt, commands);
+Projectile::Type Projectile::getType() const
+{
+	return mType;
 }
 
 void Projectile::drawCurrent(sf::RenderTarget& target, sf::RenderStates states) const
@@ -77,11 +88,6 @@ unsigned int Projectile::getCategory() const
 		return Category::AlliedProjectile;
 }
 
-sf::FloatRect Projectile::getBoundingRect() const
-{
-	return getWorldTransform().transformRect(mSprite.getGlobalBounds());
-}
-
 float Projectile::getMaxSpeed() const
 {
 	return Table[mType].speed;
@@ -19,22 +19,26 @@ public:
 	int playerID;
 
 public:
-	Projectile(Type type, const TextureHolder& texture, int playerID);
+	Projectile(Type type, EntityStore& entities, const TextureHolder& texture, int playerID);
+
+	// Recycled through ObjectPool<Projectile>
+	static void* operator new(std::size_t size);
+	static void operator delete(void* pointer, std::size_t size);
 
 	void guideTowards(sf::Vector2f position);
+	sf::Vector2f getTargetDirection() const;
+	void setTargetDirection(sf::Vector2f direction);
 	bool isGuided() const;
+	Type getType() const;
 
 	virtual unsigned int getCategory() const;
-	virtual sf::FloatRect getBoundingRect() const;
 	float getMaxSpeed() const;
 	int getDamage() const;
 
 private:
-	virtual void updateCurrent(sf::Time dt, CommandQueue& commands);
 	virtual void drawCurrent(sf::RenderTarget& target, sf::RenderStates states) const;
 
 private:
 	Type mType;
 	sf::Sprite mSprite;
-	sf::Vector2f mTargetDirection;
 };
\ No newline at end of file
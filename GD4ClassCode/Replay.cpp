@@ -0,0 +1,351 @@
+#include "Replay.hpp"
+#include "Foreach.hpp"
+
+#include <SFML/Network/Packet.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <iterator>
+
+
+namespace
+{
+	const sf::Uint32 Magic = 0x53544252; // "STBR"
+	const sf::Uint32 Version = 2;
+
+	// Smallest encoded size of each repeated entry, see writeSnapshot() and saveToFile()
+	const std::size_t IdentifierSize = 4;
+	const std::size_t KeyframeSize = 45;
+	const std::size_t CharacterSize = 78;
+	const std::size_t ProjectileSize = 36;
+	const std::size_t PickupSize = 21;
+
+	// A count read from a file can't exceed what the file has bytes for; checked before resizing to it,
+	// so a corrupt count fails the load instead of allocating gigabytes
+	bool isPlausibleCount(const sf::Packet& packet, sf::Int32 count, std::size_t entrySize)
+	{
+		return count >= 0 && static_cast<std::size_t>(count) <= packet.getDataSize() / entrySize;
+	}
+
+	void writeTime(sf::Packet& packet, sf::Time time)
+	{
+		packet << static_cast<sf::Int32>(time.asMicroseconds());
+	}
+
+	sf::Time readTime(sf::Packet& packet)
+	{
+		sf::Int32 microseconds = 0;
+		packet >> microseconds;
+		return sf::microseconds(microseconds);
+	}
+
+	void writeSnapshot(sf::Packet& packet, const World::Snapshot& snapshot)
+	{
+		// The random engine is stored as its position in the sequence, not its 2.5 KB state
+		packet << static_cast<sf::Uint32>(snapshot.random.seed) << static_cast<sf::Uint32>(snapshot.random.draws);
+
+		const PickupSpawner& spawner = snapshot.pickupSpawner;
+		packet << spawner.hasSchedule() << spawner.getSeed() << spawner.getNextIndex();
+		writeTime(packet, spawner.getMeanInterval());
+		writeTime(packet, spawner.getTimeUntilNext());
+
+		packet << static_cast<sf::Int32>(snapshot.characters.size());
+		FOREACH(const Character::State& state, snapshot.characters)
+		{
+			packet << static_cast<sf::Int32>(state.identifier) << state.position.x << state.position.y << state.velocity.x << state.velocity.y;
+			packet << static_cast<sf::Int32>(state.hitpoints) << state.knockback << static_cast<sf::Int32>(state.missileAmmo);
+			packet << static_cast<sf::Int32>(state.survivability) << static_cast<sf::Int32>(state.fireRateLevel);
+			writeTime(packet, state.fireCountdown);
+			packet << state.isFiring << state.isLaunchingMissile << state.isGrounded << state.explosionBegan << state.spawnedPickup;
+			packet << state.playedExplosionSound << static_cast<sf::Uint32>(state.explosionFrame);
+			writeTime(packet, state.explosionElapsed);
+			packet << state.previousPositionOnFire.x << state.previousPositionOnFire.y << static_cast<sf::Int32>(state.shootDirection);
+			packet << static_cast<sf::Int32>(state.currentAnimation) << static_cast<sf::Int32>(state.animationFrameTimer);
+		}
+
+		packet << static_cast<sf::Int32>(snapshot.projectiles.size());
+		FOREACH(const World::Snapshot::ProjectileState& state, snapshot.projectiles)
+		{
+			packet << static_cast<sf::Int32>(state.type) << static_cast<sf::Int32>(state.playerID);
+			packet << state.position.x << state.position.y << state.velocity.x << state.velocity.y;
+			packet << state.targetDirection.x << state.targetDirection.y << state.rotation;
+		}
+
+		packet << static_cast<sf::Int32>(snapshot.pickups.size());
+		FOREACH(const World::Snapshot::PickupState& state, snapshot.pickups)
+		{
+			packet << static_cast<sf::Int32>(state.type);
+			packet << state.position.x << state.position.y << state.velocity.x << state.velocity.y << state.grounded;
+		}
+	}
+
+	bool readSnapshot(sf::Packet& packet, World::Snapshot& snapshot)
+	{
+		sf::Uint32 randomSeed, randomDraws;
+		packet >> randomSeed >> randomDraws;
+		snapshot.random.seed = randomSeed;
+		snapshot.random.draws = randomDraws;
+		rebuildRandomEngine(snapshot.random);
+
+		bool hasSchedule;
+		sf::Uint32 pickupSeed, nextIndex;
+		packet >> hasSchedule >> pickupSeed >> nextIndex;
+		sf::Time meanInterval = readTime(packet);
+		sf::Time untilNext = readTime(packet);
+		snapshot.pickupSpawner = PickupSpawner();
+		if (hasSchedule)
+		{
+			if (meanInterval.asMilliseconds() <= 0)
+				return false;
+
+			snapshot.pickupSpawner.setSchedule(pickupSeed, meanInterval, nextIndex, untilNext);
+		}
+
+		sf::Int32 count = 0;
+		packet >> count;
+		if (!isPlausibleCount(packet, count, CharacterSize))
+			return false;
+
+		snapshot.characters.resize(count);
+		FOREACH(Character::State& state, snapshot.characters)
+		{
+			sf::Int32 identifier, hitpoints, missileAmmo, survivability, fireRateLevel, shootDirection, currentAnimation, animationFrameTimer;
+			packet >> identifier >> state.position.x >> state.position.y >> state.velocity.x >> state.velocity.y;
+			packet >> hitpoints >> state.knockback >> missileAmmo >> survivability >> fireRateLevel;
+			state.fireCountdown = readTime(packet);
+			packet >> state.isFiring >> state.isLaunchingMissile >> state.isGrounded >> state.explosionBegan >> state.spawnedPickup;
+			sf::Uint32 explosionFrame;
+			packet >> state.playedExplosionSound >> explosionFrame;
+			state.explosionFrame = explosionFrame;
+			state.explosionElapsed = readTime(packet);
+			packet >> state.previousPositionOnFire.x >> state.previousPositionOnFire.y >> shootDirection;
+			packet >> currentAnimation >> animationFrameTimer;
+
+			state.identifier = identifier;
+			state.hitpoints = hitpoints;
+			state.missileAmmo = missileAmmo;
+			state.survivability = survivability;
+			state.fireRateLevel = fireRateLevel;
+			state.shootDirection = shootDirection;
+			state.currentAnimation = currentAnimation;
+			state.animationFrameTimer = animationFrameTimer;
+		}
+
+		count = 0;
+		packet >> count;
+		if (!isPlausibleCount(packet, count, ProjectileSize))
+			return false;
+
+		snapshot.projectiles.resize(count);
+		FOREACH(World::Snapshot::ProjectileState& state, snapshot.projectiles)
+		{
+			sf::Int32 type, playerID;
+			packet >> type >> playerID >> state.position.x >> state.position.y >> state.velocity.x >> state.velocity.y;
+			packet >> state.targetDirection.x >> state.targetDirection.y >> state.rotation;
+
+			if (type < 0 || type >= Projectile::TypeCount)
+				return false;
+
+			state.type = static_cast<Projectile::Type>(type);
+			state.playerID = playerID;
+		}
+
+		count = 0;
+		packet >> count;
+		if (!isPlausibleCount(packet, count, PickupSize))
+			return false;
+
+		snapshot.pickups.resize(count);
+		FOREACH(World::Snapshot::PickupState& state, snapshot.pickups)
+		{
+			sf::Int32 type;
+			packet >> type >> state.position.x >> state.position.y >> state.velocity.x >> state.velocity.y >> state.grounded;
+
+			if (type < 0 || type >= Pickup::TypeCount)
+				return false;
+
+			state.type = static_cast<Pickup::Type>(type);
+		}
+
+		return packet;
+	}
+}
+
+Replay::Replay()
+	: mIdentifiers()
+	, mTimePerTick(sf::Time::Zero)
+	, mInputs()
+	, mKeyframes()
+{
+}
+
+void Replay::begin(const std::vector<sf::Int32>& identifiers)
+{
+	mIdentifiers = identifiers;
+	mTimePerTick = sf::Time::Zero;
+	mInputs.clear();
+	mKeyframes.clear();
+}
+
+bool Replay::needsKeyframe() const
+{
+	return getTickCount() % KeyframeInterval == 0;
+}
+
+void Replay::addKeyframe(const World::Snapshot& snapshot)
+{
+	Keyframe keyframe = { getTickCount(), snapshot };
+	mKeyframes.push_back(keyframe);
+}
+
+void Replay::recordTick(const std::vector<sf::Uint8>& inputs, sf::Time dt)
+{
+	assert(inputs.size() == mIdentifiers.size());
+	mTimePerTick = dt;
+	mInputs.insert(mInputs.end(), inputs.begin(), inputs.end());
+}
+
+bool Replay::saveToFile(const std::string& filename) const
+{
+	sf::Packet packet;
+	packet << Magic << Version;
+	writeTime(packet, mTimePerTick);
+
+	packet << static_cast<sf::Int32>(mIdentifiers.size());
+	FOREACH(sf::Int32 identifier, mIdentifiers)
+		packet << identifier;
+
+	// Inputs barely change from tick to tick: store runs of identical rows
+	std::size_t players = mIdentifiers.size();
+	sf::Uint32 tickCount = getTickCount();
+	packet << tickCount;
+
+	sf::Uint32 tick = 0;
+	while (tick < tickCount)
+	{
+		auto row = mInputs.begin() + tick * players;
+
+		sf::Uint32 run = 1;
+		while (tick + run < tickCount && run < 0xFFFF && std::equal(row, row + players, row + run * players))
+			++run;
+
+		packet << static_cast<sf::Uint16>(run);
+		for (std::size_t player = 0; player < players; ++player)
+			packet << row[player];
+
+		tick += run;
+	}
+
+	packet << static_cast<sf::Int32>(mKeyframes.size());
+	FOREACH(const Keyframe& keyframe, mKeyframes)
+	{
+		packet << keyframe.tick;
+		writeSnapshot(packet, keyframe.snapshot);
+	}
+
+	std::ofstream file(filename, std::ios::binary);
+	file.write(static_cast<const char*>(packet.getData()), packet.getDataSize());
+	return file.good();
+}
+
+bool Replay::loadFromFile(const std::string& filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+		return false;
+
+	std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if (data.empty())
+		return false;
+
+	sf::Packet packet;
+	packet.append(data.data(), data.size());
+
+	sf::Uint32 magic, version;
+	packet >> magic >> version;
+	if (!packet || magic != Magic || version != Version)
+		return false;
+
+	mTimePerTick = readTime(packet);
+
+	sf::Int32 players = 0;
+	packet >> players;
+	if (!packet || players <= 0 || !isPlausibleCount(packet, players, IdentifierSize))
+		return false;
+
+	mIdentifiers.resize(players);
+	FOREACH(sf::Int32& identifier, mIdentifiers)
+		packet >> identifier;
+
+	sf::Uint32 tickCount = 0;
+	packet >> tickCount;
+
+	mInputs.clear();
+	std::vector<sf::Uint8> row(players);
+	std::size_t inputCount = tickCount * static_cast<std::size_t>(players);
+	while (packet && mInputs.size() < inputCount)
+	{
+		sf::Uint16 run = 0;
+		packet >> run;
+		FOREACH(sf::Uint8& input, row)
+			packet >> input;
+
+		// A run past the announced tick count means the file is corrupt; don't expand it
+		if (run > (inputCount - mInputs.size()) / players)
+			return false;
+
+		for (sf::Uint16 i = 0; i < run; ++i)
+			mInputs.insert(mInputs.end(), row.begin(), row.end());
+	}
+
+	sf::Int32 keyframeCount = 0;
+	packet >> keyframeCount;
+	if (!isPlausibleCount(packet, keyframeCount, KeyframeSize))
+		return false;
+
+	mKeyframes.resize(keyframeCount);
+	FOREACH(Keyframe& keyframe, mKeyframes)
+	{
+		packet >> keyframe.tick;
+		if (!readSnapshot(packet, keyframe.snapshot))
+			return false;
+	}
+
+	// Playback starts from a keyframe, a replay without the first one is useless
+	return packet && !mKeyframes.empty() && mKeyframes.front().tick == 0;
+}
+
+const std::vector<sf::Int32>& Replay::getIdentifiers() const
+{
+	return mIdentifiers;
+}
+
+sf::Time Replay::getTimePerTick() const
+{
+	return mTimePerTick;
+}
+
+sf::Uint32 Replay::getTickCount() const
+{
+	return mIdentifiers.empty() ? 0 : static_cast<sf::Uint32>(mInputs.size() / mIdentifiers.size());
+}
+
+sf::Uint8 Replay::getInput(sf::Uint32 tick, std::size_t player) const
+{
+	return mInputs[tick * mIdentifiers.size() + player];
+}
+
+sf::Uint32 Replay::findKeyframe(sf::Uint32 tick, const World::Snapshot*& out) const
+{
+	assert(!mKeyframes.empty());
+
+	// Keyframes are recorded in tick order
+	auto found = std::upper_bound(mKeyframes.begin(), mKeyframes.end(), tick,
+		[](sf::Uint32 value, const Keyframe& keyframe) { return value < keyframe.tick; });
+	if (found != mKeyframes.begin())
+		--found;
+
+	out = &found->snapshot;
+	return found->tick;
+}
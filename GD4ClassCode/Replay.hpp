@@ -0,0 +1,56 @@
+#pragma once
+#include "World.hpp"
+
+#include <SFML/Config.hpp>
+#include <SFML/System/Time.hpp>
+
+#include <string>
+#include <vector>
+
+
+// Recorded match: the PlayerAction bitmask of every player for every tick, plus a World keyframe every
+// KeyframeInterval ticks. Playback restores the nearest keyframe and feeds the inputs back through Player,
+// so the file stays small (run-length encoded inputs) and seeking re-simulates at most one interval
+class Replay
+{
+public:
+	static const sf::Uint32		KeyframeInterval = 300;	// 5 seconds at 60 ticks per second
+
+
+public:
+								Replay();
+
+	// Recording: call needsKeyframe()/addKeyframe() and recordTick() once per tick, before its inputs are applied.
+	// dt is the fixed step the tick is simulated with, playback uses the same
+	void						begin(const std::vector<sf::Int32>& identifiers);
+	bool						needsKeyframe() const;
+	void						addKeyframe(const World::Snapshot& snapshot);
+	void						recordTick(const std::vector<sf::Uint8>& inputs, sf::Time dt);
+
+	bool						saveToFile(const std::string& filename) const;
+	bool						loadFromFile(const std::string& filename);
+
+	// Playback; player index follows getIdentifiers()
+	const std::vector<sf::Int32>& getIdentifiers() const;
+	sf::Time					getTimePerTick() const;
+	sf::Uint32					getTickCount() const;
+	sf::Uint8					getInput(sf::Uint32 tick, std::size_t player) const;
+
+	// Latest keyframe at or before tick; returns the tick the keyframe was taken at
+	sf::Uint32					findKeyframe(sf::Uint32 tick, const World::Snapshot*& out) const;
+
+
+private:
+	struct Keyframe
+	{
+		sf::Uint32				tick;
+		World::Snapshot			snapshot;
+	};
+
+
+private:
+	std::vector<sf::Int32>		mIdentifiers;
+	sf::Time					mTimePerTick;
+	std::vector<sf::Uint8>		mInputs;		// tick-major, one byte per player
+	std::vector<Keyframe>		mKeyframes;
+};
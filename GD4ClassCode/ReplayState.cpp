@@ -0,0 +1,167 @@
+#include "ReplayState.hpp"
+#include "MusicPlayer.hpp"
+#include "Foreach.hpp"
+#include "Utility.hpp"
+
+#include <SFML/Graphics/RenderWindow.hpp>
+#include <SFML/System/Clock.hpp>
+
+#include <iostream>
+
+
+const std::string ReplayState::LastMatchFile = "lastmatch.replay";
+
+namespace
+{
+	const sf::Uint32 FastForwardTicksPerFrame = 4;
+
+	std::string formatTime(sf::Time time)
+	{
+		int seconds = static_cast<int>(time.asSeconds());
+		return toString(seconds / 60) + ":" + (seconds % 60 < 10 ? "0" : "") + toString(seconds % 60);
+	}
+}
+
+ReplayState::ReplayState(StateStack& stack, Context context)
+	: State(stack, context)
+	, mWorld(*context.window, *context.fonts, *context.sounds, false)
+	, mWindow(*context.window)
+	, mReplay()
+	, mLoaded(false)
+	, mPlayers()
+	, mTick(0)
+	, mTicksPerFrame(1)
+	, mPaused(false)
+	, mElapsedTime(sf::Time::Zero)
+{
+	mInfoText.setFont(context.fonts->get(Fonts::Main));
+	mInfoText.setCharacterSize(20);
+	mInfoText.setPosition(10.f, mWindow.getSize().y - 30.f);
+
+	mLoaded = mReplay.loadFromFile(LastMatchFile);
+	if (mLoaded)
+	{
+		FOREACH(sf::Int32 identifier, mReplay.getIdentifiers())
+			mPlayers.push_back(PlayerPtr(new Player(nullptr, identifier, nullptr)));
+
+		seek(0);
+		context.music->play(Music::MissionTheme);
+	}
+	else
+	{
+		mInfoText.setString("No replay recorded yet");
+	}
+}
+
+void ReplayState::draw()
+{
+	if (mLoaded)
+		mWorld.draw();
+
+	mWindow.setView(mWindow.getDefaultView());
+	mWindow.draw(mInfoText);
+}
+
+bool ReplayState::update(sf::Time dt)
+{
+	if (!mLoaded)
+	{
+		mElapsedTime += dt;
+		if (mElapsedTime > sf::seconds(3.f))
+		{
+			requestStackClear();
+			requestStackPush(States::Menu);
+		}
+		return true;
+	}
+
+	if (!mPaused)
+	{
+		for (sf::Uint32 i = 0; i < mTicksPerFrame && mTick < mReplay.getTickCount(); ++i)
+			simulateTick();
+	}
+
+	updateInfoText();
+	return true;
+}
+
+bool ReplayState::handleEvent(const sf::Event& event)
+{
+	if (event.type != sf::Event::KeyPressed)
+		return true;
+
+	sf::Uint32 seekStep = Replay::KeyframeInterval;
+
+	switch (event.key.code)
+	{
+	case sf::Keyboard::Escape:
+		requestStackClear();
+		requestStackPush(States::Menu);
+		break;
+
+	case sf::Keyboard::Space:
+		mPaused = !mPaused;
+		break;
+
+	case sf::Keyboard::F:
+		mTicksPerFrame = (mTicksPerFrame == 1) ? FastForwardTicksPerFrame : 1;
+		break;
+
+	case sf::Keyboard::Left:
+		if (mLoaded)
+			seek(mTick > seekStep ? mTick - seekStep : 0);
+		break;
+
+	case sf::Keyboard::Right:
+		if (mLoaded)
+			seek(std::min(mTick + seekStep, mReplay.getTickCount()));
+		break;
+
+	default:
+		break;
+	}
+
+	return true;
+}
+
+void ReplayState::simulateTick()
+{
+	// Same path the recorded inputs took: Player turns each bitmask into commands
+	CommandQueue& commands = mWorld.getCommandQueue();
+	for (std::size_t i = 0; i < mPlayers.size(); ++i)
+		mPlayers[i]->handleInputMask(mReplay.getInput(mTick, i), commands);
+
+	mWorld.update(mReplay.getTimePerTick());
+	mTick++;
+}
+
+void ReplayState::seek(sf::Uint32 tick)
+{
+	sf::Clock clock;
+
+	// Jump to the nearest keyframe before the target, then re-simulate the rest
+	const World::Snapshot* keyframe = nullptr;
+	mTick = mReplay.findKeyframe(tick, keyframe);
+	mWorld.restoreState(*keyframe);
+
+	while (mTick < tick)
+		simulateTick();
+
+	std::cout << "Replay: seek to " << formatTime(mReplay.getTimePerTick() * static_cast<sf::Int64>(tick))
+		<< " took " << clock.getElapsedTime().asMicroseconds() << " us" << std::endl;
+}
+
+void ReplayState::updateInfoText()
+{
+	sf::Time tickTime = mReplay.getTimePerTick();
+	std::string info = "Replay " + formatTime(tickTime * static_cast<sf::Int64>(mTick))
+		+ " / " + formatTime(tickTime * static_cast<sf::Int64>(mReplay.getTickCount()));
+
+	if (mPaused)
+		info += "  (paused)";
+	else if (mTicksPerFrame > 1)
+		info += "  x" + toString(mTicksPerFrame);
+
+	info += "    Space: pause  F: fast-forward  Left/Right: seek  Esc: menu";
+	mInfoText.setString(info);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "State.hpp"
+#include "World.hpp"
+#include "Player.hpp"
+#include "Replay.hpp"
+
+#include <SFML/Graphics/Text.hpp>
+
+#include <map>
+#include <string>
+
+
+// Plays back the last recorded match: Space pauses, F toggles fast-forward, Left/Right seek, Escape leaves
+class ReplayState : public State
+{
+public:
+	static const std::string	LastMatchFile;
+
+
+public:
+	ReplayState(StateStack& stack, Context context);
+
+	virtual void				draw();
+	virtual bool				update(sf::Time dt);
+	virtual bool				handleEvent(const sf::Event& event);
+
+
+private:
+	void						simulateTick();
+	void						seek(sf::Uint32 tick);
+	void						updateInfoText();
+
+
+private:
+	typedef std::unique_ptr<Player> PlayerPtr;
+
+
+private:
+	World						mWorld;
+	sf::RenderWindow&			mWindow;
+	Replay						mReplay;
+	bool						mLoaded;
+
+	std::vector<PlayerPtr>		mPlayers;		// same order as the replay's identifiers
+	sf::Uint32					mTick;
+	sf::Uint32					mTicksPerFrame;
+	bool						mPaused;
+
+	sf::Text					mInfoText;
+	sf::Time					mElapsedTime;
+};
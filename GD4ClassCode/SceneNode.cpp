@@ -12,15 +12,47 @@
 
 
 SceneNode::SceneNode(Category::Type category)
-	: mChildren()
+	: mCategoryIndex()
+	, mChildren()
+	, mUpdatedChildren()
 	, mParent(nullptr)
 	, mDefaultCategory(category)
+	, mDetachPending(false)
+	, mUpdateCurrentEnabled(true)
+	, mListedForUpdate(false)
+	, mWorldTransform()
+	, mWorldTransformDirty(true)
+	, mIndex(nullptr)
+	, mIndexedBit(CategoryBits)
+	, mPreviousInCategory(nullptr)
+	, mNextInCategory(nullptr)
 {
 }
 
+SceneNode::~SceneNode()
+{
+	// Children are destroyed after this body and unlink themselves
+	unlinkFromCategoryIndex();
+}
+
+void SceneNode::enableCategoryIndex()
+{
+	assert(mParent == nullptr && !mCategoryIndex);
+
+	mCategoryIndex.reset(new CategoryIndex());
+	mCategoryIndex->first.fill(nullptr);
+	mCategoryIndex->last.fill(nullptr);
+	registerSubtree(*mCategoryIndex);
+}
+
 void SceneNode::attachChild(Ptr child)
 {
 	child->mParent = this;
+	child->invalidateWorldTransform();
+	if (mIndex)
+		child->registerSubtree(*mIndex);
+	if (child->needsUpdate())
+		child->listForUpdate();
 	mChildren.push_back(std::move(child));
 }
 
@@ -31,13 +63,21 @@ SceneNode::Ptr SceneNode::detachChild(const SceneNode& node)
 
 	Ptr result = std::move(*found);
 	result->mParent = nullptr;
+	result->invalidateWorldTransform();
+	result->unregisterSubtree();
+	if (result->mListedForUpdate)
+	{
+		mUpdatedChildren.erase(std::find(mUpdatedChildren.begin(), mUpdatedChildren.end(), result.get()));
+		result->mListedForUpdate = false;
+	}
 	mChildren.erase(found);
 	return result;
 }
 
 void SceneNode::update(sf::Time dt, CommandQueue& commands)
 {
-	updateCurrent(dt, commands);
+	if (mUpdateCurrentEnabled)
+		updateCurrent(dt, commands);
 	updateChildren(dt, commands);
 }
 
@@ -48,7 +88,8 @@ void SceneNode::updateCurrent(sf::Time, CommandQueue&)
 
 void SceneNode::updateChildren(sf::Time dt, CommandQueue& commands)
 {
-	FOREACH(Ptr& child, mChildren)
+	// Entities the store moves aren't even dereferenced
+	FOREACH(SceneNode* child, mUpdatedChildren)
 		child->update(dt, commands);
 }
 
@@ -95,18 +136,121 @@ sf::Vector2f SceneNode::getWorldPosition() const
 	return getWorldTransform() * sf::Vector2f();
 }
 
-sf::Transform SceneNode::getWorldTransform() const
+const sf::Transform& SceneNode::getWorldTransform() const
+{
+	if (mWorldTransformDirty)
+	{
+		if (mParent)
+			mWorldTransform = mParent->getWorldTransform() * getTransform();
+		else
+			mWorldTransform = getTransform();
+
+		mWorldTransformDirty = false;
+	}
+
+	return mWorldTransform;
+}
+
+void SceneNode::setPosition(float x, float y)
+{
+	sf::Transformable::setPosition(x, y);
+	invalidateWorldTransform();
+}
+
+void SceneNode::setPosition(const sf::Vector2f& position)
+{
+	sf::Transformable::setPosition(position);
+	invalidateWorldTransform();
+}
+
+void SceneNode::move(float offsetX, float offsetY)
+{
+	sf::Transformable::move(offsetX, offsetY);
+	invalidateWorldTransform();
+}
+
+void SceneNode::move(const sf::Vector2f& offset)
+{
+	sf::Transformable::move(offset);
+	invalidateWorldTransform();
+}
+
+void SceneNode::setRotation(float angle)
+{
+	sf::Transformable::setRotation(angle);
+	invalidateWorldTransform();
+}
+
+void SceneNode::rotate(float angle)
+{
+	sf::Transformable::rotate(angle);
+	invalidateWorldTransform();
+}
+
+void SceneNode::setScale(float factorX, float factorY)
+{
+	sf::Transformable::setScale(factorX, factorY);
+	invalidateWorldTransform();
+}
+
+void SceneNode::setScale(const sf::Vector2f& factors)
+{
+	sf::Transformable::setScale(factors);
+	invalidateWorldTransform();
+}
+
+void SceneNode::scale(float factorX, float factorY)
+{
+	sf::Transformable::scale(factorX, factorY);
+	invalidateWorldTransform();
+}
+
+void SceneNode::scale(const sf::Vector2f& factor)
 {
-	sf::Transform transform = sf::Transform::Identity;
+	sf::Transformable::scale(factor);
+	invalidateWorldTransform();
+}
+
+void SceneNode::setOrigin(float x, float y)
+{
+	sf::Transformable::setOrigin(x, y);
+	invalidateWorldTransform();
+}
 
-	for (const SceneNode* node = this; node != nullptr; node = node->mParent)
-		transform = node->getTransform() * transform;
+void SceneNode::setOrigin(const sf::Vector2f& origin)
+{
+	sf::Transformable::setOrigin(origin);
+	invalidateWorldTransform();
+}
+
+void SceneNode::invalidateWorldTransform()
+{
+	// Already dirty means the whole subtree is, nothing to propagate
+	if (mWorldTransformDirty)
+		return;
 
-	return transform;
+	mWorldTransformDirty = true;
+	FOREACH(Ptr& child, mChildren)
+		child->invalidateWorldTransform();
 }
 
 void SceneNode::onCommand(const Command& command, sf::Time dt)
 {
+	// Indexed root: walk the lists of the command's categories only
+	if (mCategoryIndex)
+	{
+		for (std::size_t bit = 0; bit < CategoryBits; ++bit)
+		{
+			if (!(command.category & (1u << bit)))
+				continue;
+
+			for (SceneNode* node = mCategoryIndex->first[bit]; node != nullptr; node = node->mNextInCategory)
+				command.action(*node, dt);
+		}
+
+		return;
+	}
+
 	// Command current node, if category matches
 	if (command.category & getCategory())
 		command.action(*this, dt);
@@ -121,31 +265,105 @@ unsigned int SceneNode::getCategory() const
 	return mDefaultCategory;
 }
 
-void SceneNode::checkSceneCollision(SceneNode& sceneGraph, std::set<Pair>& collisionPairs)
+void SceneNode::registerSubtree(CategoryIndex& index)
 {
-	checkNodeCollision(sceneGraph, collisionPairs);
+	mIndex = &index;
+
+	unsigned int category = getCategory();
+	if (category != Category::None)
+	{
+		// One list per node: every category a node reports is a single bit
+		assert((category & (category - 1)) == 0);
+
+		mIndexedBit = 0;
+		while (!(category & (1u << mIndexedBit)))
+			++mIndexedBit;
+
+		mPreviousInCategory = index.last[mIndexedBit];
+		mNextInCategory = nullptr;
+		if (mPreviousInCategory)
+			mPreviousInCategory->mNextInCategory = this;
+		else
+			index.first[mIndexedBit] = this;
+		index.last[mIndexedBit] = this;
+	}
 
-	FOREACH(Ptr& child, sceneGraph.mChildren)
-		checkSceneCollision(*child, collisionPairs);
+	FOREACH(Ptr& child, mChildren)
+		child->registerSubtree(index);
 }
 
-void SceneNode::checkNodeCollision(SceneNode& node, std::set<Pair>& collisionPairs)
+void SceneNode::unregisterSubtree()
 {
-	if (this != &node && collision(*this, node) && !isDestroyed() && !node.isDestroyed())
-		collisionPairs.insert(std::minmax(this, &node));
+	unlinkFromCategoryIndex();
+	mIndex = nullptr;
 
 	FOREACH(Ptr& child, mChildren)
-		child->checkNodeCollision(node, collisionPairs);
+		child->unregisterSubtree();
 }
 
-void SceneNode::removeWrecks()
+void SceneNode::unlinkFromCategoryIndex()
 {
-	// Remove all children which request so
-	auto wreckfieldBegin = std::remove_if(mChildren.begin(), mChildren.end(), std::mem_fn(&SceneNode::isMarkedForRemoval));
-	mChildren.erase(wreckfieldBegin, mChildren.end());
+	if (!mIndex || mIndexedBit == CategoryBits)
+		return;
+
+	if (mPreviousInCategory)
+		mPreviousInCategory->mNextInCategory = mNextInCategory;
+	else
+		mIndex->first[mIndexedBit] = mNextInCategory;
+
+	if (mNextInCategory)
+		mNextInCategory->mPreviousInCategory = mPreviousInCategory;
+	else
+		mIndex->last[mIndexedBit] = mPreviousInCategory;
+
+	mPreviousInCategory = nullptr;
+	mNextInCategory = nullptr;
+	mIndexedBit = CategoryBits;
+}
 
-	// Call function recursively for all remaining children
-	std::for_each(mChildren.begin(), mChildren.end(), std::mem_fn(&SceneNode::removeWrecks));
+void SceneNode::detachNodes(const std::vector<SceneNode*>& nodes, std::vector<Ptr>& detached)
+{
+	FOREACH(SceneNode* node, nodes)
+	{
+		if (node->mParent)
+			node->mDetachPending = true;
+	}
+
+	FOREACH(SceneNode* node, nodes)
+	{
+		// Null once a sibling's pass has taken the node
+		SceneNode* parent = node->mParent;
+		if (!parent || !node->mDetachPending)
+			continue;
+
+		// Before the loop below clears the pending flags
+		std::vector<SceneNode*>& updated = parent->mUpdatedChildren;
+		updated.erase(std::remove_if(updated.begin(), updated.end(), [](SceneNode* child) { return child->mDetachPending; }), updated.end());
+
+		std::vector<Ptr>& children = parent->mChildren;
+		std::size_t kept = 0;
+		for (std::size_t i = 0; i < children.size(); ++i)
+		{
+			if (children[i]->mDetachPending)
+			{
+				SceneNode& child = *children[i];
+				child.mDetachPending = false;
+				child.mListedForUpdate = false;
+				child.mParent = nullptr;
+				child.invalidateWorldTransform();
+				child.unregisterSubtree();
+				detached.push_back(std::move(children[i]));
+			}
+			else
+			{
+				if (kept != i)
+					children[kept] = std::move(children[i]);
+				++kept;
+			}
+		}
+
+		children.resize(kept);
+	}
 }
 
 sf::FloatRect SceneNode::getBoundingRect() const
@@ -165,6 +383,29 @@ bool SceneNode::isDestroyed() const
 	return false;
 }
 
+void SceneNode::setUpdateCurrentEnabled(bool enabled)
+{
+	// Disabling leaves the node listed, the walk then just visits it for nothing
+	mUpdateCurrentEnabled = enabled;
+	if (enabled)
+		listForUpdate();
+}
+
+bool SceneNode::needsUpdate() const
+{
+	return mUpdateCurrentEnabled || !mUpdatedChildren.empty();
+}
+
+void SceneNode::listForUpdate()
+{
+	// Ancestors that had nothing to update so far are listed with it
+	for (SceneNode* node = this; node->mParent && !node->mListedForUpdate; node = node->mParent)
+	{
+		node->mParent->mUpdatedChildren.push_back(node);
+		node->mListedForUpdate = true;
+	}
+}
+
 bool collision(const SceneNode& lhs, const SceneNode& rhs)
 {
 	return lhs.getBoundingRect().intersects(rhs.getBoundingRect());
@@ -7,8 +7,8 @@
 #include <SFML/Graphics/Transformable.hpp>
 #include <SFML/Graphics/Drawable.hpp>
 
+#include <array>
 #include <vector>
-#include <set>
 #include <memory>
 #include <utility>
 
@@ -25,6 +25,11 @@ public:
 
 public:
 	explicit				SceneNode(Category::Type category = Category::None);
+	virtual					~SceneNode();
+
+	// Root only: keeps every node of the graph in a list per category bit (attach order), so onCommand()
+	// visits just the nodes a command targets instead of the whole tree
+	void					enableCategoryIndex();
 
 	void					attachChild(Ptr child);
 	Ptr						detachChild(const SceneNode& node);
@@ -32,19 +37,51 @@ public:
 	void					update(sf::Time dt, CommandQueue& commands);
 
 	sf::Vector2f			getWorldPosition() const;
-	sf::Transform			getWorldTransform() const;
+	const sf::Transform&	getWorldTransform() const;
+
+	// Hide sf::Transformable's mutators so every change invalidates the cached world transform of this
+	// node and its subtree
+	void					setPosition(float x, float y);
+	void					setPosition(const sf::Vector2f& position);
+	void					move(float offsetX, float offsetY);
+	void					move(const sf::Vector2f& offset);
+	void					setRotation(float angle);
+	void					rotate(float angle);
+	void					setScale(float factorX, float factorY);
+	void					setScale(const sf::Vector2f& factors);
+	void					scale(float factorX, float factorY);
+	void					scale(const sf::Vector2f& factor);
+	void					setOrigin(float x, float y);
+	void					setOrigin(const sf::Vector2f& origin);
 
 	void					onCommand(const Command& command, sf::Time dt);
 	virtual unsigned int	getCategory() const;
 
-	void					checkSceneCollision(SceneNode& sceneGraph, std::set<Pair>& collisionPairs);
-	void					checkNodeCollision(SceneNode& node, std::set<Pair>& collisionPairs);
-	void					removeWrecks();
+	// Detaches every listed node from its parent with one pass over each affected parent's children, keeping
+	// sibling order; the nodes end up in detached
+	static void				detachNodes(const std::vector<SceneNode*>& nodes, std::vector<Ptr>& detached);
+
 	virtual sf::FloatRect	getBoundingRect() const;
 	virtual bool			isMarkedForRemoval() const;
 	virtual bool			isDestroyed() const;
 
 
+protected:
+	// For nodes whose updateCurrent() has nothing to do. The update walk only visits children listed in
+	// mUpdatedChildren, so a subtree without anything to update costs nothing per frame
+	void					setUpdateCurrentEnabled(bool enabled);
+
+
+private:
+	static const std::size_t CategoryBits = sizeof(unsigned int) * 8;
+
+	struct CategoryIndex
+	{
+		std::array<SceneNode*, CategoryBits> first;
+		std::array<SceneNode*, CategoryBits> last;
+	};
+
+
 private:
 	virtual void			updateCurrent(sf::Time dt, CommandQueue& commands);
 	void					updateChildren(sf::Time dt, CommandQueue& commands);
@@ -54,11 +91,35 @@ private:
 	void					drawChildren(sf::RenderTarget& target, sf::RenderStates states) const;
 	void					drawBoundingRect(sf::RenderTarget& target, sf::RenderStates states) const;
 
+	void					invalidateWorldTransform();
+
+	bool					needsUpdate() const;
+	void					listForUpdate();
+
+	void					registerSubtree(CategoryIndex& index);
+	void					unregisterSubtree();
+	void					unlinkFromCategoryIndex();
+
 
 private:
+	std::unique_ptr<CategoryIndex> mCategoryIndex;	// root only; declared first, so children unlink before it goes
 	std::vector<Ptr>		mChildren;
+	std::vector<SceneNode*>	mUpdatedChildren;	// the children whose needsUpdate() was true once, attach order
 	SceneNode*				mParent;
 	Category::Type			mDefaultCategory;
+	bool					mDetachPending;		// set during detachNodes() only
+	bool					mUpdateCurrentEnabled;
+	bool					mListedForUpdate;	// in mParent->mUpdatedChildren
+
+	// Parent's world transform * own transform; a dirty node's subtree is dirty as well
+	mutable sf::Transform	mWorldTransform;
+	mutable bool			mWorldTransformDirty;
+
+	// Membership in the root's category index
+	CategoryIndex*			mIndex;
+	std::size_t				mIndexedBit;		// CategoryBits when not linked
+	SceneNode*				mPreviousInCategory;
+	SceneNode*				mNextInCategory;
 };
 
 bool	collision(const SceneNode& lhs, const SceneNode& rhs);
@@ -0,0 +1,83 @@
+#include "SendRate.hpp"
+
+#include <algorithm>
+
+
+namespace
+{
+	const float RateIncrease = 2.f;				// Hz per healthy round trip
+	const float QueueingDecrease = 0.85f;
+	const float LossDecrease = 0.7f;
+	const float BackpressureDecrease = 0.5f;
+
+	// A round trip this far above the base one means packets are waiting in a queue
+	const float QueueingFactor = 2.f;
+	const sf::Time QueueingSlack = sf::milliseconds(20);
+}
+
+SendRate::SendRate(float minRate, float maxRate, float initialRate)
+	: mMinRate(minRate)
+	, mMaxRate(maxRate)
+	, mRate(std::min(std::max(initialRate, minRate), maxRate))
+	, mRoundTripTime(sf::Time::Zero)
+	, mBaseRoundTripTime(sf::Time::Zero)
+	, mHasRoundTrip(false)
+{
+}
+
+void SendRate::addRoundTrip(sf::Time roundTrip)
+{
+	if (!mHasRoundTrip)
+	{
+		mRoundTripTime = roundTrip;
+		mBaseRoundTripTime = roundTrip;
+		mHasRoundTrip = true;
+	}
+	else
+	{
+		mRoundTripTime = mRoundTripTime * 0.875f + roundTrip * 0.125f;
+
+		// The base creeps towards newer samples, so a route that got slower for good stops counting as queuing
+		mBaseRoundTripTime = std::min(mBaseRoundTripTime + (roundTrip - mBaseRoundTripTime) / static_cast<sf::Int64>(64), roundTrip);
+	}
+
+	if (roundTrip > mBaseRoundTripTime * QueueingFactor + QueueingSlack)
+		decrease(QueueingDecrease);
+	else
+		increase();
+}
+
+void SendRate::addLoss()
+{
+	decrease(LossDecrease);
+}
+
+void SendRate::addBackpressure()
+{
+	decrease(BackpressureDecrease);
+}
+
+float SendRate::getRate() const
+{
+	return mRate;
+}
+
+sf::Time SendRate::getInterval() const
+{
+	return sf::seconds(1.f / mRate);
+}
+
+sf::Time SendRate::getRoundTripTime() const
+{
+	return mRoundTripTime;
+}
+
+void SendRate::increase()
+{
+	mRate = std::min(mRate + RateIncrease, mMaxRate);
+}
+
+void SendRate::decrease(float factor)
+{
+	mRate = std::max(mRate * factor, mMinRate);
+}
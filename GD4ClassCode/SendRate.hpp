@@ -0,0 +1,35 @@
+#pragma once
+
+#include <SFML/System/Time.hpp>
+
+
+// How often to send on one connection, between a minimum and a maximum rate in Hz. The rate grows additively
+// while the link looks healthy and shrinks multiplicatively on the first signs of congestion: round trips
+// well above the best one seen (packets queuing up somewhere), lost pings, or a socket that can't take more
+class SendRate
+{
+public:
+								SendRate(float minRate, float maxRate, float initialRate);
+
+	void						addRoundTrip(sf::Time roundTrip);
+	void						addLoss();
+	void						addBackpressure();
+
+	float						getRate() const;
+	sf::Time					getInterval() const;
+	sf::Time					getRoundTripTime() const;		// smoothed, zero before the first sample
+
+
+private:
+	void						increase();
+	void						decrease(float factor);
+
+
+private:
+	float						mMinRate;
+	float						mMaxRate;
+	float						mRate;
+	sf::Time					mRoundTripTime;
+	sf::Time					mBaseRoundTripTime;
+	bool						mHasRoundTrip;
+};
@@ -4,13 +4,20 @@
 SoundNode::SoundNode(SoundPlayer& player)
 	:SceneNode()
 	,mSounds(player)
+	,mMuted(false)
 {
 
 }
 
 void SoundNode::playSound(SoundEffect::ID sound, sf::Vector2f position)
 {
-	mSounds.play(sound, position);
+	if (!mMuted)
+		mSounds.play(sound, position);
+}
+
+void SoundNode::setMuted(bool flag)
+{
+	mMuted = flag;
 }
 
 unsigned int SoundNode::getCategory() const
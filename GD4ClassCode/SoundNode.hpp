@@ -9,9 +9,11 @@ class SoundNode : public SceneNode
 public:
 	explicit SoundNode(SoundPlayer& player);
 	void playSound(SoundEffect::ID sound, sf::Vector2f position);
+	void setMuted(bool flag);
 
 	virtual unsigned int getCategory() const;
 
 private:
 	SoundPlayer& mSounds;
+	bool mMuted;
 };
\ No newline at end of file
@@ -0,0 +1,126 @@
+#include "SpatialIndex.hpp"
+
+#include <cassert>
+#include <algorithm>
+#include <cmath>
+
+
+SpatialIndex::SpatialIndex(float cellSize)
+	: mCellSize(cellSize)
+	, mBounds()
+	, mColumns(0)
+	, mRows(0)
+	, mItems()
+	, mCells(1)
+{
+}
+
+void SpatialIndex::setBounds(const sf::FloatRect& bounds)
+{
+	mBounds = bounds;
+	mColumns = std::max(1, static_cast<int>(std::ceil(bounds.width / mCellSize)));
+	mRows = std::max(1, static_cast<int>(std::ceil(bounds.height / mCellSize)));
+
+	mCells.assign(mColumns * mRows + 1, std::vector<sf::Uint32>());
+	for (std::size_t id = 0; id < mItems.size(); ++id)
+	{
+		if (mItems[id].cell != NoItem)
+			link(id, getCell(mItems[id].x, mItems[id].y));
+	}
+}
+
+void SpatialIndex::add()
+{
+	Item item = { 0.f, 0.f, 0, NoItem, 0 };
+	mItems.push_back(item);
+}
+
+void SpatialIndex::remove(std::size_t id)
+{
+	assert(id < mItems.size());
+
+	if (mItems[id].cell != NoItem)
+		unlink(id);
+
+	// Same swap-remove as the owner's rows
+	std::size_t last = mItems.size() - 1;
+	if (id != last)
+	{
+		mItems[id] = mItems[last];
+		if (mItems[id].cell != NoItem)
+			mCells[mItems[id].cell][mItems[id].slot] = static_cast<sf::Uint32>(id);
+	}
+
+	mItems.pop_back();
+}
+
+void SpatialIndex::update(std::size_t id, sf::Vector2f position, unsigned int category)
+{
+	Item& item = mItems[id];
+	item.x = position.x;
+	item.y = position.y;
+	item.category = category;
+
+	sf::Uint32 cell = getCell(position.x, position.y);
+	if (cell == item.cell)
+		return;
+
+	if (item.cell != NoItem)
+		unlink(id);
+	link(id, cell);
+}
+
+sf::Uint32 SpatialIndex::getCell(float x, float y) const
+{
+	if (mColumns == 0)
+		return getOverflowCell();
+
+	float column = std::floor((x - mBounds.left) / mCellSize);
+	float row = std::floor((y - mBounds.top) / mCellSize);
+	if (column < 0.f || row < 0.f || column >= mColumns || row >= mRows)
+		return getOverflowCell();
+
+	return static_cast<sf::Uint32>(row) * mColumns + static_cast<sf::Uint32>(column);
+}
+
+sf::Uint32 SpatialIndex::getOverflowCell() const
+{
+	return static_cast<sf::Uint32>(mCells.size() - 1);
+}
+
+void SpatialIndex::link(std::size_t id, sf::Uint32 cell)
+{
+	std::vector<sf::Uint32>& items = mCells[cell];
+	mItems[id].cell = cell;
+	mItems[id].slot = static_cast<sf::Uint32>(items.size());
+	items.push_back(static_cast<sf::Uint32>(id));
+}
+
+void SpatialIndex::unlink(std::size_t id)
+{
+	// Order within a cell doesn't matter, fill the gap with the cell's last item
+	std::vector<sf::Uint32>& items = mCells[mItems[id].cell];
+	sf::Uint32 moved = items.back();
+	items[mItems[id].slot] = moved;
+	mItems[moved].slot = mItems[id].slot;
+	items.pop_back();
+
+	mItems[id].cell = NoItem;
+}
+
+float SpatialIndex::getRingDistance(sf::Vector2f position, int column, int row, int ring) const
+{
+	if (ring == 0)
+		return 0.f;
+
+	// The square of cells closer than ring; everything in the ring lies outside it
+	float left = mBounds.left + (column - ring + 1) * mCellSize;
+	float right = mBounds.left + (column + ring) * mCellSize;
+	float top = mBounds.top + (row - ring + 1) * mCellSize;
+	float bottom = mBounds.top + (row + ring) * mCellSize;
+
+	if (position.x < left || position.x > right || position.y < top || position.y > bottom)
+		return 0.f;
+
+	return std::min(std::min(position.x - left, right - position.x), std::min(position.y - top, bottom - position.y));
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <SFML/Config.hpp>
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include <limits>
+#include <vector>
+
+
+// Uniform grid over items identified by dense ids (EntityStore rows). An item changes cells only when it crosses
+// a cell border, removal is O(1), and queries visit the cells around the query point nearest first. Items
+// outside the bounds share one overflow list every query scans; those are entities about to leave anyway
+class SpatialIndex
+{
+public:
+	static const sf::Uint32				NoItem = std::numeric_limits<sf::Uint32>::max();
+
+
+public:
+	explicit							SpatialIndex(float cellSize);
+
+	// Re-buckets every item
+	void								setBounds(const sf::FloatRect& bounds);
+
+	// Mirror the owner's rows: add() appends an item not in any cell yet, remove() moves the last item into the gap
+	void								add();
+	void								remove(std::size_t id);
+	void								update(std::size_t id, sf::Vector2f position, unsigned int category);
+
+	// Nearest item in categoryMask that accept(id) agrees to, NoItem if none. Equal distances go to the smaller
+	// x, then y, so the answer doesn't depend on the order items entered their cells
+	template <typename Accept>
+	sf::Uint32							findNearest(sf::Vector2f position, unsigned int categoryMask, Accept accept) const;
+
+	// Calls visit(id) for every item in categoryMask within radius, in no particular order
+	template <typename Visitor>
+	void								forEachInRadius(sf::Vector2f position, float radius, unsigned int categoryMask, Visitor visit) const;
+
+
+private:
+	struct Item
+	{
+		float							x;
+		float							y;
+		unsigned int					category;
+		sf::Uint32						cell;			// NoItem until the first update()
+		sf::Uint32						slot;			// index in the cell's list
+	};
+
+
+private:
+	sf::Uint32							getCell(float x, float y) const;
+	sf::Uint32							getOverflowCell() const;
+	void								link(std::size_t id, sf::Uint32 cell);
+	void								unlink(std::size_t id);
+
+	// Distance from position to the nearest cell ring cells away from (column, row), 0 if position isn't in the grid
+	float								getRingDistance(sf::Vector2f position, int column, int row, int ring) const;
+
+
+private:
+	float								mCellSize;
+	sf::FloatRect						mBounds;
+	int									mColumns;
+	int									mRows;
+	std::vector<Item>					mItems;
+	std::vector<std::vector<sf::Uint32>> mCells;		// mColumns * mRows, then the overflow list
+};
+
+#include "SpatialIndex.inl"
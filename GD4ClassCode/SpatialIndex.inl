@@ -0,0 +1,118 @@
+#include "Foreach.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+
+template <typename Accept>
+sf::Uint32 SpatialIndex::findNearest(sf::Vector2f position, unsigned int categoryMask, Accept accept) const
+{
+	sf::Uint32 best = NoItem;
+	float bestDistanceSquared = std::numeric_limits<float>::max();
+
+	auto consider = [&](sf::Uint32 id)
+	{
+		const Item& item = mItems[id];
+		if (!(item.category & categoryMask))
+			return;
+
+		float dx = item.x - position.x;
+		float dy = item.y - position.y;
+		float distanceSquared = dx * dx + dy * dy;
+
+		bool closer = distanceSquared < bestDistanceSquared;
+		if (!closer && distanceSquared == bestDistanceSquared && best != NoItem)
+		{
+			const Item& current = mItems[best];
+			closer = item.x < current.x || (item.x == current.x && item.y < current.y);
+		}
+
+		// accept() may be costly, ask only for improvements
+		if (closer && accept(id))
+		{
+			best = id;
+			bestDistanceSquared = distanceSquared;
+		}
+	};
+
+	FOREACH(sf::Uint32 id, mCells[getOverflowCell()])
+		consider(id);
+
+	if (mColumns == 0)
+		return best;
+
+	int column = std::max(0, std::min(mColumns - 1, static_cast<int>(std::floor((position.x - mBounds.left) / mCellSize))));
+	int row = std::max(0, std::min(mRows - 1, static_cast<int>(std::floor((position.y - mBounds.top) / mCellSize))));
+	int maxRing = std::max(std::max(column, mColumns - 1 - column), std::max(row, mRows - 1 - row));
+
+	for (int ring = 0; ring <= maxRing; ++ring)
+	{
+		// Nothing in this ring or further out can beat what we have
+		if (best != NoItem)
+		{
+			float ringDistance = getRingDistance(position, column, row, ring);
+			if (ringDistance * ringDistance > bestDistanceSquared)
+				break;
+		}
+
+		int top = std::max(0, row - ring);
+		int bottom = std::min(mRows - 1, row + ring);
+		int left = std::max(0, column - ring);
+		int right = std::min(mColumns - 1, column + ring);
+
+		for (int y = top; y <= bottom; ++y)
+		{
+			for (int x = left; x <= right; ++x)
+			{
+				// The inside was covered by the smaller rings
+				if (std::abs(x - column) != ring && std::abs(y - row) != ring)
+					continue;
+
+				FOREACH(sf::Uint32 id, mCells[y * mColumns + x])
+					consider(id);
+			}
+		}
+	}
+
+	return best;
+}
+
+template <typename Visitor>
+void SpatialIndex::forEachInRadius(sf::Vector2f position, float radius, unsigned int categoryMask, Visitor visit) const
+{
+	float radiusSquared = radius * radius;
+
+	auto consider = [&](sf::Uint32 id)
+	{
+		const Item& item = mItems[id];
+		if (!(item.category & categoryMask))
+			return;
+
+		float dx = item.x - position.x;
+		float dy = item.y - position.y;
+		if (dx * dx + dy * dy <= radiusSquared)
+			visit(id);
+	};
+
+	FOREACH(sf::Uint32 id, mCells[getOverflowCell()])
+		consider(id);
+
+	if (mColumns == 0)
+		return;
+
+	// Cells the circle's bounding box touches
+	int left = std::max(0, static_cast<int>(std::floor((position.x - radius - mBounds.left) / mCellSize)));
+	int right = std::min(mColumns - 1, static_cast<int>(std::floor((position.x + radius - mBounds.left) / mCellSize)));
+	int top = std::max(0, static_cast<int>(std::floor((position.y - radius - mBounds.top) / mCellSize)));
+	int bottom = std::min(mRows - 1, static_cast<int>(std::floor((position.y + radius - mBounds.top) / mCellSize)));
+
+	for (int y = top; y <= bottom; ++y)
+	{
+		for (int x = left; x <= right; ++x)
+		{
+			FOREACH(sf::Uint32 id, mCells[y * mColumns + x])
+				consider(id);
+		}
+	}
+}
@@ -0,0 +1,389 @@
+#include "SpectatorRelay.hpp"
+#include "NetworkProtocol.hpp"
+#include "Foreach.hpp"
+
+#include <SFML/System/Sleep.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+
+namespace
+{
+	// A spectator this far behind is dropped, it would only fall further behind
+	const std::size_t MaxQueuedFrames = 512;
+
+	const sf::Time ReconnectInterval = sf::seconds(2.f);
+	const sf::Time ConnectTimeout = sf::seconds(1.f);
+
+	// Keeps spectators connected while the server is away (they give up after 2 seconds of silence)
+	const sf::Time HeartbeatInterval = sf::seconds(0.5f);
+
+	const sf::Time StatisticsInterval = sf::seconds(5.f);
+}
+
+SpectatorRelay::Spectator::Spectator()
+	: socket()
+	, queue()
+	, offset(0)
+{
+	socket.setBlocking(false);
+}
+
+SpectatorRelay::SpectatorRelay(sf::IpAddress serverAddress, unsigned short serverPort, sf::Time delay)
+	: mThread(&SpectatorRelay::executionThread, this)
+	, mWaitingThreadEnd(false)
+	, mServerAddress(serverAddress)
+	, mServerPort(serverPort)
+	, mDelay(delay)
+	, mUpstream()
+	, mUpstreamConnecting(false)
+	, mUpstreamConnected(false)
+	, mLastConnectAttempt(sf::Time::Zero)
+	, mDelayedPackets()
+	, mCharacters()
+	, mPickupSchedule()
+	, mSpectators()
+	, mPendingSpectator(new Spectator())
+	, mLastBroadcastTime(sf::Time::Zero)
+	, mLastStatisticsReport(sf::Time::Zero)
+	, mFramesSent(0)
+	, mBytesQueued(0)
+	, mBytesSent(0)
+{
+	mListenerSocket.setBlocking(false);
+	if (mListenerSocket.listen(SpectatorRelayPort) != sf::TcpListener::Done)
+		std::cout << "Relay: can't listen on port " << SpectatorRelayPort << std::endl;
+
+	mThread.launch();
+}
+
+SpectatorRelay::~SpectatorRelay()
+{
+	mWaitingThreadEnd = true;
+	mThread.wait();
+}
+
+void SpectatorRelay::executionThread()
+{
+	while (!mWaitingThreadEnd)
+	{
+		updateUpstream();
+		releaseDelayedPackets();
+		handleIncomingSpectators();
+		flushSpectators();
+		reportStatistics();
+
+		sf::sleep(sf::milliseconds(5));
+	}
+}
+
+void SpectatorRelay::updateUpstream()
+{
+	if (!mUpstreamConnected)
+	{
+		if (!mUpstreamConnecting)
+		{
+			if (mLastConnectAttempt != sf::Time::Zero && now() < mLastConnectAttempt + ReconnectInterval)
+				return;
+
+			// Non-blocking, so spectators keep being served while the server is away; polled on later iterations
+			mLastConnectAttempt = now();
+			mUpstream.setBlocking(false);
+			sf::Socket::Status status = mUpstream.connect(mServerAddress, mServerPort + SubscriberPortOffset);
+			if (status != sf::Socket::Done && status != sf::Socket::NotReady)
+				return;
+
+			mUpstreamConnecting = true;
+		}
+
+		// The peer address is only known once the connect succeeded
+		if (mUpstream.getRemoteAddress() == sf::IpAddress::None)
+		{
+			// Refused or unanswered: give up, the next attempt starts ReconnectInterval after this one did
+			if (now() >= mLastConnectAttempt + ConnectTimeout)
+			{
+				mUpstream.disconnect();
+				mUpstreamConnecting = false;
+			}
+			return;
+		}
+
+		mUpstreamConnecting = false;
+		mUpstreamConnected = true;
+		std::cout << "Relay: subscribed to " << mServerAddress.toString() << ":" << mServerPort << std::endl;
+	}
+
+	sf::Packet packet;
+	sf::Socket::Status status;
+	while ((status = mUpstream.receive(packet)) == sf::Socket::Done)
+	{
+		DelayedPacket delayed = { now() + mDelay, packet };
+		mDelayedPackets.push_back(delayed);
+		packet.clear();
+	}
+
+	if (status == sf::Socket::Disconnected || status == sf::Socket::Error)
+	{
+		// The server's next InitialState is turned into connects/disconnects, spectators stay
+		std::cout << "Relay: lost the server, reconnecting" << std::endl;
+		mUpstream.disconnect();
+		mUpstreamConnected = false;
+	}
+}
+
+void SpectatorRelay::releaseDelayedPackets()
+{
+	while (!mDelayedPackets.empty() && now() >= mDelayedPackets.front().releaseTime)
+	{
+		handlePacket(mDelayedPackets.front().packet);
+		mDelayedPackets.pop_front();
+	}
+
+	if (now() >= mLastBroadcastTime + HeartbeatInterval)
+	{
+		sf::Packet heartbeat;
+		heartbeat << static_cast<sf::Int32>(Server::Heartbeat);
+		broadcast(heartbeat);
+	}
+}
+
+void SpectatorRelay::handlePacket(sf::Packet& packet)
+{
+	// Read from a copy, the original goes out unchanged
+	sf::Packet reader = packet;
+	sf::Int32 packetType;
+	reader >> packetType;
+
+	switch (packetType)
+	{
+	// Only at subscription: turn it into the difference to what the spectators already have
+	case Server::InitialState:
+	{
+		sf::Int32 version, count;
+		reader >> version >> count;
+		if (!reader || version != WorldSnapshot::Version)
+		{
+			std::cout << "Relay: server runs an incompatible version" << std::endl;
+			return;
+		}
+
+		std::map<sf::Int32, CharacterState> characters;
+		for (sf::Int32 i = 0; i < count && reader; ++i)
+		{
+			sf::Int32 identifier;
+			CharacterState state;
+			reader >> identifier >> state.position.x >> state.position.y >> state.hitpoints >> state.missileAmmo >> state.knockback >> state.survivability;
+			characters[identifier] = state;
+		}
+
+		FOREACH(auto& character, mCharacters)
+		{
+			if (characters.find(character.first) == characters.end())
+				broadcast(sf::Packet() << static_cast<sf::Int32>(Server::PlayerDisconnect) << character.first);
+		}
+
+		FOREACH(auto& character, characters)
+		{
+			if (mCharacters.find(character.first) == mCharacters.end())
+				broadcast(sf::Packet() << static_cast<sf::Int32>(Server::PlayerConnect) << character.first << character.second.position.x << character.second.position.y);
+		}
+
+		mCharacters = characters;
+
+		sf::Packet update;
+		update << static_cast<sf::Int32>(Server::UpdateClientState) << static_cast<sf::Int32>(mCharacters.size());
+		FOREACH(auto& character, mCharacters)
+			update << character.first << character.second.position.x << character.second.position.y << character.second.hitpoints << character.second.missileAmmo << character.second.knockback << character.second.survivability;
+		broadcast(update);
+	} break;
+
+	case Server::PlayerConnect:
+	{
+		sf::Int32 identifier;
+		CharacterState state = { sf::Vector2f(), 100, 2, 0.f, 0 };
+		reader >> identifier >> state.position.x >> state.position.y;
+		mCharacters[identifier] = state;
+		broadcast(packet);
+	} break;
+
+	case Server::PlayerDisconnect:
+	{
+		sf::Int32 identifier;
+		reader >> identifier;
+		mCharacters.erase(identifier);
+		broadcast(packet);
+	} break;
+
+	case Server::UpdateClientState:
+	{
+		sf::Int32 count;
+		reader >> count;
+		for (sf::Int32 i = 0; i < count && reader; ++i)
+		{
+			sf::Int32 identifier;
+			CharacterState state;
+			reader >> identifier >> state.position.x >> state.position.y >> state.hitpoints >> state.missileAmmo >> state.knockback >> state.survivability;
+
+			auto found = mCharacters.find(identifier);
+			if (reader && found != mCharacters.end())
+				found->second = state;
+		}
+		broadcast(packet);
+	} break;
+
+	// Same characters, fresh state. The last round's schedule is dropped, late spectators get the next resync
+	case Server::RoundReset:
+	{
+		sf::Uint32 seed;
+		sf::Int32 meanInterval, count;
+		reader >> seed >> meanInterval >> count;
+		for (sf::Int32 i = 0; i < count && reader; ++i)
+		{
+			sf::Int32 identifier;
+			CharacterState state = { sf::Vector2f(), 100, 2, 0.f, 0 };
+			reader >> identifier >> state.position.x >> state.position.y;
+			if (reader)
+				mCharacters[identifier] = state;
+		}
+		mPickupSchedule.reset();
+		broadcast(packet);
+	} break;
+
+	// Kept for late spectators; their pickup timer may be off until the server's next resync (10 s)
+	case Server::PickupSchedule:
+	{
+		mPickupSchedule = encode(packet);
+		broadcast(packet);
+	} break;
+
+	case Server::BroadcastMessage:
+	case Server::PlayerEvent:
+	case Server::PlayerRealtimeChange:
+	{
+		broadcast(packet);
+	} break;
+
+	default:
+		break;
+	}
+}
+
+void SpectatorRelay::handleIncomingSpectators()
+{
+	Frame initialState;
+
+	while (mListenerSocket.accept(mPendingSpectator->socket) == sf::TcpListener::Done)
+	{
+		// Built once for everyone accepted in this batch
+		if (!initialState)
+			initialState = encode(buildInitialState());
+
+		mPendingSpectator->queue.push_back(initialState);
+		if (mPickupSchedule)
+			mPendingSpectator->queue.push_back(mPickupSchedule);
+
+		mSpectators.push_back(std::move(mPendingSpectator));
+		mPendingSpectator.reset(new Spectator());
+	}
+}
+
+void SpectatorRelay::flushSpectators()
+{
+	for (auto itr = mSpectators.begin(); itr != mSpectators.end(); )
+	{
+		Spectator& spectator = **itr;
+		bool dropped = false;
+
+		while (!spectator.queue.empty())
+		{
+			const std::vector<char>& frame = *spectator.queue.front();
+			std::size_t sent = 0;
+			sf::Socket::Status status = spectator.socket.send(frame.data() + spectator.offset, frame.size() - spectator.offset, sent);
+
+			spectator.offset += sent;
+			mBytesSent += sent;
+
+			if (spectator.offset == frame.size())
+			{
+				spectator.queue.pop_front();
+				spectator.offset = 0;
+			}
+			else
+			{
+				dropped = (status == sf::Socket::Disconnected || status == sf::Socket::Error);
+				break;
+			}
+		}
+
+		// Spectators never send anything, reading only tells whether they left
+		char buffer[64];
+		std::size_t received = 0;
+		sf::Socket::Status status = spectator.socket.receive(buffer, sizeof(buffer), received);
+		dropped |= (status == sf::Socket::Disconnected || status == sf::Socket::Error);
+		dropped |= (spectator.queue.size() > MaxQueuedFrames);
+
+		if (dropped)
+			itr = mSpectators.erase(itr);
+		else
+			++itr;
+	}
+}
+
+void SpectatorRelay::broadcast(const sf::Packet& packet)
+{
+	Frame frame = encode(packet);
+
+	FOREACH(SpectatorPtr& spectator, mSpectators)
+		spectator->queue.push_back(frame);
+
+	mFramesSent++;
+	mBytesQueued += frame->size() * mSpectators.size();
+	mLastBroadcastTime = now();
+}
+
+sf::Packet SpectatorRelay::buildInitialState() const
+{
+	sf::Packet packet;
+	packet << static_cast<sf::Int32>(Server::InitialState) << WorldSnapshot::Version << static_cast<sf::Int32>(mCharacters.size());
+
+	FOREACH(const auto& character, mCharacters)
+		packet << character.first << character.second.position.x << character.second.position.y << character.second.hitpoints << character.second.missileAmmo << character.second.knockback << character.second.survivability;
+
+	packet << false;
+	return packet;
+}
+
+void SpectatorRelay::reportStatistics()
+{
+	if (now() < mLastStatisticsReport + StatisticsInterval)
+		return;
+
+	float seconds = (now() - mLastStatisticsReport).asSeconds();
+	std::cout << "Relay: " << mSpectators.size() << " spectators, " << static_cast<int>(mFramesSent / seconds) << " frames/s encoded, "
+		<< static_cast<int>(mBytesSent / seconds / 1024.f) << " KB/s sent (" << static_cast<int>(mBytesQueued / seconds / 1024.f) << " KB/s queued)" << std::endl;
+
+	mLastStatisticsReport = now();
+	mFramesSent = mBytesQueued = mBytesSent = 0;
+}
+
+sf::Time SpectatorRelay::now() const
+{
+	return mClock.getElapsedTime();
+}
+
+SpectatorRelay::Frame SpectatorRelay::encode(const sf::Packet& packet)
+{
+	// Same framing sf::TcpSocket uses for packets: 32-bit big endian size, then the data
+	sf::Uint32 size = static_cast<sf::Uint32>(packet.getDataSize());
+	std::shared_ptr<std::vector<char>> frame(new std::vector<char>(4 + size));
+
+	(*frame)[0] = static_cast<char>((size >> 24) & 0xFF);
+	(*frame)[1] = static_cast<char>((size >> 16) & 0xFF);
+	(*frame)[2] = static_cast<char>((size >> 8) & 0xFF);
+	(*frame)[3] = static_cast<char>(size & 0xFF);
+	if (size > 0)
+		std::copy(static_cast<const char*>(packet.getData()), static_cast<const char*>(packet.getData()) + size, frame->begin() + 4);
+
+	return frame;
+}
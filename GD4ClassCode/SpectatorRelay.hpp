@@ -0,0 +1,101 @@
+#pragma once
+
+#include <SFML/System/Clock.hpp>
+#include <SFML/System/Thread.hpp>
+#include <SFML/System/Vector2.hpp>
+#include <SFML/Network/IpAddress.hpp>
+#include <SFML/Network/Packet.hpp>
+#include <SFML/Network/TcpListener.hpp>
+#include <SFML/Network/TcpSocket.hpp>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+
+// Fans one match out to any number of spectators. The relay subscribes to a GameServer's read-only stream
+// (port + SubscriberPortOffset), holds every packet back for the configured delay, then frames it once and
+// queues the same bytes for every spectator. The server sends to one relay no matter how many watch.
+// Late spectators get an InitialState built from the relay's own copy of the (delayed) character states
+class SpectatorRelay
+{
+public:
+								SpectatorRelay(sf::IpAddress serverAddress, unsigned short serverPort, sf::Time delay);
+								~SpectatorRelay();
+
+
+private:
+	// One packet in wire format (size prefix + data), shared by the queues of all spectators
+	typedef std::shared_ptr<const std::vector<char>> Frame;
+
+	struct Spectator
+	{
+								Spectator();
+
+		sf::TcpSocket			socket;
+		std::deque<Frame>		queue;
+		std::size_t				offset;				// bytes of queue.front() already sent
+	};
+
+	struct DelayedPacket
+	{
+		sf::Time				releaseTime;
+		sf::Packet				packet;
+	};
+
+	struct CharacterState
+	{
+		sf::Vector2f			position;
+		sf::Int32				hitpoints;
+		sf::Int32				missileAmmo;
+		float					knockback;
+		sf::Int32				survivability;
+	};
+
+	typedef std::unique_ptr<Spectator> SpectatorPtr;
+
+
+private:
+	void						executionThread();
+	void						updateUpstream();
+	void						releaseDelayedPackets();
+	void						handlePacket(sf::Packet& packet);
+	void						handleIncomingSpectators();
+	void						flushSpectators();
+	void						broadcast(const sf::Packet& packet);
+	sf::Packet					buildInitialState() const;
+	void						reportStatistics();
+	sf::Time					now() const;
+
+	static Frame				encode(const sf::Packet& packet);
+
+
+private:
+	sf::Thread					mThread;
+	sf::Clock					mClock;
+	bool						mWaitingThreadEnd;
+
+	sf::IpAddress				mServerAddress;
+	unsigned short				mServerPort;
+	sf::Time					mDelay;
+	sf::TcpSocket				mUpstream;
+	bool						mUpstreamConnecting;	// non-blocking connect in progress
+	bool						mUpstreamConnected;
+	sf::Time					mLastConnectAttempt;
+	std::deque<DelayedPacket>	mDelayedPackets;
+
+	// Match as the spectators currently see it (after the delay)
+	std::map<sf::Int32, CharacterState> mCharacters;
+	Frame						mPickupSchedule;
+
+	sf::TcpListener				mListenerSocket;
+	std::vector<SpectatorPtr>	mSpectators;
+	SpectatorPtr				mPendingSpectator;
+	sf::Time					mLastBroadcastTime;
+
+	sf::Time					mLastStatisticsReport;
+	std::size_t					mFramesSent;
+	std::size_t					mBytesQueued;
+	std::size_t					mBytesSent;
+};
@@ -19,6 +19,12 @@ namespace States
 		HostGame,
 		JoinGame,
 		Options,
-		HighScore
+		HighScore,
+		LockstepHost,
+		LockstepJoin,
+		Replay,
+		Spectate,
+		RematchDraw,		// results screens that offer a rematch besides MissionSuccess1/2
+		RematchGameOver
 	};
 }
@@ -82,10 +82,17 @@ void StateStack::applyPendingChanges()
 			break;
 
 		case Pop:
+			mStack.back()->onDestroy();
 			mStack.pop_back();
+
+			if (!mStack.empty())
+				mStack.back()->onActivate();
 			break;
 
 		case Clear:
+			FOREACH(State::Ptr& state, mStack)
+				state->onDestroy();
+
 			mStack.clear();
 			break;
 		}
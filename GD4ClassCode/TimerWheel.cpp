@@ -0,0 +1,99 @@
+#include "TimerWheel.hpp"
+#include "Foreach.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+
+TimerWheel::TimerWheel(sf::Time resolution)
+	: mResolution(resolution)
+	, mCurrentStep(0)
+	, mNextId(NoTimer + 1)
+	, mTimerCount(0)
+	, mCancelled()
+	, mSlots()
+{
+	assert(resolution > sf::Time::Zero);
+}
+
+TimerWheel::TimerId TimerWheel::schedule(sf::Time delay, Callback callback)
+{
+	// Round up and count from the end of the current step, so a timer never fires early
+	sf::Int64 steps = (std::max(delay, sf::Time::Zero).asMicroseconds() + mResolution.asMicroseconds() - 1) / mResolution.asMicroseconds();
+
+	Timer timer = { mNextId++, mCurrentStep + 1 + steps, callback };
+	if (mNextId == NoTimer)
+		mNextId++;
+
+	TimerId id = timer.id;
+	insert(timer);
+	mTimerCount++;
+	return id;
+}
+
+void TimerWheel::cancel(TimerId timer)
+{
+	if (timer != NoTimer)
+		mCancelled.insert(timer);
+}
+
+void TimerWheel::advance(sf::Time now)
+{
+	sf::Uint64 targetStep = static_cast<sf::Uint64>(now.asMicroseconds() / mResolution.asMicroseconds());
+
+	while (mCurrentStep < targetStep)
+	{
+		mCurrentStep++;
+
+		// Higher levels first, so timers cascaded into a lower slot that is due right now are cascaded again
+		for (unsigned int level = LevelCount - 1; level > 0; --level)
+		{
+			if ((mCurrentStep & ((sf::Uint64(1) << (BitsPerLevel * level)) - 1)) == 0)
+				cascade(level);
+		}
+
+		// Everything left in the level 0 slot is due now; take the slot first, callbacks may schedule into it
+		Slot due;
+		due.swap(mSlots[mCurrentStep & (SlotsPerLevel - 1)]);
+
+		FOREACH(Timer& timer, due)
+		{
+			mTimerCount--;
+
+			auto cancelled = mCancelled.find(timer.id);
+			if (cancelled != mCancelled.end())
+				mCancelled.erase(cancelled);
+			else
+				timer.callback();
+		}
+	}
+}
+
+std::size_t TimerWheel::getTimerCount() const
+{
+	return mTimerCount - mCancelled.size();
+}
+
+void TimerWheel::insert(Timer timer)
+{
+	// Lowest level whose revolution still contains the deadline
+	unsigned int level = 0;
+	while (level + 1 < LevelCount && (timer.deadline >> (BitsPerLevel * (level + 1))) != (mCurrentStep >> (BitsPerLevel * (level + 1))))
+		level++;
+
+	// Beyond the top level's range: park it in the last slot, it is re-inserted when that slot cascades
+	sf::Uint64 maxDeadline = mCurrentStep + (sf::Uint64(1) << (BitsPerLevel * LevelCount)) - 1;
+	sf::Uint64 slotDeadline = std::min(timer.deadline, maxDeadline);
+
+	std::size_t slot = (slotDeadline >> (BitsPerLevel * level)) & (SlotsPerLevel - 1);
+	mSlots[level * SlotsPerLevel + slot].push_back(timer);
+}
+
+void TimerWheel::cascade(unsigned int level)
+{
+	Slot moved;
+	moved.swap(mSlots[level * SlotsPerLevel + ((mCurrentStep >> (BitsPerLevel * level)) & (SlotsPerLevel - 1))]);
+
+	FOREACH(Timer& timer, moved)
+		insert(timer);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <SFML/Config.hpp>
+#include <SFML/System/Time.hpp>
+
+#include <array>
+#include <functional>
+#include <set>
+#include <vector>
+
+
+// Hierarchical timer wheel: scheduling is O(1), and advancing only touches the slots whose
+// time has come, so thousands of mostly idle timers (peer timeouts, keepalives) cost nothing until they fire.
+// Level 0 has one slot per resolution step; each higher level covers a whole revolution of the one below
+// and its timers are cascaded down when that revolution completes
+class TimerWheel
+{
+public:
+	typedef sf::Uint32				TimerId;
+	typedef std::function<void()>	Callback;
+
+	static const TimerId			NoTimer = 0;
+
+
+public:
+	explicit						TimerWheel(sf::Time resolution);
+
+	// Callbacks run from advance() and may schedule or cancel timers themselves; only cancel pending timers
+	TimerId							schedule(sf::Time delay, Callback callback);
+	void							cancel(TimerId timer);
+	void							advance(sf::Time now);
+
+	std::size_t						getTimerCount() const;
+
+
+private:
+	static const unsigned int		BitsPerLevel = 6;
+	static const unsigned int		SlotsPerLevel = 1 << BitsPerLevel;
+	static const unsigned int		LevelCount = 4;		// 64^4 steps, a bit over 46 hours at 10 ms
+
+	struct Timer
+	{
+		TimerId						id;
+		sf::Uint64					deadline;			// in resolution steps
+		Callback					callback;
+	};
+
+	typedef std::vector<Timer>		Slot;
+
+
+private:
+	void							insert(Timer timer);
+	void							cascade(unsigned int level);
+
+
+private:
+	sf::Time						mResolution;
+	sf::Uint64						mCurrentStep;
+	TimerId							mNextId;
+	std::size_t						mTimerCount;
+	std::set<TimerId>				mCancelled;			// removed lazily when their slot comes up
+	std::array<Slot, SlotsPerLevel * LevelCount> mSlots;
+};
@@ -12,13 +12,18 @@
 
 namespace
 {
-	std::default_random_engine createRandomEngine()
+	// mt19937's sequence is fixed by the standard, unlike default_random_engine's.
+	// Seed and draw count are tracked, so a position in the sequence can be stored compactly (replays)
+	RandomState createRandomState()
 	{
-		auto seed = static_cast<unsigned long>(std::time(nullptr));
-		return std::default_random_engine(seed);
+		RandomState state;
+		state.seed = static_cast<unsigned int>(std::time(nullptr));
+		state.draws = 0;
+		state.engine.seed(state.seed);
+		return state;
 	}
 
-	auto RandomEngine = createRandomEngine();
+	RandomState Random = createRandomState();
 }
 
 std::string toString(sf::Keyboard::Key key)
@@ -164,10 +169,40 @@ float toRadian(float degree)
 	return 3.141592653589793238462643383f / 180.f * degree;
 }
 
+void setRandomSeed(unsigned int seed)
+{
+	Random.seed = seed;
+	Random.draws = 0;
+	Random.engine.seed(seed);
+}
+
+void saveRandomState(RandomState& out)
+{
+	out = Random;
+}
+
+void restoreRandomState(const RandomState& state)
+{
+	Random = state;
+}
+
+void rebuildRandomEngine(RandomState& state)
+{
+	state.engine.seed(state.seed);
+	state.engine.discard(state.draws);
+}
+
+unsigned int getRandomDrawCount()
+{
+	return Random.draws;
+}
+
 int randomInt(int exclusiveMax)
 {
-	std::uniform_int_distribution<> distr(0, exclusiveMax - 1);
-	return distr(RandomEngine);
+	// Plain modulo instead of uniform_int_distribution, whose algorithm differs between standard libraries
+	assert(exclusiveMax > 0);
+	Random.draws++;
+	return static_cast<int>(Random.engine() % static_cast<unsigned int>(exclusiveMax));
 }
 
 float length(sf::Vector2f vector)
@@ -2,6 +2,7 @@
 #include <SFML/Window/Keyboard.hpp>
 #include <SFML/System/Vector2.hpp>
 #include <sstream>
+#include <random>
 
 namespace sf
 {
@@ -28,9 +29,26 @@ void			centerOrigin(Animation& animation);
 float			toDegree(float radian);
 float			toRadian(float degree);
 
-// Random number generation
+// Random number generation; seeding makes the sequence reproducible (lockstep, replays)
+void			setRandomSeed(unsigned int seed);
 int				randomInt(int exclusiveMax);
 
+// Full generator state, so rollback can rewind the random sequence along with the world.
+// seed + draws identify the same position compactly; rebuildRandomEngine() recreates the engine from them
+struct RandomState
+{
+	std::mt19937	engine;
+	unsigned int	seed;
+	unsigned int	draws;
+};
+
+void			saveRandomState(RandomState& out);
+void			restoreRandomState(const RandomState& state);
+void			rebuildRandomEngine(RandomState& state);
+
+// Numbers drawn since the last seeding; cheaper than a full saveRandomState() when only the position matters
+unsigned int	getRandomDrawCount();
+
 // Vector operations
 float			length(sf::Vector2f vector);
 sf::Vector2f	unitVector(sf::Vector2f vector);
@@ -7,10 +7,13 @@
 #include "ParticleNode.hpp"
 #include "SoundNode.hpp"
 #include "NetworkNode.hpp"
+#include "EmitterNode.hpp"
+#include "ObjectPool.hpp"
 #include "Utility.hpp"
 #include <SFML/Graphics/RenderTarget.hpp>
 
 #include <algorithm>
+#include <cassert>
 #include <cmath>
 #include <limits>
 
@@ -22,48 +25,60 @@ World::World(sf::RenderTarget& outputTarget, FontHolder& fonts, SoundPlayer& sou
 	, mTextures()
 	, mFonts(fonts)
 	, mSounds(sounds)
+	, mEntities()
 	, mSceneGraph()
 	, mSceneLayers()
+	, mBroadphase(64.f)
+	, mCollisionPairs()
+	, mCollisionTypes()
+	, mContacts()
+	, mContactRuns()
 	, mWorldBounds(0.f, 0.f, mWorldView.getSize().x, mWorldView.getSize().y)
 	, mSpawnPosition(mWorldView.getSize().x / 2.f, mWorldBounds.height - mWorldView.getSize().y / 2.f)
 	, mPlayerCharacters()
-	, mActivePlayers()
 	, mNetworkedWorld(networked)
 	, mNetworkNode(nullptr)
+	, mSoundNode(nullptr)
 	, mFinishSprite(nullptr)
 	, mGravity(0.f, 250.f)
 {
 	mSceneTexture.create(mTarget.getSize().x, mTarget.getSize().y);
 
 	loadTextures();
+	mSceneGraph.enableCategoryIndex();
 	buildScene();
+	mEntities.setSpatialBounds(mWorldBounds);
+
+	// Single player seeds its own pickup schedule, networked worlds wait for the server's
+	if (!mNetworkedWorld)
+		seedPickupSchedule();
 
 	// Prepare the view
 	mWorldView.setCenter(mSpawnPosition);
 }
 
+World::~World()
+{
+	// Peaks tell whether the pools' chunk size fits a match; debug builds only, players don't need them
+#ifndef NDEBUG
+	ObjectPool<Projectile>::instance().printStatistics("Projectile");
+	ObjectPool<EmitterNode>::instance().printStatistics("EmitterNode");
+	ObjectPool<Pickup>::instance().printStatistics("Pickup");
+#endif
+}
+
 bool World::mShadersEnabled = true;
 
-bool matchesCategories(SceneNode::Pair& colliders, Category::Type type1, Category::Type type2)
+// Indexed by ContactType
+const World::ContactRule World::ContactRules[World::ContactTypeCount] =
 {
-	unsigned int category1 = colliders.first->getCategory();
-	unsigned int category2 = colliders.second->getCategory();
-
-	// Make sure first pair entry has category type1 and second has type2
-	if (type1 & category1 && type2 & category2)
-	{
-		return true;
-	}
-	else if (type1 & category2 && type2 & category1)
-	{
-		std::swap(colliders.first, colliders.second);
-		return true;
-	}
-	else
-	{
-		return false;
-	}
-}
+	{ World::ImpactContacts,	Category::PlayerCharacter,	Category::PlayerCharacter },
+	{ World::ImpactContacts,	Category::PlayerCharacter,	Category::Pickup },
+	{ World::ImpactContacts,	Category::PlayerCharacter,	Category::AlliedProjectile },
+	{ World::SupportContacts,	Category::PlayerCharacter,	Category::Platform },
+	{ World::SupportContacts,	Category::Pickup,			Category::Platform },
+	{ World::SupportContacts,	Category::Projectile,		Category::Platform },
+};
 
 void World::update(sf::Time dt)
 {
@@ -76,21 +91,20 @@ void World::update(sf::Time dt)
 			a->accelerate(mGravity);
 		}
 	}
-	//spawn pickups only if in single player
-	if (!mNetworkedWorld) {
-		if (randomInt(1000) == 0) {
-			sf::Vector2f pos = sf::Vector2f(randomInt(600)+200, 10);
-			auto type = static_cast<Pickup::Type>(randomInt(Pickup::TypeCount));
-			createPickup(pos, type);
-		}
-	}
+	// Spawn pickups from the seeded schedule (in multiplayer the server hands out the seed)
+	PickupSpawner::Spawn spawn;
+	if (mPickupSpawner.update(dt, spawn))
+		createPickup(spawn.position, spawn.type);
 
 	// Setup commands to destroy entities
 	destroyEntitiesOutsideView();
 
+	// Spatial queries made by this frame's commands see the positions the previous frame ended with
+	mEntities.refreshSpatialIndex();
+
 	// Forward commands to scene graph, adapt velocity (scrolling, diagonal correction)
 	while (!mCommandQueue.isEmpty())
-		mSceneGraph.onCommand(mCommandQueue.pop(), dt);
+		dispatchCommand(mCommandQueue.pop(), dt);
 	adaptPlayerVelocity();
 
 	//guide missiles
@@ -99,15 +113,12 @@ void World::update(sf::Time dt)
 	// Collision detection and response (may destroy entities)
 	handleCollisions();
 
-	// Remove characters that were destroyed (World::removeWrecks() only destroys the entities, not the pointers in mPlayerCharacter)
-	auto firstToRemove = std::remove_if(mPlayerCharacters.begin(), mPlayerCharacters.end(), std::mem_fn(&Character::isMarkedForRemoval));
-	mPlayerCharacters.erase(firstToRemove, mPlayerCharacters.end());
-
-	// Remove all destroyed entities
-	mSceneGraph.removeWrecks();
+	// Remove destroyed entities
+	removeWrecks();
 
-	// Regular update step
+	// Regular update step, then missile guidance and movement over the entity store
 	mSceneGraph.update(dt, mCommandQueue);
+	mEntities.update(dt);
 
 	//handle player collision with platform
 	handleCollisionsPlatform();
@@ -148,13 +159,11 @@ CommandQueue& World::getCommandQueue()
 
 Character* World::getCharacter(int identifier) const
 {
-	FOREACH(Character* a, mPlayerCharacters)
-	{
-		if (a->getIdentifier() == identifier)
-			return a;
-	}
+	auto found = mCharacterHandles.find(identifier);
+	if (found == mCharacterHandles.end())
+		return nullptr;
 
-	return nullptr;
+	return static_cast<Character*>(mEntities.resolve(found->second));
 }
 
 void World::removeCharacter(int identifier)
@@ -164,26 +173,44 @@ void World::removeCharacter(int identifier)
 	{
 		character->destroy();
 		mPlayerCharacters.erase(std::find(mPlayerCharacters.begin(), mPlayerCharacters.end(), character));
+		mCharacterHandles.erase(identifier);
 	}
 }
 
 Character* World::addCharacter(int identifier, float x, float y)
 {
-	std::unique_ptr<Character> player(new Character(Character::Eagle, mTextures, mFonts));
+	std::unique_ptr<Character> player(new Character(Character::Eagle, mEntities, mTextures, mFonts));
 	player->setPosition(x, y);
 	player->setIdentifier(identifier);
 
+	mCharacterHandles[identifier] = player->getHandle();
 	mPlayerCharacters.push_back(player.get());
 	mSceneLayers[UpperAir]->attachChild(std::move(player));
 	return mPlayerCharacters.back();
 }
 
-void World::createPickup(sf::Vector2f position, Pickup::Type type)
+Pickup* World::createPickup(sf::Vector2f position, Pickup::Type type)
 {
-	std::unique_ptr<Pickup> pickup(new Pickup(type, mTextures));
+	std::unique_ptr<Pickup> pickup(new Pickup(type, mEntities, mTextures));
 	pickup->setPosition(position);
 	pickup->setVelocity(mGravity);
+
+	Pickup* result = pickup.get();
 	mSceneLayers[UpperAir]->attachChild(std::move(pickup));
+	return result;
+}
+
+Projectile* World::createProjectile(Projectile::Type type, int playerID, sf::Vector2f position, sf::Vector2f velocity, float rotation)
+{
+	std::unique_ptr<Projectile> projectile(new Projectile(type, mEntities, mTextures, playerID));
+	projectile->setPosition(position);
+	projectile->setVelocity(velocity);
+	projectile->setRotation(rotation);
+
+	// Same layer Character's fire commands attach to
+	Projectile* result = projectile.get();
+	mSceneLayers[LowerAir]->attachChild(std::move(projectile));
+	return result;
 }
 
 bool World::pollGameAction(GameActions::Action& out)
@@ -191,9 +218,20 @@ bool World::pollGameAction(GameActions::Action& out)
 	return mNetworkNode->pollGameAction(out);
 }
 
+void World::setPickupSchedule(sf::Uint32 seed, sf::Time meanInterval, sf::Uint32 nextIndex, sf::Time untilNext)
+{
+	mPickupSpawner.setSchedule(seed, meanInterval, nextIndex, untilNext);
+}
+
+const PickupSpawner& World::getPickupSpawner() const
+{
+	return mPickupSpawner;
+}
+
 void World::setWorldHeight(float height)
 {
 	mWorldBounds.height = height;
+	mEntities.setSpatialBounds(mWorldBounds);
 }
 
 bool World::hasAlivePlayer() const
@@ -240,11 +278,95 @@ void World::adaptPlayerVelocity()
 	}
 }
 
-void World::handleCollisions()
+void World::findContacts(ContactStage stage)
 {
-	std::set<SceneNode::Pair> collisionPairs;
-	mSceneGraph.checkSceneCollision(mSceneGraph, collisionPairs);
+	// Only nodes this stage has a response for go into the broadphase, in scene graph order
+	unsigned int stageCategories = Category::None;
+	for (std::size_t type = 0; type < ContactTypeCount; ++type)
+	{
+		if (ContactRules[type].stage == stage)
+			stageCategories |= ContactRules[type].first | ContactRules[type].second;
+	}
 
+	mBroadphase.clear();
+
+	Command collector;
+	collector.category = stageCategories;
+	collector.action = [this, stage] (SceneNode& node, sf::Time)
+	{
+		if (node.isDestroyed())
+			return;
+
+		// Whatever is on the other side of one of this stage's rules
+		unsigned int category = node.getCategory();
+		unsigned int collidesWith = Category::None;
+		for (std::size_t type = 0; type < ContactTypeCount; ++type)
+		{
+			const ContactRule& rule = ContactRules[type];
+			if (rule.stage != stage)
+				continue;
+
+			if (category & rule.first)
+				collidesWith |= rule.second;
+			if (category & rule.second)
+				collidesWith |= rule.first;
+		}
+
+		mBroadphase.insert(node, collidesWith);
+	};
+	mSceneGraph.onCommand(collector, sf::Time::Zero);
+
+	mCollisionPairs.clear();
+	mBroadphase.findPairs(mCollisionPairs);
+
+	// Classify by the first matching rule, swapping so the pair's first has the rule's first category
+	mCollisionTypes.clear();
+	mContactRuns.fill(0);
+	FOREACH(SceneNode::Pair& pair, mCollisionPairs)
+	{
+		unsigned int category1 = pair.first->getCategory();
+		unsigned int category2 = pair.second->getCategory();
+
+		ContactType found = ContactTypeCount;
+		for (std::size_t type = 0; type < ContactTypeCount && found == ContactTypeCount; ++type)
+		{
+			const ContactRule& rule = ContactRules[type];
+			if (rule.stage != stage)
+				continue;
+
+			if (rule.first & category1 && rule.second & category2)
+			{
+				found = static_cast<ContactType>(type);
+			}
+			else if (rule.first & category2 && rule.second & category1)
+			{
+				std::swap(pair.first, pair.second);
+				found = static_cast<ContactType>(type);
+			}
+		}
+
+		mCollisionTypes.push_back(found);
+		if (found != ContactTypeCount)
+			mContactRuns[found + 1]++;
+	}
+
+	// Counting sort by type; pairs keep their broadphase order within a run
+	for (std::size_t type = 1; type < mContactRuns.size(); ++type)
+		mContactRuns[type] += mContactRuns[type - 1];
+
+	mContacts.resize(mContactRuns.back());
+	std::array<std::size_t, ContactTypeCount> fill;
+	std::copy(mContactRuns.begin(), mContactRuns.end() - 1, fill.begin());
+	for (std::size_t i = 0; i < mCollisionPairs.size(); ++i)
+	{
+		if (mCollisionTypes[i] != ContactTypeCount)
+			mContacts[fill[mCollisionTypes[i]]++] = mCollisionPairs[i];
+	}
+}
+
+void World::handleCollisions()
+{
+	findContacts(ImpactContacts);
 
 	FOREACH(Character* characters, mPlayerCharacters)
 	{
@@ -266,77 +388,80 @@ void World::handleCollisions()
 		}
 	}
 
-	FOREACH(SceneNode::Pair pair, collisionPairs)
+	for (std::size_t i = mContactRuns[PlayerPlayerContact]; i < mContactRuns[PlayerPlayerContact + 1]; ++i)
 	{
-		if (matchesCategories(pair, Category::PlayerCharacter, Category::PlayerCharacter))
+		const SceneNode::Pair& pair = mContacts[i];
+
+		auto& player1 = static_cast<Character&>(*pair.first);
+		auto& player2 = static_cast<Character&>(*pair.second);
+
+		// Collision: Players bounce back on impact
+		float xVelocity1 = 0;
+		float xVelocity2 = 0;
+		if (fabs(player1.getVelocity().x) > fabs(player2.getVelocity().x)) {
+			xVelocity1 = player1.getKnockback() * player2.getVelocity().x;
+			xVelocity2 = player2.getKnockback() / 2 * player1.getVelocity().x;
+			player2.incrementKnockback(5.f);
+		}
+		else if (fabs(player1.getVelocity().x) < fabs(player2.getVelocity().x)) {
+			xVelocity2 = player2.getKnockback() * player1.getVelocity().x;
+			xVelocity1 = player1.getKnockback() / 2 * player2.getVelocity().x;
+			player1.incrementKnockback(5.f);
+		}
+		else {
+			xVelocity1 = player1.getKnockback() / 2 * player2.getVelocity().x;
+			xVelocity2 = player2.getKnockback() / 2 * player1.getVelocity().x;
+		}
+
+		float yVelocity1 = 0;
+		float yVelocity2 = 0;
+		if (fabs(player1.getVelocity().y) > fabs(player2.getVelocity().y)) {
+			yVelocity1 = -player1.getKnockback() / 2 * player1.getVelocity().y;
+		}
+		else if (fabs(player1.getVelocity().y) < fabs(player2.getVelocity().y)) {
+			yVelocity2 = -player2.getKnockback() / 2 * player2.getVelocity().y;
+		}
+		else
 		{
-			auto& player1 = static_cast<Character&>(*pair.first);
-			auto& player2 = static_cast<Character&>(*pair.second);
-
-			// Collision: Players bounce back on impact
-			float xVelocity1 = 0;
-			float xVelocity2 = 0;
-			if (fabs(player1.getVelocity().x) > fabs(player2.getVelocity().x)) {
-				xVelocity1 = player1.getKnockback() * player2.getVelocity().x;
-				xVelocity2 = player2.getKnockback() / 2 * player1.getVelocity().x;
-				player2.incrementKnockback(5.f);
-			}
-			else if (fabs(player1.getVelocity().x) < fabs(player2.getVelocity().x)) {
-				xVelocity2 = player2.getKnockback() * player1.getVelocity().x;
-				xVelocity1 = player1.getKnockback() / 2 * player2.getVelocity().x;
-				player1.incrementKnockback(5.f);
-			}
-			else {
-				xVelocity1 = player1.getKnockback() / 2 * player2.getVelocity().x;
-				xVelocity2 = player2.getKnockback() / 2 * player1.getVelocity().x;
-			}
+			xVelocity1 = player1.getKnockback() / 4 * player2.getVelocity().x;
+			xVelocity2 = player2.getKnockback() / 4 * player1.getVelocity().x;
+		}
 
-			float yVelocity1 = 0;
-			float yVelocity2 = 0;
-			if (fabs(player1.getVelocity().y) > fabs(player2.getVelocity().y)) {
-				yVelocity1 = -player1.getKnockback() / 2 * player1.getVelocity().y;
-			}
-			else if (fabs(player1.getVelocity().y) < fabs(player2.getVelocity().y)) {
-				yVelocity2 = -player2.getKnockback() / 2 * player2.getVelocity().y;
-			}
-			else
-			{
-				xVelocity1 = player1.getKnockback() / 4 * player2.getVelocity().x;
-				xVelocity2 = player2.getKnockback() / 4 * player1.getVelocity().x;
-			}
+		player1.setVelocity(xVelocity1, yVelocity1);
+		player2.setVelocity(xVelocity2, yVelocity2);
+	}
 
-			player1.setVelocity(xVelocity1, yVelocity1);
-			player2.setVelocity(xVelocity2, yVelocity2);
-		}
+	for (std::size_t i = mContactRuns[PlayerPickupContact]; i < mContactRuns[PlayerPickupContact + 1]; ++i)
+	{
+		const SceneNode::Pair& pair = mContacts[i];
 
-		else if (matchesCategories(pair, Category::PlayerCharacter, Category::Pickup))
-		{
-			auto& player = static_cast<Character&>(*pair.first);
-			auto& pickup = static_cast<Pickup&>(*pair.second);
+		auto& player = static_cast<Character&>(*pair.first);
+		auto& pickup = static_cast<Pickup&>(*pair.second);
 
-			// Apply pickup effect to player, destroy projectile
-			pickup.apply(player);
-			pickup.destroy();
-			player.playLocalSound(mCommandQueue, SoundEffect::CollectPickup);
-		}
+		// Apply pickup effect to player, destroy projectile
+		pickup.apply(player);
+		pickup.destroy();
+		player.playLocalSound(mCommandQueue, SoundEffect::CollectPickup);
+	}
 
-		else if (matchesCategories(pair, Category::PlayerCharacter, Category::AlliedProjectile))
-		{
-			auto& character = static_cast<Character&>(*pair.first);
-			auto& projectile = static_cast<Projectile&>(*pair.second);
-
-			if (character.getIdentifier() != projectile.playerID && projectile.isGuided()) {
-				// Apply projectileknockback + increment knockback multiplier
-				character.setVelocity(character.getKnockback() * projectile.getVelocity().x, character.getKnockback() / 2 * projectile.getVelocity().y);
-				character.incrementKnockback(20.f);
-				projectile.destroy();
-			}
-			else if (character.getIdentifier() != projectile.playerID) {
-				// Apply projectileknockback + increment knockback multiplier
-				character.setVelocity(character.getKnockback() / 4 * projectile.getVelocity().x, character.getKnockback() / 4 * projectile.getVelocity().y);
-				character.incrementKnockback(5.f);
-				projectile.destroy();
-			}
+	for (std::size_t i = mContactRuns[PlayerProjectileContact]; i < mContactRuns[PlayerProjectileContact + 1]; ++i)
+	{
+		const SceneNode::Pair& pair = mContacts[i];
+
+		auto& character = static_cast<Character&>(*pair.first);
+		auto& projectile = static_cast<Projectile&>(*pair.second);
+
+		if (character.getIdentifier() != projectile.playerID && projectile.isGuided()) {
+			// Apply projectileknockback + increment knockback multiplier
+			character.setVelocity(character.getKnockback() * projectile.getVelocity().x, character.getKnockback() / 2 * projectile.getVelocity().y);
+			character.incrementKnockback(20.f);
+			projectile.destroy();
+		}
+		else if (character.getIdentifier() != projectile.playerID) {
+			// Apply projectileknockback + increment knockback multiplier
+			character.setVelocity(character.getKnockback() / 4 * projectile.getVelocity().x, character.getKnockback() / 4 * projectile.getVelocity().y);
+			character.incrementKnockback(5.f);
+			projectile.destroy();
 		}
 	}
 }
@@ -349,50 +474,53 @@ void World::handleCollisionsPlatform()
 		character->mIsGrounded = false;
 	}
 
-	std::set<SceneNode::Pair> collisionPairs;
-	mSceneGraph.checkSceneCollision(mSceneGraph, collisionPairs);
-	FOREACH(SceneNode::Pair pair, collisionPairs)
+	findContacts(SupportContacts);
+
+	for (std::size_t i = mContactRuns[CharacterPlatformContact]; i < mContactRuns[CharacterPlatformContact + 1]; ++i)
 	{
-		if (matchesCategories(pair, Category::PlayerCharacter, Category::Platform))
-		{
-			auto& character = static_cast<Character&>(*pair.first);
-			auto& platform = static_cast<Platform&>(*pair.second);
-
-			//stop player from falling through
-			if (!character.mIsGrounded) {
-				character.setVelocity(character.getVelocity().x, 0);
-				if (platform.mType == Platform::largePlatform) {
-					character.setPosition(character.getPosition().x, platform.getPosition().y - 58);
-				}
-				else {
-					character.setPosition(character.getPosition().x, platform.getPosition().y - 50);
-				}
-				character.mIsGrounded = true;
+		const SceneNode::Pair& pair = mContacts[i];
+
+		auto& character = static_cast<Character&>(*pair.first);
+		auto& platform = static_cast<Platform&>(*pair.second);
+
+		//stop player from falling through
+		if (!character.mIsGrounded) {
+			character.setVelocity(character.getVelocity().x, 0);
+			if (platform.mType == Platform::largePlatform) {
+				character.setPosition(character.getPosition().x, platform.getPosition().y - 58);
 			}
-		}
-		else if (matchesCategories(pair, Category::Pickup, Category::Platform))
-		{
-			auto& pickup = static_cast<Pickup&>(*pair.first);
-			auto& platform = static_cast<Platform&>(*pair.second);
-
-			//stop player from falling through
-			if (!pickup.mIsGrounded) {
-				pickup.setVelocity(pickup.getVelocity().x, 0);
-				if (platform.mType == Platform::largePlatform) {
-					pickup.setPosition(pickup.getPosition().x, platform.getPosition().y - 48);
-				}
-				else {
-					pickup.setPosition(pickup.getPosition().x, platform.getPosition().y - 40);
-				}
-				pickup.mIsGrounded = true;
+			else {
+				character.setPosition(character.getPosition().x, platform.getPosition().y - 50);
 			}
+			character.mIsGrounded = true;
 		}
-		else if (matchesCategories(pair, Category::Projectile, Category::Platform))
-		{
-			auto& bullet = static_cast<Pickup&>(*pair.first);
-			bullet.destroy();
+	}
+
+	for (std::size_t i = mContactRuns[PickupPlatformContact]; i < mContactRuns[PickupPlatformContact + 1]; ++i)
+	{
+		const SceneNode::Pair& pair = mContacts[i];
+
+		auto& pickup = static_cast<Pickup&>(*pair.first);
+		auto& platform = static_cast<Platform&>(*pair.second);
+
+		//stop player from falling through
+		if (!pickup.mIsGrounded) {
+			pickup.setVelocity(pickup.getVelocity().x, 0);
+			if (platform.mType == Platform::largePlatform) {
+				pickup.setPosition(pickup.getPosition().x, platform.getPosition().y - 48);
+			}
+			else {
+				pickup.setPosition(pickup.getPosition().x, platform.getPosition().y - 40);
+			}
+			pickup.mIsGrounded = true;
 		}
 	}
+
+	for (std::size_t i = mContactRuns[ProjectilePlatformContact]; i < mContactRuns[ProjectilePlatformContact + 1]; ++i)
+	{
+		auto& bullet = static_cast<Projectile&>(*mContacts[i].first);
+		bullet.destroy();
+	}
 }
 
 void World::updateSounds()
@@ -463,6 +591,7 @@ void World::buildScene()
 
 	//Add sound effect node
 	std::unique_ptr<SoundNode> soundNode(new SoundNode(mSounds));
+	mSoundNode = soundNode.get();
 	mSceneGraph.attachChild(std::move(soundNode));
 
 	// Add network node, if necessary
@@ -489,7 +618,7 @@ void World::addPlatforms()
 
 void World::addPlatform(float x, float y, Platform::Type type)
 {
-	std::unique_ptr<Platform> plat(new Platform(type, mTextures));
+	std::unique_ptr<Platform> plat(new Platform(type, mEntities, mTextures));
 	plat->setPosition(x, y);
 
 	mSceneLayers[UpperAir]->attachChild(std::move(plat));
@@ -508,18 +637,50 @@ void World::destroyEntitiesOutsideView()
 	mCommandQueue.push(command);
 }
 
-void World::guideMissiles()
+void World::removeWrecks()
 {
-	// Setup command that stores all enemies in mActiveEnemies
-	Command playerCollector;
-	playerCollector.category = Category::PlayerCharacter;
-	playerCollector.action = derivedAction<Character>([this](Character& player, sf::Time)
+	// Only entities whose hitpoints ran out this or an earlier frame are looked at
+	mEntities.collectWrecks(mWrecks);
+	if (mWrecks.empty())
+		return;
+
+	FOREACH(SceneNode* wreck, mWrecks)
 	{
-		if (!player.isDestroyed())
-			mActivePlayers.push_back(&player);
-	});
+		auto character = std::find(mPlayerCharacters.begin(), mPlayerCharacters.end(), wreck);
+		if (character == mPlayerCharacters.end())
+			continue;
 
-	// Setup command that guides all missiles to the enemy which is currently closest to the player
+		// Unless the identifier went to a new character meanwhile
+		auto handle = mCharacterHandles.find((*character)->getIdentifier());
+		if (handle != mCharacterHandles.end() && mEntities.resolve(handle->second) == wreck)
+			mCharacterHandles.erase(handle);
+
+		mPlayerCharacters.erase(character);
+	}
+
+	SceneNode::detachNodes(mWrecks, mWreckage);
+	mWreckage.clear();
+	mWrecks.clear();
+}
+
+void World::dispatchCommand(const Command& command, sf::Time dt)
+{
+	// Player input names its character, no need to offer it to every other one
+	if (command.target != 0)
+	{
+		Character* character = getCharacter(command.target);
+		if (character && (character->getCategory() & command.category))
+			command.action(*character, dt);
+	}
+	else
+	{
+		mSceneGraph.onCommand(command, dt);
+	}
+}
+
+void World::guideMissiles()
+{
+	// Setup command that guides all missiles to the player closest to them, other than the shooter
 	Command missileGuider;
 	missileGuider.category = Category::AlliedProjectile;
 	missileGuider.action = derivedAction<Projectile>([this](Projectile& missile, sf::Time)
@@ -528,29 +689,22 @@ void World::guideMissiles()
 		if (!missile.isGuided())
 			return;
 
-		float minDistance = std::numeric_limits<float>::max();
-		Character* closestPlayer = nullptr;
-
-		// Find closest enemy
-		FOREACH(Character* player, mActivePlayers)
+		int shooter = missile.playerID;
+		Entity* closestPlayer = queryNearest(missile.getWorldPosition(), Category::PlayerCharacter, [shooter](Entity& player)
 		{
-			float playerDistance = distance(missile, *player);
-
-			if (playerDistance < minDistance && player->getIdentifier() != missile.playerID)
-			{
-				closestPlayer = player;
-				minDistance = playerDistance;
-			}
-		}
+			return static_cast<Character&>(player).getIdentifier() != shooter;
+		});
 
 		if (closestPlayer)
 			missile.guideTowards(closestPlayer->getWorldPosition());
 	});
 
-	// Push commands, reset active enemies
-	mCommandQueue.push(playerCollector);
 	mCommandQueue.push(missileGuider);
-	mActivePlayers.clear();
+}
+
+void World::queryRadius(sf::Vector2f position, float radius, unsigned int categoryMask, std::vector<Entity*>& out) const
+{
+	mEntities.queryRadius(position, radius, categoryMask, out);
 }
 
 sf::FloatRect World::getViewBounds() const
@@ -560,10 +714,11 @@ sf::FloatRect World::getViewBounds() const
 
 Character* World::addCharacter(int identifier)
 {
-	std::unique_ptr<Character> player(new Character(Character::Eagle, mTextures, mFonts));
+	std::unique_ptr<Character> player(new Character(Character::Eagle, mEntities, mTextures, mFonts));
 	player->setPosition(mWorldView.getCenter());
 	player->setIdentifier(identifier);
 
+	mCharacterHandles[identifier] = player->getHandle();
 	mPlayerCharacters.push_back(player.get());
 	mSceneLayers[UpperAir]->attachChild(std::move(player));
 	return mPlayerCharacters.back();
@@ -572,4 +727,336 @@ Character* World::addCharacter(int identifier)
 std::map<int, int> World::getSurvivabilities() 
 {
 	return mSurvivabilities;
-}
\ No newline at end of file
+}
+void World::writeSnapshot(std::vector<sf::Packet>& chunks, std::size_t entitiesPerChunk)
+{
+	assert(entitiesPerChunk > 0);
+
+	// Collect every live dynamic entity; platforms and background are rebuilt by buildScene()
+	std::vector<Entity*> entities;
+
+	Command collector;
+	collector.category = Category::PlayerCharacter | Category::Projectile | Category::Pickup;
+	collector.action = derivedAction<Entity>([&entities](Entity& entity, sf::Time)
+	{
+		if (!entity.isDestroyed())
+			entities.push_back(&entity);
+	});
+	mSceneGraph.onCommand(collector, sf::Time::Zero);
+
+	// Always send at least one (possibly empty) chunk, so the receiver knows when it is done
+	std::size_t chunkCount = std::max<std::size_t>(1, (entities.size() + entitiesPerChunk - 1) / entitiesPerChunk);
+
+	for (std::size_t chunk = 0; chunk < chunkCount; ++chunk)
+	{
+		std::size_t begin = chunk * entitiesPerChunk;
+		std::size_t end = std::min(begin + entitiesPerChunk, entities.size());
+
+		sf::Packet packet;
+		packet << static_cast<sf::Int32>(Client::WorldSnapshotChunk);
+		packet << WorldSnapshot::Version << static_cast<sf::Int32>(chunk) << static_cast<sf::Int32>(chunkCount);
+		packet << static_cast<sf::Int32>(end - begin);
+
+		for (std::size_t i = begin; i < end; ++i)
+		{
+			Entity& entity = *entities[i];
+			sf::Vector2f position = entity.getPosition();
+			sf::Vector2f velocity = entity.getVelocity();
+
+			if (entity.getCategory() & Category::PlayerCharacter)
+			{
+				auto& character = static_cast<Character&>(entity);
+				packet << static_cast<sf::Int32>(WorldSnapshot::CharacterEntry) << static_cast<sf::Int32>(character.getIdentifier());
+				packet << position.x << position.y << velocity.x << velocity.y;
+				packet << static_cast<sf::Int32>(character.getHitpoints()) << static_cast<sf::Int32>(character.getMissileAmmo());
+				packet << character.getKnockback() << static_cast<sf::Int32>(character.getSurvivability()) << character.mIsGrounded;
+			}
+			else if (entity.getCategory() & Category::Projectile)
+			{
+				auto& projectile = static_cast<Projectile&>(entity);
+				packet << static_cast<sf::Int32>(WorldSnapshot::ProjectileEntry);
+				packet << static_cast<sf::Int32>(projectile.getType()) << static_cast<sf::Int32>(projectile.playerID);
+				packet << position.x << position.y << velocity.x << velocity.y << projectile.getRotation();
+			}
+			else
+			{
+				auto& pickup = static_cast<Pickup&>(entity);
+				packet << static_cast<sf::Int32>(WorldSnapshot::PickupEntry) << static_cast<sf::Int32>(pickup.getType());
+				packet << position.x << position.y << velocity.x << velocity.y << pickup.mIsGrounded;
+			}
+		}
+
+		chunks.push_back(packet);
+	}
+}
+
+void World::applySnapshotChunk(sf::Packet& packet)
+{
+	// Expects the packet positioned right after the [version] [index] [count] header
+	sf::Int32 entryCount;
+	packet >> entryCount;
+
+	for (sf::Int32 i = 0; i < entryCount && packet; ++i)
+	{
+		sf::Int32 entryType;
+		packet >> entryType;
+
+		switch (entryType)
+		{
+		case WorldSnapshot::CharacterEntry:
+		{
+			sf::Int32 identifier, hitpoints, missiles, survivability;
+			sf::Vector2f position, velocity;
+			float knockback;
+			bool grounded;
+			packet >> identifier >> position.x >> position.y >> velocity.x >> velocity.y;
+			packet >> hitpoints >> missiles >> knockback >> survivability >> grounded;
+
+			// Characters are created from InitialState (they need a Player), the snapshot only refines them
+			Character* character = packet ? getCharacter(identifier) : nullptr;
+			if (character)
+			{
+				character->setPosition(position);
+				character->setVelocity(velocity);
+				character->setHitpoints(hitpoints);
+				character->setMissileAmmo(missiles);
+				character->setKnockback(knockback);
+				character->setSurvivability(survivability);
+				character->mIsGrounded = grounded;
+			}
+		} break;
+
+		case WorldSnapshot::ProjectileEntry:
+		{
+			sf::Int32 type, owner;
+			sf::Vector2f position, velocity;
+			float rotation;
+			packet >> type >> owner >> position.x >> position.y >> velocity.x >> velocity.y >> rotation;
+
+			if (packet && type >= 0 && type < Projectile::TypeCount)
+				createProjectile(static_cast<Projectile::Type>(type), owner, position, velocity, rotation);
+		} break;
+
+		case WorldSnapshot::PickupEntry:
+		{
+			sf::Int32 type;
+			sf::Vector2f position, velocity;
+			bool grounded;
+			packet >> type >> position.x >> position.y >> velocity.x >> velocity.y >> grounded;
+
+			if (packet && type >= 0 && type < Pickup::TypeCount)
+			{
+				Pickup* pickup = createPickup(position, static_cast<Pickup::Type>(type));
+				pickup->setVelocity(velocity);
+				pickup->mIsGrounded = grounded;
+			}
+		} break;
+
+		default:
+			// Unknown entry: the rest of the chunk can't be parsed
+			return;
+		}
+	}
+}
+
+namespace
+{
+	// FNV-1a over the raw bits, so equal floats hash equally and any difference shows
+	void hashBytes(sf::Uint32& hash, const void* data, std::size_t size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 16777619u;
+		}
+	}
+}
+
+sf::Uint32 World::getStateChecksum()
+{
+	sf::Uint32 hash = 2166136261u;
+
+	FOREACH(Character* character, mPlayerCharacters)
+	{
+		sf::Int32 identifier = character->getIdentifier();
+		sf::Int32 hitpoints = character->getHitpoints();
+		sf::Vector2f position = character->getPosition();
+		sf::Vector2f velocity = character->getVelocity();
+		float knockback = character->getKnockback();
+
+		hashBytes(hash, &identifier, sizeof(identifier));
+		hashBytes(hash, &hitpoints, sizeof(hitpoints));
+		hashBytes(hash, &position, sizeof(position));
+		hashBytes(hash, &velocity, sizeof(velocity));
+		hashBytes(hash, &knockback, sizeof(knockback));
+	}
+
+	// Same attach order on every peer, like saveState() walks them
+	Command hasher;
+	hasher.category = Category::Projectile | Category::Pickup;
+	hasher.action = derivedAction<Entity>([&hash](Entity& entity, sf::Time)
+	{
+		if (entity.isDestroyed())
+			return;
+
+		sf::Int32 type = (entity.getCategory() & Category::Projectile)
+			? static_cast<Projectile&>(entity).getType()
+			: Projectile::TypeCount + static_cast<Pickup&>(entity).getType();
+		sf::Vector2f position = entity.getPosition();
+		sf::Vector2f velocity = entity.getVelocity();
+
+		hashBytes(hash, &type, sizeof(type));
+		hashBytes(hash, &position, sizeof(position));
+		hashBytes(hash, &velocity, sizeof(velocity));
+	});
+	mSceneGraph.onCommand(hasher, sf::Time::Zero);
+
+	// A peer that drew a different number of random values or spawned a different pickup has diverged too
+	sf::Uint32 draws = getRandomDrawCount();
+	sf::Uint32 nextPickup = mPickupSpawner.getNextIndex();
+	sf::Int64 untilNextPickup = mPickupSpawner.getTimeUntilNext().asMicroseconds();
+	hashBytes(hash, &draws, sizeof(draws));
+	hashBytes(hash, &nextPickup, sizeof(nextPickup));
+	hashBytes(hash, &untilNextPickup, sizeof(untilNextPickup));
+
+	return hash;
+}
+
+void World::saveState(Snapshot& out)
+{
+	out.characters.resize(mPlayerCharacters.size());
+	for (std::size_t i = 0; i < mPlayerCharacters.size(); ++i)
+		mPlayerCharacters[i]->saveState(out.characters[i]);
+
+	// clear() keeps the capacity, so a warmed up snapshot is refilled without allocating
+	out.projectiles.clear();
+	out.pickups.clear();
+
+	Command collector;
+	collector.category = Category::Projectile | Category::Pickup;
+	collector.action = derivedAction<Entity>([&out](Entity& entity, sf::Time)
+	{
+		if (entity.isDestroyed())
+			return;
+
+		if (entity.getCategory() & Category::Projectile)
+		{
+			auto& projectile = static_cast<Projectile&>(entity);
+			Snapshot::ProjectileState state = { projectile.getType(), projectile.playerID, projectile.getPosition(),
+				projectile.getVelocity(), projectile.getTargetDirection(), projectile.getRotation() };
+			out.projectiles.push_back(state);
+		}
+		else
+		{
+			auto& pickup = static_cast<Pickup&>(entity);
+			Snapshot::PickupState state = { pickup.getType(), pickup.getPosition(), pickup.getVelocity(), pickup.mIsGrounded };
+			out.pickups.push_back(state);
+		}
+	});
+	mSceneGraph.onCommand(collector, sf::Time::Zero);
+
+	out.pickupSpawner = mPickupSpawner;
+	saveRandomState(out.random);
+}
+
+void World::restoreState(const Snapshot& snapshot)
+{
+	// Characters live for the whole match and are overwritten in place. If one was removed since (or the snapshot
+	// has different ones), the layer's characters are rebuilt in snapshot order, so update and collision order
+	// match the timeline the snapshot came from
+	bool sameCharacters = snapshot.characters.size() == mPlayerCharacters.size();
+	for (std::size_t i = 0; sameCharacters && i < mPlayerCharacters.size(); ++i)
+		sameCharacters = mPlayerCharacters[i]->getIdentifier() == snapshot.characters[i].identifier;
+
+	if (!sameCharacters)
+	{
+		std::vector<SceneNode::Ptr> detached;
+		FOREACH(Character* character, mPlayerCharacters)
+			detached.push_back(mSceneLayers[UpperAir]->detachChild(*character));
+		mPlayerCharacters.clear();
+
+		FOREACH(const Character::State& state, snapshot.characters)
+		{
+			auto found = std::find_if(detached.begin(), detached.end(), [&state](SceneNode::Ptr& node)
+			{
+				return node && static_cast<Character&>(*node).getIdentifier() == state.identifier;
+			});
+
+			if (found != detached.end())
+			{
+				mPlayerCharacters.push_back(static_cast<Character*>(found->get()));
+				mSceneLayers[UpperAir]->attachChild(std::move(*found));
+			}
+			else
+			{
+				addCharacter(state.identifier, state.position.x, state.position.y);
+			}
+		}
+	}
+
+	for (std::size_t i = 0; i < mPlayerCharacters.size(); ++i)
+		mPlayerCharacters[i]->restoreState(snapshot.characters[i]);
+
+	// Projectiles and pickups come and go, so they are recreated from the snapshot. Detached in one pass per
+	// layer; one detachChild() each would search and shift the layer's children for every node
+	std::vector<SceneNode*> removed;
+
+	Command collector;
+	collector.category = Category::Projectile | Category::Pickup;
+	collector.action = [&removed](SceneNode& node, sf::Time)
+	{
+		removed.push_back(&node);
+	};
+	mSceneGraph.onCommand(collector, sf::Time::Zero);
+
+	std::vector<SceneNode::Ptr> detached;
+	SceneNode::detachNodes(removed, detached);
+
+	// Freed before the new ones are created, so the pools hand the same slots back out
+	detached.clear();
+
+	FOREACH(const Snapshot::ProjectileState& state, snapshot.projectiles)
+	{
+		Projectile* projectile = createProjectile(state.type, state.playerID, state.position, state.velocity, state.rotation);
+		projectile->setTargetDirection(state.targetDirection);
+	}
+
+	FOREACH(const Snapshot::PickupState& state, snapshot.pickups)
+	{
+		Pickup* pickup = createPickup(state.position, state.type);
+		pickup->setVelocity(state.velocity);
+		pickup->mIsGrounded = state.grounded;
+	}
+
+	mPickupSpawner = snapshot.pickupSpawner;
+	restoreRandomState(snapshot.random);
+}
+
+void World::setMuted(bool flag)
+{
+	mSoundNode->setMuted(flag);
+	if (mNetworkNode)
+		mNetworkNode->setMuted(flag);
+}
+
+void World::resetRound(const Snapshot& roundStart, unsigned int seed)
+{
+	// Commands of the last round must not reach the new one
+	while (!mCommandQueue.isEmpty())
+		mCommandQueue.pop();
+
+	restoreState(roundStart);
+	mSurvivabilities.clear();
+
+	// Same start, different round
+	setRandomSeed(seed);
+	if (!mNetworkedWorld)
+		seedPickupSchedule();
+}
+
+void World::seedPickupSchedule()
+{
+	sf::Uint32 seed = static_cast<sf::Uint32>(randomInt(std::numeric_limits<int>::max()));
+	setPickupSchedule(seed, sf::seconds(15.f), 0, PickupSpawner::gapAfter(seed, 0, sf::seconds(15.f)));
+}
@@ -11,14 +11,20 @@
 #include "BloomEffect.hpp"
 #include "SoundPlayer.hpp"
 #include "NetworkProtocol.hpp"
+#include "PickupSpawner.hpp"
+#include "Broadphase.hpp"
+#include "EntityStore.hpp"
+#include "Utility.hpp"
 
 
 #include <SFML/System/NonCopyable.hpp>
 #include <SFML/Graphics/View.hpp>
 #include <SFML/Graphics/Texture.hpp>
+#include <SFML/Network/Packet.hpp>
 
 #include <array>
 #include <queue>
+#include <unordered_map>
 
 //Foward declaration
 namespace sf
@@ -27,11 +33,43 @@ namespace sf
 }
 
 class NetworkNode;
+class SoundNode;
 
 class World : private sf::NonCopyable
 {
+public:
+	// Complete simulation state for rollback; reusing a Snapshot keeps saving allocation-free once its vectors have grown
+	struct Snapshot
+	{
+		struct ProjectileState
+		{
+			Projectile::Type			type;
+			int							playerID;
+			sf::Vector2f				position;
+			sf::Vector2f				velocity;
+			sf::Vector2f				targetDirection;
+			float						rotation;
+		};
+
+		struct PickupState
+		{
+			Pickup::Type				type;
+			sf::Vector2f				position;
+			sf::Vector2f				velocity;
+			bool						grounded;
+		};
+
+		std::vector<Character::State>	characters;
+		std::vector<ProjectileState>	projectiles;
+		std::vector<PickupState>		pickups;
+		PickupSpawner					pickupSpawner;
+		RandomState						random;
+	};
+
+
 public:
 	explicit World(sf::RenderTarget& window, FontHolder& font, SoundPlayer& sounds, bool networked = false);
+	~World();
 	void update(sf::Time dt);
 	void draw();
 
@@ -50,11 +88,40 @@ public:
 	int isLastOneStanding();
 
 	Character* getCharacter(int identifier) const;
+
+	// Nearest live entity in categoryMask that accept(entity) agrees to, and all live ones within radius
+	// (unordered). Positions are those at the start of the current update
+	template <typename Accept>
+	Entity* queryNearest(sf::Vector2f position, unsigned int categoryMask, Accept accept) const;
+	void queryRadius(sf::Vector2f position, float radius, unsigned int categoryMask, std::vector<Entity*>& out) const;
 	sf::FloatRect getBattlefieldBounds() const;
 
-	void createPickup(sf::Vector2f position, Pickup::Type type);
+	Pickup* createPickup(sf::Vector2f position, Pickup::Type type);
+	Projectile* createProjectile(Projectile::Type type, int playerID, sf::Vector2f position, sf::Vector2f velocity, float rotation);
 	bool pollGameAction(GameActions::Action& out);
 
+	void setPickupSchedule(sf::Uint32 seed, sf::Time meanInterval, sf::Uint32 nextIndex, sf::Time untilNext);
+	const PickupSpawner& getPickupSpawner() const;
+
+	// Join-in-progress: serialize the dynamic entities into packets of at most entitiesPerChunk entries
+	void writeSnapshot(std::vector<sf::Packet>& chunks, std::size_t entitiesPerChunk);
+	void applySnapshotChunk(sf::Packet& packet);
+
+	// Hash of the simulation-relevant state (entities, random sequence, pickup schedule), compared between
+	// lockstep peers to detect desyncs
+	sf::Uint32 getStateChecksum();
+
+	// Rollback: only valid between two update() calls
+	void saveState(Snapshot& out);
+	void restoreState(const Snapshot& snapshot);
+
+	// While re-simulating: what already happened once plays no sounds and emits no game actions again
+	void setMuted(bool flag);
+
+	// Rematch without rebuilding: textures, shaders and the scene stay, the simulation goes back to roundStart
+	// (saved with saveState) and the random sequence and pickup schedule start over from seed
+	void resetRound(const Snapshot& roundStart, unsigned int seed);
+
 private:
 	void loadTextures(); 
 	void adaptPlayerPosition();
@@ -66,7 +133,10 @@ private:
 	void buildScene();
 	void addPlatforms();
 	void destroyEntitiesOutsideView();
+	void removeWrecks();
+	void dispatchCommand(const Command& command, sf::Time dt);
 	void guideMissiles();
+	void seedPickupSchedule();
 
 private:
 	enum Layer
@@ -77,6 +147,37 @@ private:
 		LayerCount
 	};
 
+	// Category pairs with a collision response; contacts are grouped by type, in this order
+	enum ContactType
+	{
+		PlayerPlayerContact,
+		PlayerPickupContact,
+		PlayerProjectileContact,
+		CharacterPlatformContact,
+		PickupPlatformContact,
+		ProjectilePlatformContact,
+		ContactTypeCount
+	};
+
+	// Impacts set velocities the scene update then applies; platform support needs the moved positions
+	enum ContactStage
+	{
+		ImpactContacts,
+		SupportContacts
+	};
+
+	struct ContactRule
+	{
+		ContactStage stage;
+		unsigned int first;
+		unsigned int second;
+	};
+
+	static const ContactRule			ContactRules[ContactTypeCount];
+
+private:
+	void findContacts(ContactStage stage);
+
 	struct SpawnPoint
 	{
 		SpawnPoint(Character::Type type, float x, float y)
@@ -102,9 +203,17 @@ private:
 	FontHolder&							mFonts;
 	SoundPlayer&						mSounds;
 
+	EntityStore							mEntities;				// before mSceneGraph: entities unregister when destroyed
 	SceneNode							mSceneGraph;
 	std::array<SceneNode*, LayerCount>	mSceneLayers;
 	CommandQueue						mCommandQueue;
+	Broadphase							mBroadphase;			// 64 px cells, about a character
+	std::vector<SceneNode::Pair>		mCollisionPairs;
+	std::vector<ContactType>			mCollisionTypes;		// parallel to mCollisionPairs
+	std::vector<SceneNode::Pair>		mContacts;				// sorted by type, first matches the rule's first
+	std::array<std::size_t, ContactTypeCount + 1> mContactRuns;	// mContacts offsets per type
+	std::vector<SceneNode*>				mWrecks;				// removeWrecks() scratch, kept for its capacity
+	std::vector<SceneNode::Ptr>			mWreckage;
 
 	sf::FloatRect						mWorldBounds;
 	sf::Vector2f						mSpawnPosition;
@@ -113,12 +222,16 @@ private:
 	float								mScrollSpeedCompensation;
 	std::vector<Character*>				mPlayerCharacters;
 
-	std::vector<Character*>				mActivePlayers;
+	std::unordered_map<int, EntityHandle> mCharacterHandles;	// by identifier; stale once the character is gone
+	PickupSpawner						mPickupSpawner;
 	std::map<int, int>					mSurvivabilities;
 
 	BloomEffect							mBloomEffect;
 
 	bool								mNetworkedWorld;
 	NetworkNode*						mNetworkNode;
+	SoundNode*							mSoundNode;
 	SpriteNode*							mFinishSprite;
-};
\ No newline at end of file
+};
+
+#include "World.inl"
\ No newline at end of file
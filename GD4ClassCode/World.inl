@@ -0,0 +1,5 @@
+template <typename Accept>
+Entity* World::queryNearest(sf::Vector2f position, unsigned int categoryMask, Accept accept) const
+{
+	return mEntities.queryNearest(position, categoryMask, accept);
+}
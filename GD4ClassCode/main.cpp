@@ -1,17 +1,94 @@
 #include "Application.hpp"
+#include "LobbyGateway.hpp"
+#include "GameServer.hpp"
+#include "SpectatorRelay.hpp"
+#include "Benchmarks.hpp"
 
 #include <stdexcept>
 #include <iostream>
-Application app;
+#include <string>
+#include <cstdlib>
 
-int main()
+
+// Headless modes, both run until Enter is pressed:
+//   --gateway [localServers]          matchmaking gateway, optionally with its own loopback servers (default 2)
+//   --server [port] [gatewayAddress] [botSlots]  dedicated game server registering with a gateway
+//   --relay [address] [port] [delay]  spectator relay for the game server at address:port, delay in seconds
+// and one that exits on its own:
+//   --bot-benchmark                   cost per bot of the server's batched bot AI
+//   --collision-benchmark             broadphase against all-pairs collision tests, up to 10000 projectiles
+//   --command-benchmark               draining a frame's commands by tree walk and by category index
+//   --entity-benchmark                5000 entities updated by updateCurrent() overrides and by EntityStore
+//   --spatial-benchmark               2000 homing missiles finding their closest target by scan and by SpatialIndex
+//   --rollback-benchmark              World save, restore and 1 to 8 tick re-simulations in a busy lockstep match
+//   --outbox-check                    partial sends through PacketOutbox on a loopback connection, exits with 1 if the stream broke
+int main(int argc, char* argv[])
 {
+	std::string mode = (argc > 1) ? argv[1] : "";
+
 	try {
-		app.run();
+		if (mode == "--gateway")
+		{
+			std::size_t localServers = (argc > 2) ? std::atoi(argv[2]) : 2;
+			LobbyGateway gateway(localServers);
+			std::cout << "Gateway running on port " << GatewayPort << " with " << localServers << " local servers, press Enter to stop" << std::endl;
+			std::cin.ignore();
+		}
+		else if (mode == "--server")
+		{
+			unsigned short port = (argc > 2) ? static_cast<unsigned short>(std::atoi(argv[2])) : ServerPort;
+			sf::IpAddress gateway = (argc > 3) ? sf::IpAddress(argv[3]) : sf::IpAddress::LocalHost;
+			std::size_t botSlots = (argc > 4) ? std::atoi(argv[4]) : GameServer::DefaultBotSlots;
+			GameServer server(sf::Vector2u(1024, 768), false, port, gateway, botSlots);
+			std::cout << "Server running on port " << port << ", press Enter to stop" << std::endl;
+			std::cin.ignore();
+		}
+		else if (mode == "--relay")
+		{
+			sf::IpAddress address = (argc > 2) ? sf::IpAddress(argv[2]) : sf::IpAddress::LocalHost;
+			unsigned short port = (argc > 3) ? static_cast<unsigned short>(std::atoi(argv[3])) : ServerPort;
+			sf::Time delay = sf::seconds((argc > 4) ? static_cast<float>(std::atof(argv[4])) : 0.f);
+			SpectatorRelay relay(address, port, delay);
+			std::cout << "Relay for " << address.toString() << ":" << port << " running on port " << SpectatorRelayPort << ", press Enter to stop" << std::endl;
+			std::cin.ignore();
+		}
+		else if (mode == "--bot-benchmark")
+		{
+			runBotBenchmark();
+		}
+		else if (mode == "--collision-benchmark")
+		{
+			runCollisionBenchmark();
+		}
+		else if (mode == "--command-benchmark")
+		{
+			runCommandBenchmark();
+		}
+		else if (mode == "--entity-benchmark")
+		{
+			runEntityBenchmark();
+		}
+		else if (mode == "--spatial-benchmark")
+		{
+			runSpatialBenchmark();
+		}
+		else if (mode == "--rollback-benchmark")
+		{
+			runRollbackBenchmark();
+		}
+		else if (mode == "--outbox-check")
+		{
+			return runOutboxCheck() ? 0 : 1;
+		}
+		else
+		{
+			Application app;
+			app.run();
+		}
 	}
 	catch (std::exception& e)
 	{
 		std::cout << "Exception: " << e.what() << std::endl;
 		std::cin.ignore();
 	}
-}
\ No newline at end of file
+}